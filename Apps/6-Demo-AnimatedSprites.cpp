@@ -32,14 +32,14 @@ void MouseMove(float x, float y, bool leftDown, bool rightDown) {
 
 // Sprite Intersection
 
-void GetPts(Sprite s, vec2 *pts) {
+void GetPts(Sprite &s, vec2 *pts) {
 	vec4 x1 = s.ptTransform*vec4(-1,-1,0,1), x2 = s.ptTransform*vec4(-1,+1,0,1),
 		 x3 = s.ptTransform*vec4(+1,+1,0,1), x4 = s.ptTransform*vec4(+1,-1,0,1);
 	pts[0] = vec2(x1.x, x1.y); pts[1] = vec2(x2.x, x2.y);
 	pts[2] = vec2(x3.x, x3.y); pts[3] = vec2(x4.x, x4.y);
 }
 
-void Outline(Sprite s) {
+void Outline(Sprite &s) {
 	vec2 pts[4];
 	GetPts(s, pts);
 	for (int i = 0; i < 4; i++) Line(pts[i], pts[(i+1)%4], 3, vec3(1, 1, 0));
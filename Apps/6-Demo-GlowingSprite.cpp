@@ -56,15 +56,7 @@ public:
 			Glow::BuildShader();
 		glUseProgram(glowSpriteShader);
 		glActiveTexture(GL_TEXTURE0+textureUnit);
-		if (nFrames) { // animation
-			time_t now = clock();
-			if (now > change) {
-				frame = (frame+1)%nFrames;
-				change = now+(time_t)(frameDuration*CLOCKS_PER_SEC);
-			}
-			glBindTexture(GL_TEXTURE_2D, textureNames[frame]);
-		}
-		else glBindTexture(GL_TEXTURE_2D, textureName);
+		glBindTexture(GL_TEXTURE_2D, textureName); // not animated (frames are a texture array, see Sprite shader)
 		SetUniform(glowSpriteShader, "textureImage", (int) textureUnit);
 		SetUniform(glowSpriteShader, "useMat", matName > 0);
 		SetUniform(glowSpriteShader, "nTexChannels", nTexChannels);
@@ -45,8 +45,10 @@ void Display() {
 	glEnable(GL_DEPTH_TEST);
 	// background
 	background.Display();
-	// display foreground sprites, testing for collision
-	int nHitPixels = TestCollisions(sprites);
+	// display foreground sprites back to front (z decreases with index), test for collision on CPU
+	for (int i = (int) sprites.size()-1; i >= 0; i--)
+		sprites[i]->Display();
+	int nCollisions = FindCollisions(sprites);
 	if (showOutlines)
 		for (Sprite *s : sprites) {
 			bool hit = false;
@@ -62,9 +64,9 @@ void Display() {
 		ShowCollide(*s);
 	glDisable(GL_DEPTH_TEST);
 	UseDrawShader(ScreenMode());
-	int w = 145+16*((int)log10(nHitPixels)), y = VPh()-40;
+	int w = 145+16*(nCollisions > 9? (int)log10(nCollisions) : 0), y = VPh()-40;
 	Quad(0, y, 0, y+40, w, y+40, w, y, true, vec3(0,0,1), .4f);
-	Text(10, y+10, vec3(1), 16, "%i hit pixels", nHitPixels);
+	Text(10, y+10, vec3(1), 16, "%i collisions", nCollisions);
 	// depth test needed for mouse selection
 	glEnable(GL_DEPTH_TEST);
 	glFlush();
@@ -31,6 +31,8 @@ public:
 Sprite background;
 const int nFallingSprites = 4;
 FallingSprite fallingSprites[nFallingSprites];
+SpriteBatch fallingBatch;	// one instanced draw for all falling sprites
+int lilyLayer = 0;
 
 // meshes
 string meshNames[] = {"Bench", "Cat"};
@@ -119,8 +121,10 @@ void Display() {
 	for (int i = 0; i < nMeshes; i++)
 		meshes[i].Display(camera);
 	// draw sprites
+	fallingBatch.Clear();
 	for (int i = 0; i < nFallingSprites; i++)
-		fallingSprites[i].Display();
+		fallingBatch.Add(fallingSprites[i], lilyLayer);
+	fallingBatch.Display();
 	glDisable(GL_DEPTH_TEST);
 	UseDrawShader(camera.fullview);
 	Disk(light, 9, vec3(1, 1, 0));
@@ -140,10 +144,9 @@ void ReadSprites() {
 	// read background, set sprites
 	background.Initialize(dirImages+"Earth.tga");
 	srand((unsigned) time(NULL));
+	lilyLayer = fallingBatch.AddImage(dirImages+"Lily.tga", dirImages+"Mat.tga");
 	for (int i = 0; i < nFallingSprites; i++) {
 		FallingSprite &f = fallingSprites[i];
-		f.Initialize(dirImages+"Lily.tga", dirImages+"Mat.tga");
-		float scale = Random(.2f, .5f);
 		f.fallingRate = Random(.1f, 1.25f);
 		f.position = RandomVec();
 		f.SetTransform();
@@ -187,10 +190,7 @@ int main(int ac, char **av) {
 	// terminate
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glDeleteBuffers(1, &background.textureName);
-	for (int i = 0; i < nFallingSprites; i++) {
-		glDeleteBuffers(1, &fallingSprites[i].textureName);
-		glDeleteBuffers(1, &fallingSprites[i].matName);
-	}
+	fallingBatch.Release();
 	glfwDestroyWindow(w);
 	glfwTerminate();
 }
@@ -159,7 +159,7 @@ int main(int ac, char **av) {
 	}
 	// unbind vertex buffer, free GPU memory
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glDeleteBuffers(1, &mesh.vBufferId);
+	mesh.Clear();
 	glfwDestroyWindow(w);
 	glfwTerminate();
 }
@@ -0,0 +1,95 @@
+// BVH-Benchmark.cpp - compare BVH, vectorized kernels and linear search for line/mesh intersection
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Mesh.h"
+
+const char *defaultFile = "C:/Users/longt/Code/Assets/Models/Pistol2.obj";
+
+double Seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float Random(float lo, float hi) { return lo+(hi-lo)*rand()/RAND_MAX; }
+
+vec3 Random(vec3 min, vec3 max) { return vec3(Random(min.x, max.x), Random(min.y, max.y), Random(min.z, max.z)); }
+
+int main(int ac, char **av) {
+	// usage: BVH-Benchmark [obj file] [# queries]
+	const char *filename = ac > 1? av[1] : defaultFile;
+	int nQueries = ac > 2? atoi(av[2]) : 100000;
+	std::shared_ptr<MeshGeometry> g = ReadGeometry(filename);
+	if (!g) {
+		printf("can't read %s\n", filename);
+		return 1;
+	}
+	printf("%s: %i triangles, %i quads\n", filename, (int) g->triangles.size(), (int) g->quads.size());
+	BuildTriInfos(g->points, g->triangles, g->triInfos);
+	BuildQuadInfos(g->points, g->quads, g->quadInfos);
+	// build
+	double t0 = Seconds();
+	g->triBVH.Build(g->points, g->triangles, false);
+	double t1 = Seconds();
+	g->triBVH.Build(g->points, g->triangles, true);
+	double t2 = Seconds();
+	g->quadBVH.Build(g->points, g->quads, true);
+	printf("BVH build: %.2f ms serial, %.2f ms parallel, %i nodes\n", 1000*(t1-t0), 1000*(t2-t1), (int) g->triBVH.nodes.size());
+	vector<int2> leaves(g->triBVH.nodes.size());
+	for (size_t i = 0; i < leaves.size(); i++)
+		leaves[i] = int2(g->triBVH.nodes[i].start, g->triBVH.nodes[i].count);
+	g->triPackets.Build(g->points, g->triangles, g->triBVH.indices, leaves);
+	// random lines through (standardized) mesh bounds, about half missing
+	srand(1);
+	vector<vec3> p1s(nQueries), p2s(nQueries);
+	for (int i = 0; i < nQueries; i++) {
+		p1s[i] = Random(vec3(-3, -3, -3), vec3(3, 3, 3));
+		p2s[i] = Random(vec3(-1.2f, -1.2f, -1.2f), vec3(1.2f, 1.2f, 1.2f));
+	}
+	vector<int> linearIds(nQueries), bvhIds(nQueries);
+	vector<float> linearAlphas(nQueries), bvhAlphas(nQueries);
+	double t3 = Seconds();
+	for (int i = 0; i < nQueries; i++)
+		linearIds[i] = IntersectWithLine(p1s[i], p2s[i], g->triInfos, linearAlphas[i]);
+	double t4 = Seconds();
+	for (int i = 0; i < nQueries; i++)
+		bvhIds[i] = IntersectWithLine(p1s[i], p2s[i], g->triInfos, g->triBVH, bvhAlphas[i]);
+	double t5 = Seconds();
+	int nHits = 0, nMismatches = 0;
+	for (int i = 0; i < nQueries; i++) {
+		nHits += linearIds[i] >= 0;
+		nMismatches += linearIds[i] != bvhIds[i] || linearAlphas[i] != bvhAlphas[i];
+	}
+	double linearUs = 1e6*(t4-t3)/nQueries, bvhUs = 1e6*(t5-t4)/nQueries;
+	printf("%i queries (%i hits): linear %.3f us/query, BVH %.3f us/query (%.1fx), %i mismatches\n",
+		nQueries, nHits, linearUs, bvhUs, linearUs/bvhUs, nMismatches);
+	// vectorized kernels: identical to each other; may differ from linear search at triangle edges
+	const char *best = IntersectKernel(), *kernels[] = { "scalar", "sse", "avx2" };
+	vector<int> scalarIds(nQueries), ids(nQueries);
+	vector<float> scalarAlphas(nQueries), alphas(nQueries);
+	for (const char *k : kernels) {
+		SetIntersectKernel(k);
+		if (strcmp(IntersectKernel(), k))
+			continue;
+		double t6 = Seconds();
+		for (int i = 0; i < nQueries; i++)
+			ids[i] = IntersectWithLine(p1s[i], p2s[i], g->triPackets, g->triBVH, alphas[i]);
+		double t7 = Seconds();
+		if (!strcmp(k, "scalar")) {
+			scalarIds = ids;
+			scalarAlphas = alphas;
+		}
+		int nDiffer = 0, nKernelMismatches = 0;
+		for (int i = 0; i < nQueries; i++) {
+			nDiffer += ids[i] != linearIds[i];
+			nKernelMismatches += ids[i] != scalarIds[i] || alphas[i] != scalarAlphas[i];
+		}
+		nMismatches += nKernelMismatches;
+		double us = 1e6*(t7-t6)/nQueries;
+		printf("BVH+%s: %.3f us/query (%.1fx), %i differ from linear, %i mismatches with scalar\n",
+			k, us, linearUs/us, nDiffer, nKernelMismatches);
+	}
+	SetIntersectKernel(best);
+	return nMismatches? 1 : 0;
+}
@@ -0,0 +1,586 @@
+// VR-Benchmark.cpp: headless, scripted frame-time benchmark of the VR-Demo-button3 scene
+// renders both eyes and the app (mirror) display into offscreen framebuffers, driven by MockVR poses
+// context: EGL surfaceless (eg, Mesa llvmpipe: no display or GPU needed), or hidden GLFW window on Windows
+// build: Visual Studio project on Windows, CMakeLists.txt (links EGL) on Linux
+
+#include <glad.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+	#include <glfw3.h>
+#else
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+#include "Camera.h"
+#include "Capture.h"
+#include "Draw.h"
+#include "GLXtras.h"
+#include "Mesh.h"
+#include "MockVR.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "VRXtras.h"
+
+// options
+int			nFrames = 300, nWarmup = 10, nTargets = 3, fireInterval = 15, eyeSamples = 4;
+bool		singlePass = true;
+string		assetDir("C:/Users/longt/Code/Assets/");
+const char *csvFile = NULL, *recordFile = NULL;
+
+// VR
+VROOM		vroom;
+MockVR		mockVR(90);
+enum		Side { Left = 0, Right };
+int			hmdW = 1440, hmdH = 1600;
+Camera		cameraUser(0, 0, hmdW, hmdH);
+
+// app (mirror) display, as in VR-Demo-button3
+int			appEyeH = 330, appEyeW = (int) (appEyeH*1024/768.f);
+int			winW = 2*appEyeW, winH = 3*appEyeH;
+GLuint		mirrorFramebuffer = 0, mirrorColorBuffer = 0, mirrorDepthBuffer = 0, hmdToAppProgram = 0;
+Camera		cameraScene(0, 0, winW, winH-appEyeH, Quaternion(-.17f, .42f, .09f, .88f), vec3(0, 0, -5));
+
+// scene
+Mesh		bench, bill2, bill3, ground, head, leftHand, rightHand, button, box, targetMesh;
+vector<mat4> targets;					// target transforms (all share targetMesh geometry)
+vector<bool> occupied;					// target slots
+vector<int>	targetSlots;
+Scene		laserScene;
+vector<Mesh *> targetProxies;			// laserScene entries for targets
+vec3		light(-.2f, .4f, .3f), lookAt(0, .5f, 5);
+vec3		wht(1, 1, 1), red(1, 0, 0), grn(0, 1, 0), yel(1, 1, 0);
+int			meshTextureUnit = 5;
+float		spacing = 3;				// slot spacing, before target scale
+vec3		wallCenter(0, .5f, 5), wallExtent(1, 1, 0);
+
+// shots
+enum		{ Miss = -1, StartScreen = -2 };
+struct Shot { int frame = 0, target = Miss; vec3 point; };	// target index, Miss, or StartScreen
+vector<Shot> shots;
+
+// Headless Context
+
+#ifdef _WIN32
+
+bool InitHeadlessGL() {
+	if (!glfwInit())
+		return false;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow *w = glfwCreateWindow(64, 64, "VR-Benchmark", NULL, NULL);
+	if (!w)
+		return false;
+	glfwMakeContextCurrent(w);
+	glfwSwapInterval(0);
+	return gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) != 0;
+}
+
+#else
+
+bool InitHeadlessGL() {
+	// surfaceless display, compatibility context, no default framebuffer
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = getPlatformDisplay?
+		getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : EGL_NO_DISPLAY;
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor, nConfigs = 0;
+	if (!eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API)) {
+		printf("can't initialize EGL (error %x)\n", eglGetError());
+		return false;
+	}
+	EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = NULL;
+	eglChooseConfig(display, configAttributes, &config, 1, &nConfigs);
+	EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+	EGLContext context = eglCreateContext(display, nConfigs? config : (EGLConfig) 0, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		printf("can't make EGL context (error %x)\n", eglGetError());
+		return false;
+	}
+	return gladLoadGLLoader((GLADloadproc) eglGetProcAddress) != 0;
+}
+
+#endif
+
+// Draw Counts
+
+namespace {
+
+int nDraws = 0, nInstances = 0;
+PFNGLDRAWARRAYSPROC drawArrays;
+PFNGLDRAWELEMENTSPROC drawElements;
+PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced;
+PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced;
+
+void APIENTRY CountDrawArrays(GLenum m, GLint f, GLsizei n) {
+	nDraws++; nInstances++; drawArrays(m, f, n);
+}
+
+void APIENTRY CountDrawElements(GLenum m, GLsizei n, GLenum t, const void *i) {
+	nDraws++; nInstances++; drawElements(m, n, t, i);
+}
+
+void APIENTRY CountDrawArraysInstanced(GLenum m, GLint f, GLsizei n, GLsizei c) {
+	nDraws++; nInstances += c; drawArraysInstanced(m, f, n, c);
+}
+
+void APIENTRY CountDrawElementsInstanced(GLenum m, GLsizei n, GLenum t, const void *i, GLsizei c) {
+	nDraws++; nInstances += c; drawElementsInstanced(m, n, t, i, c);
+}
+
+} // end namespace
+
+void CountDraws() {
+	// route draw calls through counters
+	drawArrays = glad_glDrawArrays;						glad_glDrawArrays = CountDrawArrays;
+	drawElements = glad_glDrawElements;					glad_glDrawElements = CountDrawElements;
+	drawArraysInstanced = glad_glDrawArraysInstanced;	glad_glDrawArraysInstanced = CountDrawArraysInstanced;
+	drawElementsInstanced = glad_glDrawElementsInstanced; glad_glDrawElementsInstanced = CountDrawElementsInstanced;
+}
+
+// Geometry
+
+vec3 XAxis(mat4 m)  { return vec3(m[0][0], m[1][0], m[2][0]); }
+vec3 ZAxis(mat4 m)  { return vec3(m[0][2], m[1][2], m[2][2]); }
+vec3 Origin(mat4 m) { return vec3(m[0][3], m[1][3], m[2][3]); }
+
+vec3 EyeOffset(Side e) {
+	vec3 headX = normalize(XAxis(head.toWorld));
+	return e == Left? vec3(-.05f*headX) : vec3(.05f*headX);
+}
+
+mat4 EyeView(Side e) {
+	vec3 headP = Origin(head.toWorld), offset = EyeOffset(e);
+	return LookAt(headP+offset, lookAt+offset, vec3(0, 1, 0));
+}
+
+vec3 Laser1() { return Origin(rightHand.toWorld); }
+
+vec3 Laser2() {
+	vec3 p1 = Laser1(), tip = p1+.068f*XAxis(rightHand.toWorld);
+	return p1+20*normalize(tip-p1);
+}
+
+// Targets
+
+mat4 SlotTransform(int slot) {
+	// VR-Demo-button3 layout for 9 slots (3x3), square grid centered on the same point otherwise
+	int nSlots = (int) occupied.size(), cols = (int) ceil(sqrt((float) nSlots)), rows = (nSlots+cols-1)/cols;
+	int row = slot/cols, col = slot%cols;
+	float x = spacing*(col-.5f*(cols-1)), y = 5-spacing-spacing*(row-.5f*(rows-1));
+	return Scale(.25f)*Translate(x, y, 20)*RotateY(90);
+}
+
+int UnoccupiedSlot() {
+	int nSlots = (int) occupied.size();
+	for (int i = rand()%nSlots;; i = (i+1)%nSlots)
+		if (!occupied[i]) {
+			occupied[i] = true;
+			return i;
+		}
+}
+
+void MakeTargets(int n) {
+	// 3 targets in 9 slots (as VR-Demo-button3), in general 3n slots
+	occupied.assign(3*n, false);
+	targets.resize(n);
+	targetSlots.resize(n);
+	for (int i = 0; i < n; i++)
+		targets[i] = SlotTransform(targetSlots[i] = UnoccupiedSlot());
+	int cols = (int) ceil(sqrt((float) (3*n))), rows = (3*n+cols-1)/cols;
+	wallExtent = vec3(.25f*spacing*.5f*(cols-1)+.25f, .25f*spacing*.5f*(rows-1)+.25f, 0);
+	// intersection proxies share target geometry
+	for (int i = 0; i < n; i++) {
+		Mesh *m = new Mesh();
+		m->geometry = targetMesh.geometry;
+		m->toWorld = targets[i];
+		targetProxies.push_back(m);
+		laserScene.Add(*m);
+	}
+}
+
+void MoveTarget(int i) {
+	int slot = UnoccupiedSlot();
+	occupied[targetSlots[i]] = false;
+	targetSlots[i] = slot;
+	targetProxies[i]->toWorld = targets[i] = SlotTransform(slot);
+}
+
+// Scene
+
+bool ReadMesh(Mesh &m, const char *meshName, const char *imageName, mat4 t) {
+	string obj = assetDir+"Models/"+meshName;
+	bool ok = imageName? m.Read(obj, assetDir+"Images/"+imageName, &t) : m.Read(obj, &t);
+	if (!ok)
+		printf("can't read %s%s%s\n", meshName, imageName? " or " : "", imageName? imageName : "");
+	return ok;
+}
+
+void MakeScene() {
+	// same content as VR-Demo-button3 MakeScene, read synchronously
+	ReadMesh(bench, "Screen1_Test.obj", "Test_Start_S1.jpg", Scale(.5f)*Translate(0, -.2f, .7f)*RotateZ(90)*RotateX(0)*RotateY(90));
+	ReadMesh(bill2, "Screen1_Test.obj", "Test_Start_S1.jpg", Scale(.5f)*Translate(2.3f, -.2f, .1f)*RotateZ(90)*RotateX(45)*RotateY(90));
+	ReadMesh(bill3, "Screen1_Test.obj", "Test_Start_S1.jpg", Scale(.5f)*Translate(-2.3f, -.2f, .1f)*RotateZ(90)*RotateX(-45)*RotateY(90));
+	ReadMesh(ground, "Test_ground.obj", "marble_floor.jpg", Scale(2)*Translate(0, -.3f, 0));
+	ReadMesh(head, "Head.obj", NULL, RotateX(20)*Translate(.5f, .6f, -.85f)*Scale(.17f, .17f, .17f));
+	ReadMesh(leftHand, "HandLeft.obj", NULL, Translate(.7f, .4f, -.4f)*RotateX(-45)*Scale(.15f));
+	ReadMesh(rightHand, "Pistol2.obj", "pistol2.png", RotateZ(45)*RotateX(36));
+	ReadMesh(button, "Square.obj", "Push!.png", Translate(100.1f, .2f, -.4f)*RotateY(60)*RotateZ(-90)*Scale(.1f, .25f, 1));
+	ReadMesh(box, "aimlab_box.obj", "rocktexture.jpg", Scale(4)*Translate(0, -.05f, 1.1f));
+	ReadMesh(targetMesh, "target_sphere.obj", "shooting_target_sphere.jpg", mat4());
+	Mesh *targetable[] = { &button, &bench };
+	for (Mesh *m : targetable)
+		laserScene.Add(*m);
+	MakeTargets(nTargets);
+}
+
+// Pose Script
+
+mat4 Aim(vec3 p, vec3 at, float scale) {
+	// device transform: origin at p/scale, x-axis towards at (toWorld = Scale(scale)*transform)
+	// y-reflected, as from runtime (undone by VROOM::GetTransforms)
+	vec3 x = normalize(at-p), z = normalize(cross(x, vec3(0, 1, 0))), y = cross(z, x);
+	return mat4(vec4(x.x, -y.x, z.x, p.x/scale), vec4(-x.y, y.y, -z.y, p.y/scale), vec4(x.z, -y.z, z.z, p.z/scale), vec4(0, 0, 0, 1));
+}
+
+void BenchmarkPoses(double t, mat4 &headM, mat4 &leftHandM, mat4 &rightHandM) {
+	// head turns slightly, right hand sweeps a Lissajous path across the target wall
+	float a = (float) t;
+	headM = Translate(vec3(0, .4f, -.85f)/.17f)*RotateY(8*sin(.4f*a));
+	leftHandM = Translate(vec3(-.4f, .2f, -.4f)/.15f)*RotateX(-45);
+	// (sweep starts at wall center, through start screen; limited to within laser reach)
+	vec2 sweep(std::min(wallExtent.x, 4.f), std::min(wallExtent.y, 4.f));
+	vec3 aim = wallCenter+vec3(sweep.x*sin(1.3f*a), sweep.y*sin(.7f*a), 0);
+	rightHandM = Aim(vec3(.42f, .22f, -.39f), aim, .15f);
+}
+
+void UpdatePoses() {
+	mat4 headM, leftHandM, rightHandM;
+	vroom.GetTransforms(headM, leftHandM, rightHandM);
+	head.toWorld = Scale(.17f, .17f, .17f)*headM;
+	leftHand.toWorld = Scale(.15f, .15f, .15f)*leftHandM;
+	rightHand.toWorld = Scale(.15f, .15f, .15f)*rightHandM;
+	float f = length(lookAt-Origin(head.toWorld))/length(ZAxis(head.toWorld));
+	lookAt = Origin(head.toWorld)+f*ZAxis(head.toWorld);
+}
+
+void Fire(int frame) {
+	SceneHit hit;
+	Shot s;
+	s.frame = frame;
+	if (laserScene.IntersectWithSegment(Laser1(), Laser2(), &hit)) {
+		s.point = hit.point;
+		if (hit.mesh == &bench) {
+			// start screen shot: billboards removed, as VR-Demo-button3
+			s.target = StartScreen;
+			bench.toWorld = bill2.toWorld = bill3.toWorld = Translate(0, -1, .7f)*Scale(.00000001f);
+			laserScene.Remove(bench);
+		}
+		for (int i = 0; i < (int) targetProxies.size(); i++)
+			if (hit.mesh == targetProxies[i]) {
+				s.target = i;
+				MoveTarget(i);
+			}
+	}
+	shots.push_back(s);
+}
+
+// Rendering
+
+void RenderMesh(Mesh &m, Camera &camera, vec3 color) {
+	GLuint s = UseMeshShader();
+	SetUniform(s, "color", color);
+	m.Display(camera);
+}
+
+void RenderScene(Camera &camera, bool vrDisplay) {
+	glEnable(GL_DEPTH_TEST);
+	GLuint s = UseMeshShader();
+	SetUniform(s, "defaultLight", Vec3(camera.modelview*vec4(light, 1)));
+	SetUniform(s, "useLight", false);
+	bench.Display(camera, meshTextureUnit);
+	bill2.Display(camera, meshTextureUnit);
+	bill3.Display(camera, meshTextureUnit);
+	SetUniform(s, "useLight", true);
+	box.Display(camera, meshTextureUnit);
+	targetMesh.DisplayInstanced(camera, targets, NULL, meshTextureUnit);
+	ground.Display(camera, meshTextureUnit);
+	RenderMesh(leftHand, camera, grn);
+	RenderMesh(rightHand, camera, red);
+	if (!vrDisplay) {
+		SetUniform(s, "twoSidedShading", true);
+		RenderMesh(head, camera, grn);
+		SetUniform(s, "twoSidedShading", false);
+	}
+}
+
+void Crosshair() {
+	glDisable(GL_DEPTH_TEST);
+	Line(vec2((float) hmdW/2-20, (float) hmdH/2), vec2((float) hmdW/2+20, (float) hmdH/2), 3.7f, yel);
+	Line(vec2((float) hmdW/2, (float) hmdH/2-20), vec2((float) hmdW/2, (float) hmdH/2+20), 3.7f, yel);
+}
+
+void RenderEye(Side e) {
+	vroom.BindEyeFramebuffer(e);
+	glClearColor(1, 1, 1, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	cameraUser.SetModelview(EyeView(e));
+	RenderScene(cameraUser, true);
+	UseDrawShader(ScreenMode());
+	Crosshair();
+	vroom.ResolveEyeFramebuffer(e);
+}
+
+void RenderStereo() {
+	mat4 midView = LookAt(Origin(head.toWorld), lookAt, vec3(0, 1, 0));
+	cameraUser.SetModelview(midView);
+	mat4 left = StereoClipMatrix(cameraUser.persp, midView, EyeView(Left));
+	mat4 right = StereoClipMatrix(cameraUser.persp, midView, EyeView(Right));
+	vroom.BindStereoFramebuffer();
+	glClearColor(1, 1, 1, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	SetStereo(true, left, right);
+	RenderScene(cameraUser, true);
+	SetStereo(true);
+	glViewport(0, 0, hmdW, hmdH);
+	mat4 screen = ScreenMode();
+	glViewport(0, 0, 2*hmdW, hmdH);
+	UseDrawShader(screen);
+	Crosshair();
+	SetStereo(false);
+	vroom.ResolveStereoFramebuffer();
+}
+
+GLuint MakeTextureDisplayProgram() {
+	const char *vertexDisplayShader = R"(
+		#version 330
+		out vec2 uv;
+		uniform vec2 uRange = vec2(0, 1);
+		void main() {
+			vec2 pts[] = vec2[4](vec2(-1,-1), vec2(-1,1), vec2(1,1), vec2(1,-1));
+			vec2 uvs[] = vec2[4](vec2(0, 0), vec2(0, 1), vec2(1, 1), vec2(1,0));
+			gl_Position = vec4(pts[gl_VertexID], 0, 1);
+			uv = vec2(mix(uRange.x, uRange.y, uvs[gl_VertexID].x), uvs[gl_VertexID].y);
+		}
+	)";
+	const char *pixelDisplayShader = R"(
+		#version 330
+		in vec2 uv;
+		out vec4 color;
+		uniform sampler2D textureImage;
+		void main() { color = texture(textureImage, uv); }
+	)";
+	return LinkProgramViaCode(&vertexDisplayShader, &pixelDisplayShader);
+}
+
+bool InitMirrorFramebuffer() {
+	glGenFramebuffers(1, &mirrorFramebuffer);
+	glGenRenderbuffers(1, &mirrorColorBuffer);
+	glGenRenderbuffers(1, &mirrorDepthBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mirrorFramebuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mirrorColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, winW, winH);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mirrorColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mirrorDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, winW, winH);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mirrorDepthBuffer);
+	bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return ok;
+}
+
+void RenderMirror() {
+	// app display, as VR-Demo-button3 Display, into offscreen framebuffer
+	glBindFramebuffer(GL_FRAMEBUFFER, mirrorFramebuffer);
+	glViewport(0, 0, winW, winH);
+	glClearColor(.7f, .7f, .7f, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glUseProgram(hmdToAppProgram);
+	for (int k = 0; k < 2; k++) {
+		glActiveTexture(GL_TEXTURE0+2+k);
+		glBindTexture(GL_TEXTURE_2D, singlePass? vroom.stereoTexture : vroom.eyeTextures[k]);
+		SetUniform(hmdToAppProgram, "textureImage", 2+k);
+		SetUniform(hmdToAppProgram, "uRange", singlePass? vec2(.5f*k, .5f*k+.5f) : vec2(0, 1));
+		glViewport(k*appEyeW, winH-appEyeH, appEyeW, appEyeH);
+		glDrawArrays(GL_QUADS, 0, 4);
+	}
+	glViewport(0, 0, winW, winH-appEyeH);
+	RenderScene(cameraScene, false);
+	// annotations
+	UseDrawShader(cameraScene.fullview);
+	glDisable(GL_DEPTH_TEST);
+	BeginDrawBatch();
+	Line(Laser1(), Laser2(), 6, red, .5f);
+	for (Shot &s : shots)
+		if (s.target >= 0)
+			Disk(s.point, 10, red);
+	Disk(Origin(head.toWorld), 8, wht);
+	Disk(Origin(leftHand.toWorld), 8, wht);
+	Disk(Origin(rightHand.toWorld), 8, wht);
+	Disk(lookAt, 11, red);
+	EndDrawBatch();
+}
+
+// Report
+
+float Percentile(vector<float> v, float p) {
+	if (!v.size())
+		return 0;
+	std::sort(v.begin(), v.end());
+	return v[std::min((int) v.size()-1, (int) (p*v.size()))];
+}
+
+void Report(vector<float> &frameMs, Profiler &profiler, double seconds) {
+	float sum = 0;
+	for (float t : frameMs)
+		sum += t;
+	int n = (int) frameMs.size(), nHits = 0;
+	printf("%i frames in %.2f s: frame ms avg %.2f, min %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f (%.1f fps)\n",
+		n, seconds, sum/n, Percentile(frameMs, 0), Percentile(frameMs, .5f), Percentile(frameMs, .9f),
+		Percentile(frameMs, .99f), Percentile(frameMs, 1), 1000*n/sum);
+	printf("%-12s %22s %22s\n", "stage ms", "cpu min/avg/p99", "gpu min/avg/p99");
+	for (int i = 0; i < profiler.NStages(); i++) {
+		ProfileStats c = profiler.CpuStats(i), g = profiler.GpuStats(i);
+		printf("%-12s %8.2f/%6.2f/%6.2f %8.2f/%6.2f/%6.2f\n", profiler.StageName(i), c.min, c.avg, c.p99, g.min, g.avg, g.p99);
+	}
+	printf("draws/frame %.1f, instances/frame %.1f\n", (float) nDraws/n, (float) nInstances/n);
+	int startFrame = -1;
+	for (Shot &s : shots) {
+		nHits += s.target >= 0;
+		if (s.target == StartScreen) startFrame = s.frame;
+	}
+	printf("%i shots, %i target hits, start screen %s", (int) shots.size(), nHits, startFrame < 0? "not hit\n" : "");
+	if (startFrame >= 0)
+		printf("hit at frame %i\n", startFrame);
+	for (Shot &s : shots)
+		if (s.target >= 0 && nTargets <= 9)
+			printf("  frame %i: target %i at (%.3f, %.3f, %.3f)\n", s.frame, s.target+1, s.point.x, s.point.y, s.point.z);
+}
+
+// Application
+
+const char *usage = R"(usage: VR-Benchmark [options]
+	-frames n       frames measured (default 300), after 10 warm-up frames
+	-targets n      target count (default 3; stress test with thousands)
+	-fire n         fire every n frames (default 15)
+	-samples n      eye multisampling, 1, 2, 4, or 8 (default 4)
+	-eye w h        per-eye resolution (default 1440 1600)
+	-twopass        render eyes separately (default single-pass stereo)
+	-assets dir     directory containing Models/ and Images/ (eg, ../Assets)
+	-csv file       write per-frame stage times
+	-record file    record mirror display (raw rgb frames) during measured frames
+)";
+
+bool ParseArgs(int ac, char **av) {
+	for (int i = 1; i < ac; i++) {
+		const char *a = av[i];
+		bool more = i+1 < ac;
+		if (!strcmp(a, "-frames") && more) nFrames = atoi(av[++i]);
+		else if (!strcmp(a, "-targets") && more) nTargets = atoi(av[++i]);
+		else if (!strcmp(a, "-fire") && more) fireInterval = atoi(av[++i]);
+		else if (!strcmp(a, "-samples") && more) eyeSamples = atoi(av[++i]);
+		else if (!strcmp(a, "-eye") && i+2 < ac) { hmdW = atoi(av[++i]); hmdH = atoi(av[++i]); }
+		else if (!strcmp(a, "-twopass")) singlePass = false;
+		else if (!strcmp(a, "-assets") && more) { assetDir = string(av[++i]); assetDir += "/"; }
+		else if (!strcmp(a, "-csv") && more) csvFile = av[++i];
+		else if (!strcmp(a, "-record") && more) recordFile = av[++i];
+		else return false;
+	}
+	return nFrames > 0 && nTargets > 0 && fireInterval > 0 && hmdW > 0 && hmdH > 0;
+}
+
+int main(int ac, char **av) {
+	if (!ParseArgs(ac, av)) {
+		printf("%s", usage);
+		return 1;
+	}
+	if (!InitHeadlessGL()) {
+		printf("can't create headless OpenGL context\n");
+		return 1;
+	}
+	printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+	// mock runtime, unpaced: poses advance 1/90 s per frame regardless of frame time
+	mockVR.pace = false;
+	mockVR.script = BenchmarkPoses;
+	mockVR.recommendedWidth = hmdW;
+	mockVR.recommendedHeight = hmdH;
+	vroom.InitMockVR(&mockVR);
+	cameraUser.Resize(hmdW, hmdH);
+	if (!vroom.InitEyeFramebuffers(hmdW, hmdH) || !vroom.InitStereoFramebuffer() || !InitMirrorFramebuffer()) {
+		printf("can't make frame buffers\n");
+		return 1;
+	}
+	vroom.SetEyeSamples(eyeSamples);
+	if (!(hmdToAppProgram = MakeTextureDisplayProgram()))
+		return 1;
+	srand(1);
+	MakeScene();
+	printf("%ix%i per eye, %s, %i samples, %i targets, fire every %i frames\n", hmdW, hmdH,
+		singlePass? "single-pass" : "two-pass", vroom.eyeSamples, nTargets, fireInterval);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_MULTISAMPLE);
+	CountDraws();
+	Profiler profiler;
+	vector<float> frameMs;
+	double start = 0;
+	for (int frame = -nWarmup; frame < nFrames; frame++) {
+		if (frame == 0) {
+			// discard warm-up (shader compiles, first uploads)
+			profiler.Release();
+			profiler.historySize = nFrames;
+			nDraws = nInstances = 0;
+			shots.resize(0);
+			if (recordFile)
+				StartRecording(recordFile, CaptureRaw, mirrorFramebuffer, winW, winH);
+			start = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+		auto t0 = std::chrono::steady_clock::now();
+		profiler.BeginFrame();
+		profiler.Begin("update");
+		UpdatePoses();
+		if (frame >= 0 && frame%fireInterval == 0)
+			Fire(frame);
+		if (singlePass) {
+			profiler.Begin("stereo");
+			RenderStereo();
+			profiler.Begin("submit");
+			vroom.SubmitStereoTexture();
+		}
+		else {
+			profiler.Begin("left eye");
+			RenderEye(Left);
+			profiler.Begin("right eye");
+			RenderEye(Right);
+			profiler.Begin("submit");
+			vroom.SubmitEyeTextures();
+		}
+		profiler.Begin("mirror");
+		RenderMirror();
+		if (Recording()) {
+			profiler.Begin("capture");
+			CaptureFrame();
+		}
+		profiler.Begin("finish");
+		glFinish();
+		profiler.EndFrame();
+		if (frame >= 0)
+			frameMs.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-t0).count());
+	}
+	// last frame's GPU times are collected one frame late
+	profiler.BeginFrame();
+	profiler.EndFrame();
+	double stop = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	StopCapture();
+	Report(frameMs, profiler, stop-start);
+	if (csvFile && profiler.WriteCSV(csvFile))
+		printf("stage times written to %s\n", csvFile);
+	return 0;
+}
@@ -13,23 +13,35 @@
 #include <glfw3.h>
 #include <openvr.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include "Camera.h"
+#include "Capture.h"
 #include "Draw.h"
 #include "GLXtras.h"
+#include "Loader.h"
 #include "Mesh.h"
 #include "Misc.h"
+#include "MockVR.h"
+#include "Profiler.h"
+#include "Scene.h"
 #include "VRXtras.h"
 
 // VR access
 VROOM		vroom;
+MockVR		mockVR(90);							// stand-in runtime if run with -mock
+
+// frame timing
+Profiler	profiler;
+
+// capture
+bool		screenshotPending = false;			// 'C' pressed: read back app window after next Display
 
 // headset display
 enum		Side { Left = 0, Right };
 int			hmdW = 1024, hmdH = 768;			// Vive Cosmos, per eye: 1440 wide, 1700 high
 float		hmdAspectRatio = (float) hmdW/hmdH;
-GLuint		fbTextureUnits[] = { 2, 3 };		// left and right eye texture memory
-GLuint		fbTextureNames[] = { 0, 0 };		// left and right eye texture name
+GLuint		fbTextureUnits[] = { 2, 3 };		// left and right eye texture units, for app display
 vec3		lookAt(-.35f, -.15f, .55f);
 bool		hmdPresent = false;
 
@@ -65,6 +77,7 @@ Mesh		bench, ground, head, leftHand, rightHand, button;
 Mesh		bill2, bill3, pistol;
 Mesh		box, target1, target2, target3;
 int			meshTextureUnit = 5;
+Scene		laserScene;							// meshes the laser can target
 // second Scene
 // add meshs for the second scene here
 
@@ -74,7 +87,9 @@ Toggler		annotate("Annotate", true, 20, 13, 14);
 Toggler		stereopsis("Stereopsis", false, 140, 13, 14);
 Toggler		fixGaze("Fix Gaze", false, 280, 13, 14);
 Toggler		hmdTrack("HMD Track", false, 400, 13, 14);
-Toggler	   *buttons[] = { &annotate, &stereopsis, &fixGaze }; // , &hmdTrack };
+Toggler		singlePass("Single Pass", true, 400, 13, 14);	// both eyes in one scene traversal
+Toggler		profile("Profile", false, 520, 13, 14);			// frame timing overlay
+Toggler	   *buttons[] = { &annotate, &stereopsis, &fixGaze, &singlePass, &profile }; // , &hmdTrack };
 int			nbuttons = sizeof(buttons)/sizeof(Toggler *);
 
 // gameplay
@@ -178,6 +193,18 @@ void GetVrTransforms() {
 	}
 }
 
+void PredictVrTransforms() {
+	// late update of hands from poses predicted for display time, for aiming (no compositor wait)
+	if (hmdPresent) {
+		float s = 1/.15f;
+		mat4 headM, leftHandM = Scale(s, s, s)*leftHand.toWorld, rightHandM = Scale(s, s, s)*rightHand.toWorld;
+		if (vroom.GetPredictedTransforms(vroom.SecondsToPhotons(), headM, leftHandM, rightHandM)) {
+			leftHand.toWorld = Scale(.15f, .15f, .15f)*leftHandM;
+			rightHand.toWorld = Scale(.15f, .15f, .15f)*rightHandM;
+		}
+	}
+}
+
 vec3 Laser1() { return Origin(rightHand.toWorld); }
 
 vec3 Laser2() {
@@ -191,14 +218,18 @@ mat4 FromQuatMove(Quaternion q, vec3 t, float scale) {
 	return m*Scale(scale, scale, scale);
 }
 
-bool Intersect(Mesh &m, vec3 p1, vec3 p2, vec3 &intersection) {
-	float alpha;
-	mat4 inv = Invert(m.toWorld);
-	vec3 xp1 = Vec3(inv*vec4(p1, 1)), xp2 = Vec3(inv*vec4(p2, 1));
-	bool hit = m.IntersectWithSegment(xp1, xp2, &alpha);
-	if (hit)
-		intersection = p1+alpha*(p2-p1);
-	return hit;
+void checkTargets() {
+	// one query for nearest mesh along laser
+	SceneHit hit;
+	Mesh *m = laserScene.IntersectWithSegment(Laser1(), Laser2(), &hit)? hit.mesh : NULL;
+	targeted = m == &button;
+	billBoardTargeted = m == &bench;
+	t1Targeted = m == &target1;
+	t2Targeted = m == &target2;
+	t3Targeted = m == &target3;
+	vec3 &p = targeted? target : billBoardTargeted? billBoardTarget : t1Targeted? t1Target : t2Targeted? t2Target : t3Target;
+	if (m)
+		p = hit.point;
 }
 
 // Display
@@ -218,6 +249,20 @@ void RenderMesh(Mesh &m, Camera &camera, vec3 color, bool vrDisplay = false) {
 //		ShowAxes(m);
 }
 
+void RenderTargets(Camera &camera) {
+	// targets read from the same file share geometry and texture: draw as instances
+	Mesh *targets[] = { &target1, &target2, &target3 };
+	bool shared = target1.geometry == target2.geometry && target1.geometry == target3.geometry &&
+				  target1.textureName == target2.textureName && target1.textureName == target3.textureName;
+	if (shared) {
+		vector<mat4> transforms = { target1.toWorld, target2.toWorld, target3.toWorld };
+		target1.DisplayInstanced(camera, transforms, NULL, meshTextureUnit);
+	}
+	else
+		for (Mesh *t : targets)
+			t->Display(camera, meshTextureUnit);
+}
+
 void RenderScene(Camera &camera, bool vrDisplay) {
 	glEnable(GL_DEPTH_TEST);
 	GLuint s = UseMeshShader();
@@ -238,17 +283,13 @@ void RenderScene(Camera &camera, bool vrDisplay) {
 	}
 	//else {
 		box.Display(camera, meshTextureUnit);
-		target1.Display(camera, meshTextureUnit);
-		target2.Display(camera, meshTextureUnit);
-		target3.Display(camera, meshTextureUnit);
+		RenderTargets(camera);
 	//}
 	// second scene
 	if (billBoardHit) {
 		// display the second background and the three targets
 		box.Display(camera, meshTextureUnit);
-		target1.Display(camera, meshTextureUnit);
-		target2.Display(camera, meshTextureUnit);
-		target3.Display(camera, meshTextureUnit);
+		RenderTargets(camera);
 	}
 	ground.Display(camera, meshTextureUnit);
 	//pistol.Display()
@@ -261,17 +302,21 @@ void RenderScene(Camera &camera, bool vrDisplay) {
 	}
 }
 
-void RenderEye(Side e, vec3 backgrnd) {
+mat4 EyeView(Side e) {
 	// compute view matrices for left and right eyes
 	vec3 headP = Origin(head.toWorld), offset = EyeOffset(e);
-	mat4 eyeView = stereopsis.on?
+	return stereopsis.on?
 		LookAt(headP+offset, lookAt+offset, vec3(0, 1, 0)) :
 		LookAt(headP, lookAt, vec3(0, 1, 0));
 	// mat4 eyeView = LookAt(headP+offset, stereopsis.on? lookAt : lookAt+offset, vec3(0, 1, 0));
 	// *** TODO: this assumes mid-eye is origin, but in head.obj, origin likely
 	//           base of head, so appropriate translation should be added here
+}
+
+void RenderEye(Side e, vec3 backgrnd) {
+	mat4 eyeView = EyeView(e);
+	vroom.BindEyeFramebuffer(e);
 	glClearColor(backgrnd.x, backgrnd.y, backgrnd.z, 1);
-	glViewport(0, 0, hmdW, hmdH);
 	cameraUser.SetModelview(eyeView);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	RenderScene(cameraUser, true);
@@ -282,7 +327,34 @@ void RenderEye(Side e, vec3 backgrnd) {
 		Line(vec2(hmdW/2-20, hmdH/2), vec2(hmdW/2+20, hmdH/2), 3.7f, yel);
 		Line(vec2(hmdW/2, hmdH/2-20), vec2(hmdW/2, hmdH/2+20), 3.7f, yel);
 	}
-	vroom.CopyFramebufferToEyeTexture(fbTextureNames[e], fbTextureUnits[e]);
+	vroom.ResolveEyeFramebuffer(e);
+}
+
+void RenderStereo(vec3 backgrnd) {
+	// render both eyes side by side in one traversal: scene is drawn from mid-eye,
+	// each eye's view applied in clip space by the mesh and draw shaders
+	mat4 midView = LookAt(Origin(head.toWorld), lookAt, vec3(0, 1, 0));
+	cameraUser.SetModelview(midView);
+	mat4 left = StereoClipMatrix(cameraUser.persp, midView, EyeView(Left));
+	mat4 right = StereoClipMatrix(cameraUser.persp, midView, EyeView(Right));
+	vroom.BindStereoFramebuffer();
+	glClearColor(backgrnd.x, backgrnd.y, backgrnd.z, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	SetStereo(true, left, right);
+	RenderScene(cameraUser, true);
+	if (annotate.on) {
+		// center crosshair, same pixels for each eye
+		SetStereo(true);
+		glDisable(GL_DEPTH_TEST);
+		glViewport(0, 0, hmdW, hmdH);
+		mat4 screen = ScreenMode();
+		glViewport(0, 0, 2*hmdW, hmdH);
+		UseDrawShader(screen);
+		Line(vec2(hmdW/2-20, hmdH/2), vec2(hmdW/2+20, hmdH/2), 3.7f, yel);
+		Line(vec2(hmdW/2, hmdH/2-20), vec2(hmdW/2, hmdH/2+20), 3.7f, yel);
+	}
+	SetStereo(false);
+	vroom.ResolveStereoFramebuffer();
 }
 
 void Display() {
@@ -291,29 +363,47 @@ void Display() {
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glEnable(GL_LINE_SMOOTH);
 	glEnable(GL_MULTISAMPLE);
-	// use custom framebuffer to render eye textures, submit to HMD
-	glBindFramebuffer(GL_FRAMEBUFFER, vroom.framebuffer);
-	RenderEye(Left, wht);						// white background
-	RenderEye(Right, wht);						// red background
-	if (vroom.HmdPresent())
-		vroom.SubmitOpenGLFrames(fbTextureUnits[0], fbTextureUnits[1]);
+	// render directly to eye textures, submit to HMD
+	if (singlePass.on) {
+		profiler.Begin("stereo");
+		RenderStereo(wht);
+		profiler.Begin("submit");
+		if (vroom.HmdPresent())
+			vroom.SubmitStereoTexture();
+	}
+	else {
+		profiler.Begin("left eye");
+		RenderEye(Left, wht);					// white background
+		profiler.Begin("right eye");
+		RenderEye(Right, wht);					// red background
+		profiler.Begin("submit");
+		if (vroom.HmdPresent())
+			vroom.SubmitEyeTextures();
+	}
 	// use default framebuffer for app display
+	profiler.Begin("mirror");
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glClearColor(.7f, .7f, .7f, 1);	// grey background
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	// display eye textures
 	glUseProgram(hmdToAppProgram);
 	for (int k = 0; k < 2; k++) {
+		glActiveTexture(GL_TEXTURE0+fbTextureUnits[k]);
+		glBindTexture(GL_TEXTURE_2D, singlePass.on? vroom.stereoTexture : vroom.eyeTextures[k]);
 		SetUniform(hmdToAppProgram, "textureImage", (int) fbTextureUnits[k]);
+		SetUniform(hmdToAppProgram, "uRange", singlePass.on? vec2(.5f*k, .5f*k+.5f) : vec2(0, 1));
 		glViewport(k*appEyeW, winH-appEyeH, appEyeW, appEyeH);
 		glDrawArrays(GL_QUADS, 0, 4);
 	}
 	// display global scene
+	profiler.Begin("scene");
 	glViewport(0, 0, winW, winH-appEyeH);
 	RenderScene(cameraScene, false);
 	// annotations, arcball, buttons
+	profiler.Begin("annotations");
 	UseDrawShader(cameraScene.fullview);
 	glDisable(GL_DEPTH_TEST);
+	BeginDrawBatch();
 	if (annotate.on) {
 		ArrowV(Origin(head.toWorld), 3*ZAxis(head.toWorld), cameraScene.modelview, cameraScene.persp, vec3(1,0,0), 2, 6);
 		// Disk(Origin(head.toWorld)+EyeOffset(Left), 6, red);
@@ -350,15 +440,21 @@ void Display() {
 	}
 	else
 		Disk(Origin(head.toWorld), 8, wht);
+	EndDrawBatch();
 	float dt = (float) (clock()-mouseEvent)/CLOCKS_PER_SEC;
 	if (FramerPicked() && dt < 1)
 		framer.Draw(cameraScene.fullview);
 	if (picked == &cameraScene)
 		cameraScene.arcball.Draw();
 	UseDrawShader(ScreenMode());
-	Quad(vec3(1, 1), vec3(1, 29), vec3(520, 29), vec3(520, 1), true, vec3(.5), .5);
+	BeginDrawBatch();
+	Quad(vec3(1, 1), vec3(1, 29), vec3(640, 29), vec3(640, 1), true, vec3(.5), .5);
 	for (int i = 0; i < nbuttons; i++)
 		buttons[i]->Draw(NULL, 11);
+	EndDrawBatch();
+	if (profile.on)
+		profiler.Overlay(10, winH-appEyeH-10);
+	profiler.End();
 	glFlush();
 }
 
@@ -447,13 +543,7 @@ void MouseMove(float x, float y, bool leftDown, bool rightDown) {
 			}
 		}
 		if (picked == &rightHand) {
-			targeted = Intersect(button, Laser1(), Laser2(), target);
-			billBoardTargeted = Intersect(bench, Laser1(), Laser2(), billBoardTarget);
-			
-			t1Targeted = Intersect(target1, Laser1(), Laser2(), t1Target);
-			t2Targeted = Intersect(target2, Laser1(), Laser2(), t2Target);
-			t3Targeted = Intersect(target3, Laser1(), Laser2(), t3Target);
-			
+			checkTargets();
 			// PrintFrame(rightHand.toWorld);
 		}
 	}
@@ -481,11 +571,12 @@ GLuint MakeTextureDisplayProgram() {
 	const char *vertexDisplayShader = R"(
 		#version 330
 		out vec2 uv;
+		uniform vec2 uRange = vec2(0, 1);		// horizontal texture range (half of stereo texture)
 		void main() {
 			vec2 pts[] = vec2[4](vec2(-1,-1), vec2(-1,1), vec2(1,1), vec2(1,-1));
 			vec2 uvs[] = vec2[4](vec2(0, 0), vec2(0, 1), vec2(1, 1), vec2(1,0));
 			gl_Position = vec4(pts[gl_VertexID], 0, 1);
-			uv = uvs[gl_VertexID];
+			uv = vec2(mix(uRange.x, uRange.y, uvs[gl_VertexID].x), uvs[gl_VertexID].y);
 		}
 	)";
 	const char *pixelDisplayShader = R"(
@@ -510,6 +601,15 @@ void ReadMesh(Mesh &m, string meshName, string imageName, mat4 t = mat4(1)) {
 		printf("can't read %s or %s\n", meshName.c_str(), imageName.c_str());
 }
 
+void LoadMesh(Mesh &m, string meshName, mat4 t = mat4(1)) {
+	// read in background, uploaded by UploadPending in main loop
+	LoadAsync(m, objDir+meshName, &t);
+}
+
+void LoadMesh(Mesh &m, string meshName, string imageName, mat4 t = mat4(1)) {
+	LoadAsync(m, objDir+meshName, imgDir+imageName, &t);
+}
+
 // Target
 int getUnoccupiedPosition() {
 	int numOccupied = 0;
@@ -547,20 +647,20 @@ void displayTargets(float spacing) {
 }
 
 void MakeScene() {
-	// read obj files and set toWorld transforms
+	// read obj files and set toWorld transforms (hands, head, pistol and targets load in background)
 	ReadMesh(bench, "Screen1_Test.obj", "Test_Start_S1.jpg", Scale(.5f) * Translate(0, -.2f, .7f) * RotateZ(90) * RotateX(0) * RotateY(90));
 	ReadMesh(bill2, "Screen1_Test.obj", "Test_Start_S1.jpg", Scale(.5f) * Translate(2.3f, -.2f, .1f) * RotateZ(90) * RotateX(45) * RotateY(90));
 	ReadMesh(bill3, "Screen1_Test.obj", "Test_Start_S1.jpg", Scale(.5f) * Translate(-2.3f, -.2f, .1f) * RotateZ(90) * RotateX(-45) * RotateY(90));
 	ReadMesh(ground, "Test_ground.obj", "marble_floor.jpg", Scale(2) * Translate(0, -.3f, 0));
-	ReadMesh(head, "Head.obj", RotateX(20)*Translate(.5f, .6f, -.85f)*Scale(.17f, .17f, .17f));
-	ReadMesh(leftHand, "HandLeft.obj", Translate(.7f, .4f, -.4f)*RotateX(-45)*Scale(.15f));
-	ReadMesh(rightHand, "Pistol2.obj", "pistol2.png", RotateZ(45) * RotateX(36));
+	LoadMesh(head, "Head.obj", RotateX(20)*Translate(.5f, .6f, -.85f)*Scale(.17f, .17f, .17f));
+	LoadMesh(leftHand, "HandLeft.obj", Translate(.7f, .4f, -.4f)*RotateX(-45)*Scale(.15f));
+	LoadMesh(rightHand, "Pistol2.obj", "pistol2.png", RotateZ(45) * RotateX(36));
 	ReadMesh(button, "Square.obj", "Push!.png", Translate(100.1f, .2f, -.4f)*RotateY(60)*RotateZ(-90)*Scale(.1f, .25f, 1));
 	//ReadMesh(pistol, "Pistol2.obj", "pistol2.png", Translate(.55f, .4f, -.2f) * RotateX(-90) * RotateZ(-90) * Scale(.15f));
 	ReadMesh(box, "aimlab_box.obj", "rocktexture.jpg", Scale(4) * Translate(0, -.05, 1.1f));
-	ReadMesh(target1, "target_sphere.obj", "shooting_target_sphere.jpg" );
-	ReadMesh(target2, "target_sphere.obj", "shooting_target_sphere.jpg");
-	ReadMesh(target3, "target_sphere.obj", "shooting_target_sphere.jpg");
+	LoadMesh(target1, "target_sphere.obj", "shooting_target_sphere.jpg" );
+	LoadMesh(target2, "target_sphere.obj", "shooting_target_sphere.jpg");
+	LoadMesh(target3, "target_sphere.obj", "shooting_target_sphere.jpg");
 	// target positioning
 	float spacing = 3.0f; // adjust as needed
 	displayTargets(spacing);
@@ -569,12 +669,10 @@ void MakeScene() {
 	// button.BuildInfos(); // JB: kill this line
 	// adjust right hand to point at button, test intersection
 	rightHand.toWorld = FromQuatMove(Quaternion(-.58f, -.03f, .57f, .57f), vec3(.42f, .22f, -.39f), .15f);
-	targeted = Intersect(button, Laser1(), Laser2(), target);
-	billBoardTargeted = Intersect(bench, Laser1(), Laser2(), billBoardTarget);
-
-	t1Targeted = Intersect(target1, Laser1(), Laser2(), t1Target);
-	t2Targeted = Intersect(target2, Laser1(), Laser2(), t2Target);
-	t3Targeted = Intersect(target3, Laser1(), Laser2(), t3Target);
+	Mesh *targetable[] = { &button, &bench, &target1, &target2, &target3 };
+	for (Mesh *m : targetable)
+		laserScene.Add(*m);
+	checkTargets();
 
 
 	// if no vr running, orient head towards look-at
@@ -586,21 +684,23 @@ void MakeScene() {
 
 float temp = .1f;
 
-void checkTargets() {
-	targeted = Intersect(button, Laser1(), Laser2(), target);
-	billBoardTargeted = Intersect(bench, Laser1(), Laser2(), billBoardTarget);
-	t1Targeted = Intersect(target1, Laser1(), Laser2(), t1Target);
-	t2Targeted = Intersect(target2, Laser1(), Laser2(), t2Target);
-	t3Targeted = Intersect(target3, Laser1(), Laser2(), t3Target);
-}
 
+void SaveScreenshot() {
+	// call after Display, before swap
+	static int nScreenshots = 0;
+	char name[100];
+	snprintf(name, sizeof(name), "Screenshot%i.png", nScreenshots++);
+	if (Screenshot(name, 0, winW, winH))
+		printf("%s written (asynchronously)\n", name);
+	screenshotPending = false;
+}
 
 void Keyboard(int key, bool press, bool shift, bool control) {
 	if (press && key == ' ' && targeted) {
 		hits.push_back(target);	// JB: changed // use for bulltet holes
 		temp += 0.1f;
 		//button.toWorld = Translate(temp, .2f, -.4f);
-		targeted = Intersect(button, Laser1(), Laser2(), target);
+		checkTargets();
 		//buttonHit = !buttonHit;
 		//checkTargets();
 	}
@@ -644,8 +744,26 @@ void Keyboard(int key, bool press, bool shift, bool control) {
 		t3position = temp;
 		//checkTargets();
 	}
-		 
-		
+	if (press && key == 'M') {
+		// cycle eye multisampling: 1, 2, 4, 8
+		int n = vroom.eyeSamples < 8? 2*vroom.eyeSamples : 1;
+		if (vroom.SetEyeSamples(n))
+			printf("eye multisampling: %i samples\n", vroom.eyeSamples);
+	}
+	if (press && key == 'P' && profiler.WriteCSV("FrameProfile.csv"))
+		printf("frame times written to FrameProfile.csv\n");
+	if (press && key == 'C')
+		screenshotPending = true;	// keys are handled after the swap, when the back buffer is undefined
+	if (press && key == 'R') {
+		// record app window, or (with shift) eye textures, as raw rgb frames
+		if (Recording())
+			StopRecording();
+		else if (shift)
+			StartRecording("EyeFrames.raw", CaptureRaw, singlePass.on? vroom.stereoFramebuffer : vroom.eyeFramebuffers[Left],
+				singlePass.on? 2*vroom.width : vroom.width, vroom.height);
+		else
+			StartRecording("AppFrames.raw", CaptureRaw, 0, winW, winH);
+	}
 }
 
 void Resize(int width, int height) {
@@ -659,12 +777,30 @@ void Resize(int width, int height) {
 
 const char *usage = R"(
 	<space bar>: fire!
+	M: cycle eye multisampling (1, 2, 4, 8 samples)
+	P: write per-frame stage timing to FrameProfile.csv
+	C: screenshot app window to Screenshot<n>.png
+	R: start/stop recording app window to AppFrames.raw (shift-R: eye textures to EyeFrames.raw)
+	(run with -mock to use scripted poses in place of a headset)
 )";
 
-int main() {
+void MockPoses(double t, mat4 &headM, mat4 &leftHandM, mat4 &rightHandM) {
+	// standing user looks slowly left and right, right hand sweeps across targets
+	float a = (float) t;
+	headM = Translate(0, 1.6f, 0)*RotateY(15*sin(.4f*a));
+	leftHandM = Translate(-.2f, 1.2f, -.3f);
+	rightHandM = Translate(.2f, 1.2f, -.3f)*RotateY(30*sin(.5f*a))*RotateX(10*sin(.3f*a));
+}
+
+int main(int ac, char **av) {
 	try {
-		// initialize VR, app window, OpenGL
-		bool runtime = vroom.InitOpenVR();
+		// initialize VR (or mock VR), app window, OpenGL
+		bool mock = ac > 1 && !strcmp(av[1], "-mock");
+		if (mock) {
+			mockVR.script = MockPoses;
+			mockVR.recordSubmits = true;
+		}
+		bool runtime = mock? vroom.InitMockVR(&mockVR) : vroom.InitOpenVR();
 			// this should list all connected devices, which can be one of:
 			// Invalid, HMD, Controller, GenericTracker, TrackingReference, DisplayRedirect
 		if (!runtime)
@@ -680,9 +816,9 @@ int main() {
 			hmdW = vroom.RecommendedWidth();
 			hmdH = vroom.RecommendedWidth();
 		}
-		if (!vroom.InitFrameBuffer(hmdW, hmdH))
-			printf("can't make frame buffer");
-		glGenTextures(2, fbTextureNames);
+		if (!vroom.InitEyeFramebuffers(hmdW, hmdH) || !vroom.InitStereoFramebuffer())
+			printf("can't make eye frame buffers");
+		vroom.SetEyeSamples(4);
 		if (hmdPresent)
 			printf("headset present\n");
 		// read meshes, position/orient characters
@@ -696,13 +832,29 @@ int main() {
 		printf("Usage: %s", usage);
 		glfwSwapInterval(1);
 		while (!glfwWindowShouldClose(w)) {
+			profiler.BeginFrame();
+			profiler.Begin("update");
+			UploadPending(2);
+			PredictVrTransforms();
 			checkTargets();
 			GetVrTransforms();
 			Display();
+			profiler.Begin("capture");
+			if (screenshotPending)
+				SaveScreenshot();
+			CaptureFrame();
+			profiler.EndFrame();
 			glfwSwapBuffers(w);
 			glfwPollEvents();
 		}
 		// finish
+		if (mock) {
+			printf("mock VR: %i frames, %i submits\n", mockVR.frame, (int) mockVR.submits.size());
+			mockVR.WriteSubmits("MockSubmits.csv");
+		}
+		profiler.Release();
+		StopLoader();
+		StopCapture();
 		vr::VR_Shutdown();
 		glfwDestroyWindow(w);
 		glfwTerminate();
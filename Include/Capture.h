@@ -0,0 +1,53 @@
+// Capture.h - asynchronous screenshots and frame recording
+
+#ifndef CAPTURE_HDR
+#define CAPTURE_HDR
+
+#include "glad.h"
+
+// Asynchronous Capture
+
+// a readback is copied by the GPU into one of a ring of pixel buffer objects and fenced; CaptureFrame
+// maps it once the fence has signaled (normally a frame or two later) and hands the pixels to a worker
+// thread that flips, converts and encodes them, so neither the render thread nor the GPU waits
+// a source is a single-sample framebuffer: 0 (window back buffer), or eg vroom.eyeFramebuffers[e]
+// or vroom.stereoFramebuffer (after resolve); pixels are read from its lower-left corner
+// width or height 0 means the viewport size when called
+
+enum CaptureFormat { CapturePng = 0, CaptureTga, CaptureBmp, CaptureRaw };
+
+bool Screenshot(const char *filename, GLuint framebuffer = 0, int width = 0, int height = 0);
+	// queue readback of lower-left width by height pixels of framebuffer, written on the worker thread
+	// format from filename extension (.png, .tga, .bmp, .raw; default png)
+	// return false if all readback buffers are in flight
+
+bool StartRecording(const char *name, CaptureFormat format = CaptureRaw, GLuint framebuffer = 0, int width = 0, int height = 0);
+	// read framebuffer at each CaptureFrame; size fixed for the recording
+	// raw: frames appended to file name (rgb, top row first), eg for assembly by
+	//     ffmpeg -f rawvideo -pixel_format rgb24 -video_size <w>x<h> -framerate 90 -i <name> out.mp4
+	// else name is a printf pattern for each frame's file (eg, "frame%05i.png"), numbered from 0
+
+void StopRecording();
+	// no further readbacks; queued frames are still written
+
+bool Recording();
+
+void CaptureFrame();
+	// call on GL thread once per frame, after rendering the recorded source (eg, before swap):
+	// issue recording readback, map readbacks whose fences have signaled, pass them to the worker
+	// never waits: a recording frame is dropped if the ring or encoder queue is full
+
+void FinishCaptures();
+	// on GL thread: block until all readbacks are mapped and written
+
+void StopCapture();
+	// stop recording, finish captures, join worker, delete buffers (call before exit)
+
+void SetCaptureBuffers(int nBuffers, int maxQueued = 8);
+	// readback ring size (default 3) and # mapped frames awaiting the encoder before recording drops frames
+	// ring size effective before first capture (or after StopCapture)
+
+int NDroppedFrames();
+	// # frames dropped by the current (or last) recording
+
+#endif
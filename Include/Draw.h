@@ -48,6 +48,49 @@ float ScreenDSq(int x, int y, vec3 p, mat4 m, float *zscreen = NULL);
 double ScreenZ(vec3 p, mat4 m);
 bool FrontFacing(vec3 base, vec3 vec, mat4 view);
 
+// single-pass stereo
+void SetStereo(bool on, mat4 left = mat4(), mat4 right = mat4());
+	// if on, Mesh::Display and draw-shader operations render both eyes, side by side, in one (instanced) call
+	// left, right map the app camera's clip space to each eye's (see StereoClipMatrix); on enables GL_CLIP_DISTANCE0
+bool Stereo();
+mat4 StereoMatrix(int eye);
+int StereoInstances();
+	// 2 if stereo on, else 1
+mat4 StereoClipMatrix(mat4 persp, mat4 modelview, mat4 eyeModelview);
+	// map clip space of (persp, modelview) to clip space of (persp, eyeModelview)
+#define STEREO_VERTEX_CODE \
+	"uniform bool stereo = false;\n" \
+	"uniform mat4 stereoMatrices[2];\n" \
+	"vec4 StereoPosition(vec4 p) {\n" \
+	"\t// even instances left eye, odd right; each eye squeezed into its half of the viewport\n" \
+	"\tif (!stereo)\n" \
+	"\t\treturn p;\n" \
+	"\tint eye = gl_InstanceID%2;\n" \
+	"\tp = stereoMatrices[eye]*p;\n" \
+	"\tp.x = .5*p.x+(eye == 0? -.5 : .5)*p.w;\n" \
+	"\tgl_ClipDistance[0] = eye == 0? -p.x : p.x;\n" \
+	"\treturn p;\n" \
+	"}\n"
+	// GLSL for vertex shaders, inserted after #version: gl_Position = StereoPosition(clip-space position)
+
+// batched drawing
+void BeginDrawBatch();
+	// Disk, Line, LineStrip, Quad (untextured), Triangle (not outlined), and functions built on them (Star, Arrow, Box, etc.)
+	// are appended to a vertex stream (positions transformed on append by the current UseDrawShader/UseTriangleShader view)
+	// and drawn by FlushDrawBatch, grouped by primitive type and line width, one draw per group
+	// groups are drawn in order of first use; call order is kept within a group, not across groups
+	// GL state used at flush (viewport, depth test, blending) should not change while primitives are pending
+	// textured quads, outlined triangles and cylinders flush, then draw immediately
+void FlushDrawBatch();
+	// draw pending primitives (also called when stereo changes, or when the stream region is full)
+void EndDrawBatch();
+	// flush and resume immediate drawing
+bool DrawBatching();
+void AtlasQuads(GLuint atlas, int coverage, int nQuads, vec4 *corners, vec3 color, mat4 view, float opacity = 1);
+	// quads given by four corners (x, y, u, v): (x, y) transformed by view, (u, v) in atlas texture
+	// opacity modulated by atlas red: coverage 0 red, 1 1-red, 2 signed distance (.5 at edge, sharp at any scale)
+	// batched like the primitives above, grouped by atlas; if not batching, drawn at once (one draw per call)
+
 // 2D/3D drawing functions
 int UseDrawShader();
 	// invoke shader for Disk, Line, Quad, and Arrow, but do not change view transformation
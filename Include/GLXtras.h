@@ -61,6 +61,7 @@ bool ReadProgramBinary(GLuint program, const char *filename);
 GLuint ReadProgramBinary(const char *filename);
 
 // Uniforms
+// Linking or deleting a program via the routines above keeps its uniform cache current
 void SetReport(bool report);
 	// if report, print any unknown uniforms or attributes
 bool SetUniform(int program, const char *name, bool val);
@@ -82,6 +83,38 @@ bool SetUniform4v(int program, const char *name, int count, float *v);
 bool SetUniform(int program, const char *name, mat4 m);
 	// if no such named uniform and squawk, print error message
 
+// Uniform Cache
+GLint UniformLocation(int program, const char *name);
+	// location (or -1) from a per-program cache, built when linked and cleared by DeleteProgram
+	// named SetUniform calls use this in place of glGetUniformLocation
+void ReflectUniforms(int program);
+	// rebuild cache; needed only if program linked or deleted other than by routines above
+int UniformLookupsAvoided(bool reset = false);
+	// number of glGetUniformLocation calls saved by the cache and handles
+
+// Uniform Handles
+bool SetUniform(GLint id, bool val);
+bool SetUniform(GLint id, int val);
+bool SetUniform(GLint id, float val);
+bool SetUniform(GLint id, vec2 v);
+bool SetUniform(GLint id, vec3 v);
+bool SetUniform(GLint id, vec4 v);
+bool SetUniform(GLint id, mat4 m);
+	// set by location; return false if id < 0
+GLint ResolveUniform(int program, const char *name, GLint &id, int &epoch);
+	// return id, looked up again only if any program reflected or deleted since epoch
+template<class T> struct Uniform {
+	// pre-resolved uniform: Set is an int compare plus glUniform
+	int program = 0;
+	const char *name = NULL;	// not copied: use a string literal
+	GLint id = -1;
+	int epoch = -1;
+	Uniform() { }
+	Uniform(int program, const char *name) : program(program), name(name) { }
+	bool Set(T v) { return SetUniform(ResolveUniform(program, name, id, epoch), v); }
+	GLint Id() { return ResolveUniform(program, name, id, epoch); }
+};
+
 // Attributes
 int EnableVertexAttribute(int program, const char *name);
 	// find named attribute and enable
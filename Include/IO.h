@@ -6,6 +6,7 @@
 #include <glad.h>
 #include <string.h>
 #include <vector>
+#include "Misc.h"
 #include "VecMat.h"
 
 using std::string;
@@ -15,6 +16,51 @@ using std::vector;
 
 GLuint ReadTexture(const char *filename, bool mipmap = true, int *nchannels = NULL, int *width = NULL, int *height = NULL);
 	// load image file; return texture name
+	// textures are shared: repeated reads of the same file (and mipmap setting) return the same
+	// texture name and increment its reference count
+	// if the texture cache is enabled, the image is read via CookTexture
+
+struct DecodedImage {
+	unsigned char *pixels = NULL;
+	int width = 0, height = 0, nChannels = 0;
+	DecodedImage() { }
+	DecodedImage(const DecodedImage &) = delete;
+	DecodedImage &operator=(const DecodedImage &) = delete;
+	~DecodedImage();
+};
+
+bool DecodeImage(const char *filename, DecodedImage &image);
+	// decode image file, flipped vertically as in ReadTexture; no GL calls, safe on any thread
+
+GLuint ReadTexture(const char *filename, DecodedImage &image, bool mipmap = true);
+	// as ReadTexture, with image previously decoded; if filename already read, image is ignored
+
+struct CookedTexture {
+	int width = 0, height = 0, nChannels = 0;	// nChannels of source image; all levels are rgba
+	vector<const unsigned char *> levels;		// full mip chain, level 0 width by height
+	MappedFile file;							// cache contents, if mapped
+	vector<unsigned char> pixels;				// else levels cooked in memory
+	CookedTexture() { }
+	CookedTexture(const CookedTexture &) = delete;
+	CookedTexture &operator=(const CookedTexture &) = delete;
+};
+
+bool CookTexture(const char *filename, CookedTexture &texture);
+	// map the cache <filename>.tex if it matches the size and modification time of filename, else
+	// decode filename, compute mip chain (2x2 box filter) and (re)write the cache (if enabled)
+	// no GL calls, safe on any thread
+
+GLuint ReadTexture(const char *filename, CookedTexture &texture, bool mipmap = true);
+	// as ReadTexture, with texture previously cooked: immutable storage, one upload per level
+	// if filename already read, texture is ignored
+
+void SetTextureCache(bool use);
+	// enable/disable cooked texture cache (default enabled)
+	// if disabled, ReadTexture decodes and generates mipmaps on the GPU
+
+void ReleaseTexture(GLuint textureName);
+	// decrement reference count of texture returned by ReadTexture, delete texture if unreferenced
+	// texture names not returned by ReadTexture are ignored
 
 GLuint LoadTexture(unsigned char *pixels, int width, int height, int bpp, bool bgr = false, bool mipmap = true);
 	// load pixels (bpp: bytes per pixel), return texture name
@@ -26,6 +72,7 @@ void SavePng(const char *filename);
 void SaveBmp(const char *filename);
 
 void SaveTga(const char *filename);
+	// SavePng, SaveBmp, SaveTga read the viewport synchronously; see Capture.h for screenshots without a stall
 
 // Buffer to GPU
 //    GLuint int textureName;
@@ -101,6 +148,33 @@ bool ReadAsciiObj(const char    *filename,                  // must be ASCII fil
 	// set points and triangles; normals, textures, quads optional
 	// return true if successful
 
+bool ReadAsciiObjParallel(const char    *filename,
+						  vector<vec3>  &points,
+						  vector<int3>  &triangles,
+						  vector<vec3>  *normals = NULL,
+						  vector<vec2>  *textures = NULL,
+						  vector<Group> *triangleGroups = NULL,
+						  vector<Mtl>   *triangleMtls = NULL,
+						  vector<int4>  *quads = NULL,
+						  vector<int2>  *segs = NULL,
+						  int            nThreads = 0);
+	// as ReadAsciiObj (with identical results), but map the file and parse line-aligned chunks on
+	// nThreads threads (0: one per hardware thread), then merge chunks in file order
+
+bool ReadObj(const char    *filename,
+			 vector<vec3>  &points,
+			 vector<int3>  &triangles,
+			 vector<vec3>  *normals = NULL,
+			 vector<vec2>  *textures = NULL,
+			 vector<Group> *triangleGroups = NULL,
+			 vector<Mtl>   *triangleMtls = NULL,
+			 vector<int4>  *quads = NULL);
+	// as ReadAsciiObj, but if the binary cache <filename>.bin matches the size and modification
+	// time of filename, map the cache rather than parse; else parse and (re)write the cache
+
+void SetObjCache(bool use);
+	// enable/disable ReadObj binary cache (default enabled)
+
 bool WriteAsciiObj(const char      *filename,
 				   vector<vec3>    &points,
 				   vector<vec3>    &normals,
@@ -0,0 +1,42 @@
+// Intersect.h - vectorized line/triangle intersection over structure-of-arrays packets
+
+#ifndef INTERSECT_HDR
+#define INTERSECT_HDR
+
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+// Triangle Packets
+
+// kernels use unaligned loads: vector storage need not honor alignas(32) (eg, without C++17 aligned new)
+struct alignas(32) TriPacket {
+	float v0[3][8];				// first vertex x, y, z per lane
+	float e1[3][8], e2[3][8];	// edges v1-v0, v2-v0
+	int ids[8];					// triangle (or quad) index, -1 if lane unused
+};
+
+struct TriPackets {
+	vector<TriPacket> packets;
+	vector<int2> nodePackets;	// per BVH node: first packet, # packets (0 if interior node)
+	void Build(vector<vec3> &points, vector<int3> &triangles, vector<int> &order, vector<int2> &leaves);
+	void Build(vector<vec3> &points, vector<int4> &quads, vector<int> &order, vector<int2> &leaves);
+		// leaves[n]: start, count in order of node n's primitives (count 0 if interior)
+		// each leaf is packed into its own packet(s); quads are packed as triangles
+		// (1,2,3) and (1,3,4) with the quad index as id
+};
+
+// Kernels
+
+void IntersectPackets(vec3 p, vec3 d, TriPacket *packets, int nPackets, float &alpha, int &id);
+	// Moller-Trumbore intersection of line p+alpha*d with packets; two-sided, any alpha sign
+	// update alpha, id if a triangle is hit at smaller alpha (or equal alpha and smaller id)
+
+const char *IntersectKernel();
+	// name of kernel selected at startup: "avx2", "sse" or "scalar"
+
+void SetIntersectKernel(const char *name);
+	// select "avx2", "sse" or "scalar"; if unsupported by cpu, the next slower kernel is used
+
+#endif
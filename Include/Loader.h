@@ -0,0 +1,33 @@
+// Loader.h - background loading of meshes and textures
+
+#ifndef LOADER_HDR
+#define LOADER_HDR
+
+#include "Mesh.h"
+
+// Asynchronous Load
+
+void LoadAsync(Mesh &mesh, string objFile, mat4 *m = NULL, bool standardize = true, bool forceTriangles = false);
+void LoadAsync(Mesh &mesh, string objFile, string texFile, mat4 *m = NULL, bool standardize = true, bool forceTriangles = false);
+	// parse object file and cook texture file (see CookTexture) on a worker thread; matrix is set immediately,
+	// geometry and texture are attached to mesh (and buffered) by a later UploadPending
+	// until then the mesh displays nothing and cannot be intersected
+	// mesh must not be destroyed while its load is pending
+
+int UploadPending(float budgetMs = 2);
+	// call on GL thread (eg, once per frame): attach and buffer completed loads until budget spent
+	// at least one completed load is uploaded per call; return # loads not yet uploaded
+
+int NPendingLoads();
+	// # loads requested but not yet uploaded
+
+void FinishLoads();
+	// on GL thread: block until all loads are parsed and uploaded
+
+void StopLoader();
+	// join worker threads; pending loads are discarded
+
+void SetLoaderThreads(int nThreads);
+	// # worker threads, effective before first LoadAsync (default: hardware threads-1, at least 1)
+
+#endif
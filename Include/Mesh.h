@@ -3,9 +3,11 @@
 #ifndef MESH_HDR
 #define MESH_HDR
 
+#include <memory>
 #include <vector>
 #include "glad.h"
 #include "Camera.h"
+#include "Intersect.h"
 #include "IO.h"
 #include "Quaternion.h"
 #include "VecMat.h"
@@ -38,23 +40,64 @@ struct QuadInfo {
 	QuadInfo(vec3 p1, vec3 p2, vec3 p3, vec3 p4);
 };
 
-// Mesh Class and Operations
+// Bounding Volume Hierarchy
 
-class Mesh {
-public:
-	Mesh() { };
-	Mesh(const char *filename) { Read(string(filename)); }
-	~Mesh() { glDeleteBuffers(1, &vBufferId); };
-	string objFilename, texFilename;
-	// vertices and facets
+struct BVHNode {
+	vec3 min, max;					// bounds, padded
+	int start = 0, count = 0;		// leaf: range in BVH::indices
+	int left = -1, right = -1;		// interior (count == 0): child nodes
+};
+
+struct BVH {
+	vector<BVHNode> nodes;			// nodes[0] is root
+	vector<int> indices;			// primitive (triangle or quad) indices, grouped by leaf
+	void Build(vector<vec3> &points, vector<int3> &triangles, bool parallel = false);
+	void Build(vector<vec3> &points, vector<int4> &quads, bool parallel = false);
+	void Build(vector<vec3> &mins, vector<vec3> &maxs, bool parallel = false);
+		// BVH over boxes (eg, mesh bounds)
+		// binned surface area heuristic; if parallel, subtrees near the root are built on threads
+};
+
+// Mesh Geometry
+
+struct MeshGeometry {
+	// vertices, facets, GPU buffers and intersection data, shared by meshes read from the same file
+	string			objFilename;
 	vector<vec3>	points;
 	vector<vec3>	normals;
 	vector<vec2>	uvs;
 	vector<int3>	triangles;
 	vector<int4>	quads;
-	// ancillary data
 	vector<Group>	triangleGroups;
 	vector<Mtl>		triangleMtls;
+	GLuint			vao = 0;		// vertex array object
+	GLuint			vBufferId = 0;	// vertex buffer
+	GLuint			eBufferId = 0;	// element buffer: triangles, then quads
+	GLuint			iBufferId = 0;	// instance buffer (transforms, colors), streamed by DisplayInstanced
+	size_t			iBufferSize = 0;
+	vector<TriInfo> triInfos;
+	vector<QuadInfo> quadInfos;
+	BVH				triBVH, quadBVH;
+	TriPackets		triPackets, quadPackets;	// triangles in BVH leaf order, for vectorized intersection
+	~MeshGeometry();
+};
+
+std::shared_ptr<MeshGeometry> ReadGeometry(string objFile, bool standardize = true, bool forceTriangles = false);
+	// read object file, or return geometry already read from objFile with the same options
+	// no GL calls (geometry is not buffered); safe on any thread; return NULL if can't read
+
+// Mesh Class and Operations
+
+class Mesh {
+public:
+	Mesh() : geometry(std::make_shared<MeshGeometry>()) { };
+	Mesh(const char *filename) : geometry(std::make_shared<MeshGeometry>()) { Read(string(filename)); }
+	Mesh(const Mesh &) = delete;
+	Mesh &operator=(const Mesh &) = delete;
+	~Mesh() { ReleaseTexture(textureName); };
+	string objFilename, texFilename;
+	// vertices, facets, GPU buffers (shared with other meshes read from same file)
+	std::shared_ptr<MeshGeometry> geometry;
 	// position/orientation
 	vec3			centerOfRotation;
 	mat4			toWorld;		// view = camera.modelview*toWorld
@@ -62,16 +105,11 @@ public:
 	// hierarchy
 	Mesh		   *parent = NULL;
 	vector<Mesh *>	children;
-	// GPU vertex buffer and texture
-	GLuint			vao = 0;		// vertex array object
-	GLuint			vBufferId = 0;	// vertex buffer
-	GLuint			eBufferId = 0;	// element (triangle) buffer
+	// texture (shared via ReadTexture)
 	GLuint			textureName = 0;
-	// intersection
-	vector<TriInfo> triInfos;
-	vector<QuadInfo> quadInfos;
 	// operations
 	void Clear();
+		// detach from any shared geometry
 	void Buffer();
 	void Buffer(vector<vec3> &pts, vector<vec3> *nrms = NULL, vector<vec2> *uvs = NULL);
 		// if non-null, nrms and uvs assumed same size as pts
@@ -83,16 +121,25 @@ public:
 		// for this mesh set wrtParent given parent and toWorld
 	void Display(Camera camera, int textureUnit = -1, bool lines = false, bool useGroupColor = false);
 		// texture is enabled if textureUnit >= 0 and textureName set
+		// if Stereo() (see Draw.h), both eyes are drawn with one call
 		// before this call, app must optionally change uniforms from their default, including:
 		//     nLights, lights, color, opacity, ambient
 		//     useLight, useTint, fwdFacingOnly, facetedShading
 		//     outlineColor, outlineWidth, transition
+	void DisplayInstanced(Camera camera, vector<mat4> &transforms, vector<vec3> *colors = NULL,
+						  int textureUnit = -1, bool lines = false);
+		// draw one instance per transform (in place of toWorld), one draw call for triangles, one for quads
+		// if non-null, colors (same size as transforms) replaces the color uniform per instance
+		// triangles and quads drawn, ungrouped (no per-group color or texture); uniforms as for Display
 	bool Read(string objFile, mat4 *m = NULL, bool standardize = true, bool buffer = true, bool forceTriangles = false);
 		// read in object file (with normals, uvs), initialize matrix, build vertex buffer
+		// geometry is shared with any mesh read from the same file with the same options
 	bool Read(string objFile, string texFile, mat4 *m = NULL, bool standardize = true, bool buffer = true, bool forceTriangles = false);
 		// read in object file (with normals, uvs) and texture file, initialize matrix, build vertex buffer
-	void BuildInfos();
-	bool IntersectWithSegment(vec3 p1, vec3 p2, float *alpha = NULL);
+	void BuildInfos(bool parallelBVH = false);
+		// build triangle and quad infos, their BVHs and packets
+	bool IntersectWithSegment(vec3 p1, vec3 p2, float *alpha = NULL, int *index = NULL, bool *isQuad = NULL);
+		// if non-null, set index of intersected triangle (or quad, if isQuad)
 };
 
 // Intersections
@@ -108,4 +155,12 @@ int IntersectWithLine(vec3 p1, vec3 p2, vector<TriInfo> &triInfos, float &alpha)
 
 int IntersectWithLine(vec3 p1, vec3 p2, vector<QuadInfo> &quadInfos, float &alpha);
 
+int IntersectWithLine(vec3 p1, vec3 p2, vector<TriInfo> &triInfos, BVH &bvh, float &alpha);
+int IntersectWithLine(vec3 p1, vec3 p2, vector<QuadInfo> &quadInfos, BVH &bvh, float &alpha);
+	// as above, traversing bvh front-to-back; same index and alpha as linear search
+
+int IntersectWithLine(vec3 p1, vec3 p2, TriPackets &packets, BVH &bvh, float &alpha);
+	// traverse bvh, test leaf triangles (or quads) with vectorized kernel (see Intersect.h)
+	// alpha may differ from above by roundoff
+
 #endif
@@ -14,8 +14,23 @@ using std::vector;
 
 string GetDirectory();
 time_t FileModified(const char *name);
+long FileSize(const char *name);
 bool FileExists(const char *name);
 
+// Memory-mapped File
+
+struct MappedFile {
+	const char *data = NULL;
+	size_t size = 0;
+	bool Open(const char *name);
+		// map file read-only; return false if can't open or empty
+	void Close();
+	~MappedFile() { Close(); }
+#ifdef _WIN32
+	void *file = NULL, *mapping = NULL;
+#endif
+};
+
 // Sphere
 
 float RaySphere(vec3 base, vec3 v, vec3 center, float radius);
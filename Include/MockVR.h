@@ -0,0 +1,71 @@
+// MockVR.h - in-process stand-in for the OpenVR system and compositor, for testing without a headset
+
+#ifndef MOCK_VR_HDR
+#define MOCK_VR_HDR
+
+#include <openvr.h>
+#include <chrono>
+#include <vector>
+#include "glad.h"
+#include "VecMat.h"
+
+// Poses
+
+struct MockPose {
+	// device-to-tracking transforms (OpenVR convention, as returned by the runtime) at time t
+	double	t = 0;
+	mat4	head, leftHand, rightHand;
+	MockPose() { }
+	MockPose(double t, mat4 head, mat4 leftHand, mat4 rightHand) : t(t), head(head), leftHand(leftHand), rightHand(rightHand) { }
+};
+
+typedef void (*MockPoseScript)(double t, mat4 &head, mat4 &leftHand, mat4 &rightHand);
+	// set device transforms for time t (seconds since mock started)
+
+struct MockSubmit {
+	// one compositor Submit
+	int		frame = 0;
+	vr::EVREye eye = vr::Eye_Left;
+	GLuint	textureName = 0;
+	vr::VRTextureBounds_t bounds = {0, 0, 1, 1};
+	double	t = 0;				// seconds since mock started
+};
+
+// Mock Runtime
+
+class MockVR {
+public:
+	// device indices: HMD 0, left controller 1, right controller 2
+	enum { hmdIndex = 0, leftHandIndex = 1, rightHandIndex = 2, nDevices = 3 };
+	float	refreshRate = 90;			// Hz (eg, 90, 120)
+	float	vsyncToPhotons = .011f;
+	bool	pace = true;				// if false, WaitGetPoses returns at once (benchmarks), time advances per frame
+	int		recommendedWidth = 1440, recommendedHeight = 1600;
+	int		frame = 0;
+	std::vector<MockPose> poses;		// keyframes (recorded or scripted), interpolated; used if no script
+	MockPoseScript script = NULL;
+	std::vector<MockSubmit> submits;	// record of Submit calls, if recordSubmits
+	bool	recordSubmits = false;
+	size_t	maxSubmits = 200000;		// recording stops when full (about 18 minutes of stereo at 90 Hz)
+	MockVR(float refreshRate = 90) : refreshRate(refreshRate) { start = std::chrono::steady_clock::now(); }
+	double Time();
+		// seconds since start (if !pace, frame/refreshRate)
+	void GetPoses(double t, mat4 &head, mat4 &leftHand, mat4 &rightHand);
+		// from script, else keyframes (position lerp, orientation slerp), else identity
+	bool ReadPoses(const char *filename);
+	bool WritePoses(const char *filename, std::vector<MockPose> &poses);
+		// text file, one line per pose: t, then head, leftHand, rightHand as 3 rows of 4 floats each
+	bool WriteSubmits(const char *filename);
+		// csv: frame, eye, texture, bounds, time
+	// subset of IVRSystem, IVRCompositor used by VROOM
+	vr::EVRCompositorError WaitGetPoses(vr::TrackedDevicePose_t *renderPoses, uint32_t nRender, vr::TrackedDevicePose_t *gamePoses, uint32_t nGame);
+		// block until next vsync (if pace), then advance frame and return poses predicted for display
+	void GetDeviceToAbsoluteTrackingPose(float secondsFromNow, vr::TrackedDevicePose_t *poses, uint32_t nPoses);
+	bool GetTimeSinceLastVsync(float *seconds, uint64_t *frameCounter);
+	vr::EVRCompositorError Submit(vr::EVREye eye, const vr::Texture_t *texture, const vr::VRTextureBounds_t *bounds = NULL);
+private:
+	std::chrono::steady_clock::time_point start;
+	void SetPoses(double t, vr::TrackedDevicePose_t *poses, uint32_t nPoses);
+};
+
+#endif
@@ -0,0 +1,41 @@
+// PixelFormat.h - pixel format conversion for readbacks and uploads
+
+#ifndef PIXEL_FORMAT_HDR
+#define PIXEL_FORMAT_HDR
+
+#include <stddef.h>
+
+// Conversion
+
+// on x86, AVX2, SSSE3 and SSE2 kernels are compiled regardless of compiler arch flags and selected at
+// startup by the cpu (as Intersect.h), else scalar; large images (a million or more values) are split
+// across hardware threads; pixels are tightly packed; src and dst may not overlap
+
+void FloatToByte(const float *src, unsigned char *dst, size_t n);
+	// n values: dst = 255*src, rounded, clamped to [0, 255]
+
+void ByteToFloat(const unsigned char *src, float *dst, size_t n);
+	// n values: dst = src/255
+
+void RgbToRgba(const unsigned char *rgb, unsigned char *rgba, size_t nPixels, unsigned char alpha = 255);
+
+void RgbaToRgb(const unsigned char *rgba, unsigned char *rgb, size_t nPixels);
+
+void SwapRedBlue(unsigned char *pixels, size_t nPixels, int nChannels);
+	// in place, nChannels 3 or 4: rgb(a) <-> bgr(a)
+
+void FlipVertical(unsigned char *pixels, int width, int height, int bytesPerPixel);
+	// in place: exchange rows j and height-1-j (eg, GL bottom-up readback to top-down image file)
+
+void Premultiply(unsigned char *rgba, size_t nPixels);
+	// in place: rgb = rgb*a/255, rounded
+
+// Kernel Selection
+
+const char *PixelFormatKernel();
+	// widest kernels selected at startup: "avx2", "ssse3", "sse2" or "scalar"
+
+void SetPixelFormatKernel(const char *name);
+	// limit kernels to "avx2", "ssse3", "sse2" or "scalar"; if unsupported by cpu, the widest supported is used
+
+#endif
@@ -0,0 +1,72 @@
+// Profiler.h - per-stage CPU and GPU frame timing
+
+#ifndef PROFILER_HDR
+#define PROFILER_HDR
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "glad.h"
+#include "VecMat.h"
+
+using std::string;
+using std::vector;
+
+// Frame Profiler
+
+// each named stage is timed on the CPU (wall clock between Begin and End) and on the GPU
+// (GL_TIME_ELAPSED query); queries are double-buffered and a frame's GPU times are read
+// at the end of the following frame, only if already available, so profiling never waits on the GPU
+
+struct ProfileStats {
+	float	min = 0, avg = 0, p99 = 0;		// milliseconds
+	int		n = 0;							// # frames with a valid time
+};
+
+class Profiler {
+public:
+	int		historySize = 300;				// frames in rolling statistics
+	int		maxFrames = 36000;				// per-frame records kept for WriteCSV (6+ minutes at 90 Hz)
+	int		nGpuMissed = 0;					// # GPU times not available a frame later (discarded)
+	void BeginFrame();
+	void EndFrame();
+		// bracket one frame; stage 0 ("frame") is the CPU time between these, its GPU time the sum of stages
+	void Begin(const char *stage);
+	void End();
+		// bracket a named stage; stages may not nest, and each should occur at most once per frame
+		// (a repeated stage accumulates CPU time, GPU time is measured for its first occurrence only)
+	int NStages();
+	const char *StageName(int stage);
+	ProfileStats CpuStats(int stage);
+	ProfileStats GpuStats(int stage);
+		// min, avg, 99th percentile over the last historySize frames
+	void Overlay(int x, int y, float textSize = 11, vec3 color = vec3(0, 0, 0));
+		// draw table of stage statistics, top-left at pixel (x, y), in the current viewport
+	bool WriteCSV(const char *filename);
+		// one row per frame: frame, then cpu and gpu milliseconds per stage (empty if not measured)
+	void Release();
+		// delete query objects (requires GL context) and clear statistics and records
+private:
+	typedef std::chrono::steady_clock Clock;
+	struct Stage {
+		string	name;
+		GLuint	queries[2] = {0, 0};
+		bool	issued[2] = {false, false};
+		float	cpu[2] = {-1, -1};			// ms, per query buffer
+		vector<float> cpuHistory, gpuHistory;
+	};
+	struct FrameRecord {
+		int		frame = 0;
+		vector<float> cpu, gpu;
+	};
+	vector<Stage> stages;
+	vector<FrameRecord> records;
+	int		frame = 0, current = -1, historyPos = 0;
+	bool	queryActive = false;
+	Clock::time_point frameStart, stageStart;
+	int FindStage(const char *name);
+	void Collect(int buffer);
+	ProfileStats Stats(vector<float> &history);
+};
+
+#endif
@@ -0,0 +1,41 @@
+// Scene.h - segment queries over a set of meshes
+
+#ifndef SCENE_HDR
+#define SCENE_HDR
+
+#include "Mesh.h"
+
+struct SceneHit {
+	Mesh *mesh = NULL;
+	int index = -1;				// triangle index, or quad index if quad
+	bool quad = false;
+	float alpha = 0;			// point = p1+alpha*(p2-p1)
+	vec3 point;					// world space
+};
+
+class Scene {
+public:
+	void Add(Mesh &m);
+	void Remove(Mesh &m);
+	void Clear();
+	bool IntersectWithSegment(vec3 p1, vec3 p2, SceneHit *hit = NULL);
+		// nearest mesh intersected by world-space segment p1p2, tested in object space
+		// a mesh is intersected as in Mesh::IntersectWithSegment
+		// mesh inverse transforms and world bounds are recomputed only if toWorld or geometry changed
+	int nInverses = 0;			// # inverse transforms computed
+private:
+	struct Entry {
+		Mesh *mesh = NULL;
+		MeshGeometry *geometry = NULL;
+		mat4 toWorld, inverse;
+		vec3 min, max;			// world bounds
+		bool valid = false, empty = true;
+	};
+	vector<Entry> entries;
+	vector<int> bvhEntries;		// entry index per BVH primitive (non-empty meshes)
+	BVH bvh;					// over world bounds
+	bool rebuild = true;
+	void Update();
+};
+
+#endif
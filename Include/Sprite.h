@@ -4,12 +4,27 @@
 #define SPRITE_HDR
 
 #include <glad.h>
+#include <stdint.h>
 #include <time.h>
 #include <vector>
 #include "VecMat.h"
 
 using namespace std;
 
+// Coverage Mask
+
+struct CoverageMask {
+	int width = 0, height = 0, wordsPerRow = 0;
+	vector<uint64_t> words;		// per row; texel (i, j) is bit i%64 of word i/64, unused bits 0
+	bool Get(int i, int j) { return i >= 0 && j >= 0 && i < width && j < height && (words[j*wordsPerRow+i/64] >> (i%64)) & 1; }
+	uint64_t Get64(int i, int j);
+		// texels (i, j) through (i+63, j) as bits 0 through 63; texels outside the mask are 0
+};
+
+void BuildCoverageMasks(unsigned char *pixels, int width, int height, int nChannels, int channel, vector<CoverageMask> &masks);
+	// masks[0]: texel set if channel >= .02 (as the sprite shader discards below), rows as in ReadTexture
+	// masks[k+1]: half resolution, texel set if any of its 2x2 texels in masks[k] set, down to 1 by 1
+
 // Sprite Class
 
 class Sprite {
@@ -23,19 +38,27 @@ public:
 	// for collision:
 	int id = 0;
 	vector<int> collided;
-	// for animation:
-	GLuint frame = 0, nFrames = 0;
-	vector<GLuint> textureNames;
-	float frameDuration = 1.5f;
-	time_t change;
+	vector<CoverageMask> masks;	// from alpha or matte, set by BuildMasks; empty if opaque
+	string maskFile;			// image (alpha) or matte from which masks are built, set by Initialize
+	int maskChannel = 0;
+	bool masksBuilt = false;
+	void BuildMasks();
+		// decode maskFile for masks, once per file and channel (later sprites share the result)
+		// called by pixel-accurate Intersect and FindCollisions, so Initialize need not decode
+	// for animation: frames are layers of a texture array, the shader shows
+	// frame ((time-startTime)/frameDuration)%nFrames, time from SpriteTime()
+	GLuint nFrames = 0, frameArray = 0;
+	float frameDuration = 1.5f, startTime = 0;
 	GLuint textureName = 0, matName = 0;
 	mat4 ptTransform, uvTransform;
-	bool Intersect(Sprite &s);
+	bool Intersect(Sprite &s, bool pixels = false);
+		// do bounds of transformed quads overlap? if pixels, do covered texels (per masks) overlap?
 	void UpdateTransform();
 	void Initialize(GLuint texName, float z = 0);
 	void Initialize(string imageFile, float z = 0);
 	void Initialize(string imageFile, string matFile, float z = 0);
 	void Initialize(vector<string> &imageFiles, string matFile, float z = 0);
+		// animation: frames resampled to size of first, animation starts now
 	bool Hit(double x, double y);
 	void SetPosition(vec2 p);
 	vec2 GetPosition();
@@ -56,8 +79,59 @@ public:
 	~Sprite() { Release(); }
 };
 
+// Sprite Batch
+
+class SpriteBatch {
+public:
+	int layerWidth = 256, layerHeight = 256;
+		// texture array resolution; images are resampled to fit (set before first AddImage)
+	int AddImage(string imageFile, string matFile = "");
+	int AddImage(unsigned char *pixels, int width, int height, int nChannels, unsigned char *matte = NULL);
+		// append image as texture array layer, return layer index (-1 if unreadable)
+		// opacity from 4th channel, else from matte (or red of matFile), else 1
+	int AddFrames(vector<string> &imageFiles, string matFile = "");
+		// append animation frames as consecutive layers, return first layer (-1 if a frame unreadable)
+	int NLayers();
+	void Clear();
+		// remove all instances (layers are kept)
+	void Add(mat4 ptTransform, float z, int layer, mat4 uvTransform = mat4(), int nFrames = 1, float frameDuration = 1, float startTime = 0);
+	void Add(Sprite &s, int layer);
+		// append instance: as for Sprite::Display, quad (+/-1) is transformed by ptTransform at depth z
+		// uvTransform should be affine in u, v
+		// if nFrames > 1, layer is the first of nFrames animation frames, selected by the shader as for Sprite
+	int NInstances();
+	void Display(mat4 *view = NULL, int textureUnit = 0);
+		// draw instances in descending z order (back to front, ties in order added), in one instanced call
+	void Release();
+	~SpriteBatch() { Release(); }
+private:
+	struct Instance {
+		vec4 ptRows[4];				// ptTransform
+		vec4 uvRows[2];				// first two rows of uvTransform
+		float z = 0, layer = 0;
+		float nFrames = 1, frameDuration = 1, startTime = 0;
+	};
+	vector<Instance> instances, sorted;
+	vector<unsigned char> layers;	// rgba, layerWidth by layerHeight, per layer
+	int nLayers = 0, nLayersLoaded = 0;
+	GLuint textureArray = 0, vao = 0, vbo = 0;
+	void LoadLayers();
+};
+
+float SpriteTime();
+	// seconds since first call; time for animation frame selection
+
 void BuildSpriteShader();
 int GetSpriteShader();
 int TestCollisions(vector<Sprite *> &sprites);
+	// GPU: render sprites in descending z into an occupancy buffer, reading back collisions after each sprite
+	// set each sprite's collided[i] to 1 if it covers a pixel last covered by sprite i, else -1; return # overlapped pixels
+
+int FindCollisions(vector<Sprite *> &sprites, int nThreads = 0, bool pixels = true);
+	// CPU, no GL calls: set each sprite's collided[i] to 1 if sprite i precedes it in descending z order
+	// (ties by index) and their transformed quads overlap, else -1; return # colliding pairs
+	// uniform-grid broadphase over quad bounds, separating-axis test of the quads (parallelograms)
+	// pairs are tested on nThreads threads (0: hardware concurrency; one thread if few sprites)
+	// if pixels, overlapping quads must also overlap in covered texels (see Sprite::Intersect)
 
 #endif
@@ -10,22 +10,27 @@
 
 class Character {
 public:
-	GLuint  textureID;  // glyph texture
+	GLuint  textureID;  // atlas texture (shared by character set)
+	vec4    uv;         // glyph rectangle in atlas (u1, v1, u2, v2), including border
 	int2    gSize;      // glyph size
 	int2    bearing;    // offset from baseline to left/top of glyph
 	GLuint  advance;    // offset to next glyph
 	Character() { textureID = advance = 0; }
-	Character(int textureID, int2 gSize, int2 bearing, GLuint advance) :
-		textureID(textureID), gSize(gSize), bearing(bearing), advance(advance) { }
+	Character(int textureID, vec4 uv, int2 gSize, int2 bearing, GLuint advance) :
+		textureID(textureID), uv(uv), gSize(gSize), bearing(bearing), advance(advance) { }
 };
 
 // character set and current pointer
 struct CharacterSet {
 	int charRes;
+	int border;         // pixels of distance field around each glyph
+	GLuint atlas;       // signed-distance-field glyphs, packed; rasterized once per font
 	Character characters[128];
-	CharacterSet() { charRes = 0; }
+	CharacterSet() { charRes = border = 0; atlas = 0; }
 	CharacterSet(const CharacterSet &cs) {
-		charRes = 0;
+		charRes = cs.charRes;
+		border = cs.border;
+		atlas = cs.atlas;
 		for (int i = 0; i < 128; i++)
 			characters[i] = cs.characters[i];
 	}
@@ -51,6 +56,7 @@ int TextWidth(int scale, const char *format, ...);
 
 void RenderText(const char *text, float x, float y, vec3 color, float scale, mat4 view, bool vertical = false);
 	// text with arbitrary orientation
+	// each string is one draw from the font atlas; within BeginDrawBatch/EndDrawBatch, all text is one draw per font
 
 const char *Nice(float f);
 	// minimal display of f
@@ -7,30 +7,74 @@
 #include "Quaternion.h"
 #include "VecMat.h"
 
+class MockVR;
+
 class VROOM {
 public:
 	vr::IVRSystem  *ivr = NULL;
+	MockVR		   *mock = NULL;		// if set, used in place of OpenVR runtime
 	GLuint			depthBuffer = 0, framebufferTextureName = 0;
 	int				width = 0, height = 0;
-	float		   *pixels = NULL;
+	unsigned char  *pixels = NULL;
 	mat4			appTransformStart, *appTransform = NULL;
 	float			translationScale = 1;
 	Quaternion		qStart, qStartConjugate; // *** these now obsolete?
 	vec3			pStart;
 	bool			openVR = false;
 	GLuint			framebuffer = 0;
+	// per-eye render targets, submitted without CPU readback
+	GLuint			eyeFramebuffers[2] = {0, 0}, eyeTextures[2] = {0, 0}, eyeDepthBuffers[2] = {0, 0};
+	GLenum			eyeFormat = GL_RGBA8;	// or GL_SRGB8_ALPHA8 (with GL_FRAMEBUFFER_SRGB enabled)
+	// single-pass stereo target: left eye in left half, right eye in right half
+	GLuint			stereoFramebuffer = 0, stereoTexture = 0, stereoDepthBuffer = 0;
+	// multisampled render target shared by both eyes, resolved into eyeTextures or stereoTexture
+	int				eyeSamples = 1;
+	GLuint			msFramebuffer = 0, msColorBuffer = 0, msDepthBuffer = 0;
 	bool			HmdPresent();
 	int				RecommendedWidth();
 	int				RecommendedHeight();
 	bool InitFrameBuffer(int width, int height);
 		// build frame buffer for eye rendering
 	void CopyFramebufferToEyeTexture(GLuint textureName, GLuint textureUnit);
-		// after rendering, copy frame buffer pixels to texture image
+		// after rendering, copy frame buffer pixels to texture image (via CPU; pixels allocated on first call)
+	bool InitEyeFramebuffers(int width, int height);
+		// build a texture-backed frame buffer for each eye; no pixel buffer needed
+	bool SetEyeSamples(int nSamples);
+		// 1 (off), 2, 4, or 8 samples per pixel for color and depth; may be called any time after InitEyeFramebuffers
+	void BindEyeFramebuffer(int eye);
+		// render eye (0: left, 1: right) into eyeTextures[eye], or into multisample buffer
+	void ResolveEyeFramebuffer(int eye);
+		// after rendering eye, if multisampled, blit (resolve) to eyeTextures[eye]
+	void SubmitEyeTextures();
+		// submit eyeTextures to compositor
+	bool InitStereoFramebuffer();
+		// build 2*width by height target (after InitEyeFramebuffers) for rendering both eyes at once
+	void BindStereoFramebuffer();
+		// bind stereo (or multisample) target, set viewport to both halves; see SetStereo in Draw.h
+	void ResolveStereoFramebuffer();
+		// after rendering, if multisampled, resolve to stereoTexture
+	void SubmitStereoTexture();
+		// submit left and right halves of stereoTexture to compositor
 	void SubmitOpenGLFrames(GLuint leftTextureUnit, GLuint rightTextureUnit);
 		// provide left/right eye texture identifiers for new frame
+	// tracked devices, refreshed only when devices (de)activate or change role
+	int				hmdIndex = -1, leftHandIndex = -1, rightHandIndex = -1;
+	float			frameDuration = 1/90.f, vsyncToPhotons = 0;
 	bool InitOpenVR();
 		// required before any access to OpenVR
+	bool InitMockVR(MockVR *m);
+		// use mock runtime (see MockVR.h), eg, to test frame loop without headset; mock not deleted
+	void UpdateDeviceIndices();
+		// find HMD, left and right controllers by role (by order if roles unassigned)
+	void PollEvents();
+		// process pending OpenVR events; update device indices if needed
 	bool GetTransforms(mat4 &head, mat4 &leftHand, mat4 &rightHand);
+		// wait for compositor (start of frame), then set transforms from render poses
+	float SecondsToPhotons();
+		// time from now until present frame is displayed
+	bool GetPredictedTransforms(float secondsFromNow, mat4 &head, mat4 &leftHand, mat4 &rightHand);
+		// poses predicted secondsFromNow, without waiting for compositor (eg, late update for aiming)
+		// transforms for untracked devices are unchanged
 	std::string GetTrackedDeviceType(int type);
 	~VROOM() {
 		if (ivr) { vr::VR_Shutdown(); ivr = NULL; }
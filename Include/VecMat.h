@@ -4,6 +4,7 @@
 #ifndef VEC_MAT_HDR
 #define VEC_MAT_HDR
 
+#include <float.h>
 #include <math.h>
 #include <iostream>
 
@@ -0,0 +1,317 @@
+// Capture.cpp - asynchronous screenshots and frame recording
+
+#include <ctype.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Capture.h"
+#include "PixelFormat.h"
+#include "STB_Image_Write.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// the GL thread issues readbacks into the ring and maps them, oldest first, once fenced work is
+// complete; mapped pixels are copied into a job for the worker, which alone touches image files
+
+struct Readback {
+	GLuint pbo = 0;
+	GLsizeiptr capacity = 0;
+	GLsync fence = NULL;						// set while in flight
+	int width = 0, height = 0;
+	CaptureFormat format = CapturePng;
+	string filename;
+	std::shared_ptr<FILE> raw;					// raw output, closed after its last frame is written
+};
+
+struct EncodeJob {
+	vector<unsigned char> rgba;					// bottom row first, as read
+	int width = 0, height = 0;
+	CaptureFormat format = CapturePng;
+	string filename;
+	std::shared_ptr<FILE> raw;
+};
+
+vector<Readback> ring;
+int nRing = 3, head = 0, nInFlight = 0, maxQueued = 8, nDropped = 0;
+
+struct Recording {
+	bool on = false;
+	string name;
+	CaptureFormat format = CaptureRaw;
+	GLuint framebuffer = 0;
+	int width = 0, height = 0, frame = 0;
+	std::shared_ptr<FILE> raw;
+} recording;
+
+std::deque<EncodeJob *> jobs;
+std::mutex jobsMutex;
+std::condition_variable jobsReady, jobsDone;
+std::thread worker;
+int nEncoding = 0;								// queued or being encoded
+bool stopping = false;
+
+// Worker
+
+void Encode(EncodeJob *job) {
+	int w = job->width, h = job->height;
+	vector<unsigned char> rgb(3*w*h);
+	RgbaToRgb(job->rgba.data(), rgb.data(), w*h);
+	FlipVertical(rgb.data(), w, h, 3);
+	const char *f = job->filename.c_str();
+	bool ok = false;
+	switch (job->format) {
+		case CapturePng: ok = stbi_write_png(f, w, h, 3, rgb.data(), 3*w) != 0; break;
+		case CaptureTga: ok = stbi_write_tga(f, w, h, 3, rgb.data()) != 0; break;
+		case CaptureBmp: ok = stbi_write_bmp(f, w, h, 3, rgb.data()) != 0; break;
+		case CaptureRaw: ok = fwrite(rgb.data(), rgb.size(), 1, job->raw.get()) == 1; break;
+	}
+	if (!ok)
+		printf("Capture: can't write %s\n", f);
+}
+
+void Work() {
+	for (;;) {
+		EncodeJob *job = NULL;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsReady.wait(lock, []{ return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		Encode(job);
+		delete job;
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			nEncoding--;
+		}
+		jobsDone.notify_all();
+	}
+}
+
+void Queue(EncodeJob *job) {
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobs.push_back(job);
+		nEncoding++;
+	}
+	if (!worker.joinable())
+		worker = std::thread(Work);
+	jobsReady.notify_one();
+}
+
+int NEncoding() {
+	std::lock_guard<std::mutex> lock(jobsMutex);
+	return nEncoding;
+}
+
+// Readback
+
+bool Issue(GLuint framebuffer, int width, int height, CaptureFormat format, const string &filename, std::shared_ptr<FILE> raw) {
+	if (ring.empty()) {
+		ring.resize(nRing);
+		for (Readback &r : ring)
+			glGenBuffers(1, &r.pbo);
+	}
+	if (nInFlight == (int) ring.size())
+		return false;
+	Readback &r = ring[(head+nInFlight)%ring.size()];
+	GLsizeiptr size = (GLsizeiptr) 4*width*height;
+	GLint readWas = 0, packWas = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readWas);
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packWas);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	if (size > r.capacity) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		r.capacity = size;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	// rgba rows are 4-byte aligned; read into buffer object returns without waiting
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readWas);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, packWas);
+	r.width = width;
+	r.height = height;
+	r.format = format;
+	r.filename = filename;
+	r.raw = raw;
+	nInFlight++;
+	return true;
+}
+
+void Collect(bool wait) {
+	// map readbacks in issue order, stopping at the first incomplete (unless wait)
+	GLint packWas = 0;
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packWas);
+	while (nInFlight) {
+		Readback &r = ring[head];
+		if (glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait? 1000000000 : 0) == GL_TIMEOUT_EXPIRED) {
+			if (wait)
+				continue;
+			break;
+		}
+		glDeleteSync(r.fence);
+		r.fence = NULL;
+		GLsizeiptr size = (GLsizeiptr) 4*r.width*r.height;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+		if (unsigned char *p = (unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT)) {
+			EncodeJob *job = new EncodeJob();
+			job->rgba.assign(p, p+size);
+			job->width = r.width;
+			job->height = r.height;
+			job->format = r.format;
+			job->filename = r.filename;
+			job->raw = r.raw;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			Queue(job);
+		}
+		else
+			printf("Capture: can't map readback for %s\n", r.filename.c_str());
+		r.raw.reset();
+		head = (head+1)%ring.size();
+		nInFlight--;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, packWas);
+}
+
+// Support
+
+void DefaultSize(int &width, int &height) {
+	if (width <= 0 || height <= 0) {
+		GLint vp[4];
+		glGetIntegerv(GL_VIEWPORT, vp);
+		width = vp[2];
+		height = vp[3];
+	}
+}
+
+CaptureFormat FormatOf(const char *filename) {
+	const char *ext = strrchr(filename, '.'), *names[] = { ".tga", ".bmp", ".raw" };
+	CaptureFormat formats[] = { CaptureTga, CaptureBmp, CaptureRaw };
+	for (int i = 0; ext && i < 3; i++) {
+		int k = 0;
+		while (names[i][k] && tolower(ext[k]) == names[i][k])
+			k++;
+		if (!names[i][k] && !ext[k])
+			return formats[i];
+	}
+	return CapturePng;
+}
+
+std::shared_ptr<FILE> OpenRaw(const char *filename) {
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		printf("Capture: can't open %s\n", filename);
+		return std::shared_ptr<FILE>();
+	}
+	return std::shared_ptr<FILE>(f, fclose);
+}
+
+} // end namespace
+
+// Screenshot
+
+bool Screenshot(const char *filename, GLuint framebuffer, int width, int height) {
+	DefaultSize(width, height);
+	CaptureFormat format = FormatOf(filename);
+	std::shared_ptr<FILE> raw;
+	if (format == CaptureRaw && !(raw = OpenRaw(filename)))
+		return false;
+	Collect(false);
+	if (!Issue(framebuffer, width, height, format, filename, raw)) {
+		printf("Screenshot: no free readback buffer for %s\n", filename);
+		return false;
+	}
+	return true;
+}
+
+// Recording
+
+bool StartRecording(const char *name, CaptureFormat format, GLuint framebuffer, int width, int height) {
+	StopRecording();
+	DefaultSize(width, height);
+	std::shared_ptr<FILE> raw;
+	if (format == CaptureRaw && !(raw = OpenRaw(name)))
+		return false;
+	recording.on = true;
+	recording.name = name;
+	recording.format = format;
+	recording.framebuffer = framebuffer;
+	recording.width = width;
+	recording.height = height;
+	recording.frame = 0;
+	recording.raw = raw;
+	nDropped = 0;
+	return true;
+}
+
+void StopRecording() {
+	if (recording.on)
+		printf("%s: %i frames (%ix%i), %i dropped\n", recording.name.c_str(), recording.frame, recording.width, recording.height, nDropped);
+	recording.on = false;
+	recording.raw.reset();
+}
+
+bool Recording() { return recording.on; }
+
+int NDroppedFrames() { return nDropped; }
+
+// Per Frame
+
+void CaptureFrame() {
+	Collect(false);
+	if (!recording.on)
+		return;
+	string filename = recording.name;
+	if (recording.format != CaptureRaw) {
+		char buf[1000];
+		snprintf(buf, sizeof(buf), recording.name.c_str(), recording.frame);
+		filename = buf;
+	}
+	if (NEncoding() < maxQueued && Issue(recording.framebuffer, recording.width, recording.height, recording.format, filename, recording.raw))
+		recording.frame++;
+	else
+		nDropped++;
+}
+
+void FinishCaptures() {
+	Collect(true);
+	std::unique_lock<std::mutex> lock(jobsMutex);
+	jobsDone.wait(lock, []{ return nEncoding == 0; });
+}
+
+// Cleanup
+
+void SetCaptureBuffers(int nBuffers, int maxQ) {
+	if (ring.empty())
+		nRing = nBuffers > 1? nBuffers : 1;
+	maxQueued = maxQ > 1? maxQ : 1;
+}
+
+void StopCapture() {
+	StopRecording();
+	FinishCaptures();
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+	}
+	jobsReady.notify_all();
+	if (worker.joinable())
+		worker.join();
+	stopping = false;
+	for (Readback &r : ring)
+		glDeleteBuffers(1, &r.pbo);
+	ring.clear();
+	head = nInFlight = 0;
+}
@@ -1,9 +1,10 @@
 // Draw.cpp - various draw operations (c) 2019-2022 Jules Bloomenthal
 
 #include <glad.h>
-#include <gl/glu.h>
+#include <GL/glu.h>
 #include "Draw.h"
 #include "GLXtras.h"
+#include <algorithm>
 #include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -161,13 +162,42 @@ bool FrontFacing(vec3 base, vec3 vec, mat4 view) {
 // double ScreenZ(vec3 p, mat4 m) { return (m*vec4(p, 1)).z; }
 // bool FrontFacing(vec3 base, vec3 vec, mat4 view) { return ScreenZ(base, view) >= ScreenZ(base+vec, view); }
 
+// Single-pass Stereo
+
+namespace {
+
+bool stereo = false;
+mat4 stereoMatrices[2];
+
+} // end namespace
+
+void SetStereo(bool on, mat4 left, mat4 right) {
+	FlushDrawBatch();
+	stereo = on;
+	stereoMatrices[0] = left;
+	stereoMatrices[1] = right;
+	if (on) glEnable(GL_CLIP_DISTANCE0);
+	else glDisable(GL_CLIP_DISTANCE0);
+}
+
+bool Stereo() { return stereo; }
+
+mat4 StereoMatrix(int eye) { return stereoMatrices[eye]; }
+
+int StereoInstances() { return stereo? 2 : 1; }
+
+mat4 StereoClipMatrix(mat4 persp, mat4 modelview, mat4 eyeModelview) {
+	return persp*eyeModelview*Invert(modelview)*Invert(persp);
+}
+
 // Draw Shader
 
 int drawShader = 0;
-mat4 drawView;
+mat4 drawView, triView;
 
 const char *drawVShader = R"(
 	#version 410 core // 130
+)" STEREO_VERTEX_CODE R"(
 	in vec3 position;
 	in vec3 color;
 	out vec3 vColor;
@@ -176,7 +206,7 @@ const char *drawVShader = R"(
 	void main() {
 		vec2 uvs[] = vec2[4](vec2(0,0), vec2(0,1), vec2(1,1), vec2(1,0));
 		vUv = uvs[gl_VertexID];
-		gl_Position = view*vec4(position, 1);
+		gl_Position = StereoPosition(view*vec4(position, 1));
 		vColor = color;
 	}
 )";
@@ -192,15 +222,15 @@ const char *drawPShader = R"(
 	uniform bool useTexture = false;
 	uniform sampler2D textureImage;
 	float Fade(float t) {
-		if (t < .95) return 1;
-		if (t > 1.05) return 0;
+		if (t < .95) return 1.;
+		if (t > 1.05) return 0.;
 		float a = (t-.95)/(1.05-.95);
 		return 1-smoothstep(0, 1, a);
 			// does smoothstep help?
 	}
 	float Ring(float t) {
-		if (t < .7) return 0;
-		if (t > .9) return 1;
+		if (t < .7) return 0.;
+		if (t > .9) return 1.;
 		float a = (t-.7)/(.9-.7);
 		return smoothstep(0, 1, a);
 	}
@@ -222,13 +252,26 @@ const char *drawPShader = R"(
 	}
 )";
 
+Uniform<bool> drawStereo;
+Uniform<mat4> drawStereoMatrices[2];
+
 int UseDrawShader() {
 	int was = 0;
 	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
 	bool init = !drawShader;
-	if (init) drawShader = LinkProgramViaCode(&drawVShader, &drawPShader);
+	if (init) {
+		drawShader = LinkProgramViaCode(&drawVShader, &drawPShader);
+		drawStereo = Uniform<bool>(drawShader, "stereo");
+		drawStereoMatrices[0] = Uniform<mat4>(drawShader, "stereoMatrices[0]");
+		drawStereoMatrices[1] = Uniform<mat4>(drawShader, "stereoMatrices[1]");
+	}
 	glUseProgram(drawShader);
 	if (init) SetUniform(drawShader, "view", mat4());
+	drawStereo.Set(stereo);
+	if (stereo) {
+		drawStereoMatrices[0].Set(stereoMatrices[0]);
+		drawStereoMatrices[1].Set(stereoMatrices[1]);
+	}
 	return was;
 }
 
@@ -239,6 +282,241 @@ int UseDrawShader(mat4 viewMatrix) {
 	return was;
 }
 
+// Batched Drawing
+
+namespace {
+
+struct BatchVertex {
+	vec4	position;				// clip space
+	vec4	color;					// rgb, opacity
+	float	size = 1;				// point diameter, in pixels
+	float	shape = 0;				// 0 plain, 1 disk, 2 ring (points); 3+coverage (atlas triangles)
+	vec2	uv;						// atlas coordinates
+	BatchVertex() { }
+	BatchVertex(vec4 p, vec3 c, float o, float size = 1, float shape = 0) : position(p), color(c, o), size(size), shape(shape) { }
+};
+
+struct BatchGroup {
+	GLenum	mode = GL_POINTS;		// GL_POINTS, GL_LINES, or GL_TRIANGLES
+	float	lineWidth = 1;
+	GLuint	atlas = 0;				// texture for atlas triangles
+	std::vector<BatchVertex> vertices;
+};
+
+const int batchRegionSize = 1 << 16;	// vertices per region of the triple-buffered stream
+const int batchTextureUnit = 2;			// atlas texture unit (as for Letters)
+
+bool batching = false;
+std::vector<BatchGroup> batchGroups;	// pending, in order of first use
+int nBatchVertices = 0;
+GLuint batchShader = 0, batchVAO = 0, batchVBO = 0;
+BatchVertex *batchMapped = NULL;		// persistently mapped stream, or NULL if glBufferStorage unavailable
+GLsync batchFences[3] = { NULL, NULL, NULL };
+int batchRegion = 0, batchOffset = 0;	// current region, first free vertex in region
+Uniform<bool> batchStereo;
+Uniform<mat4> batchStereoMatrices[2];
+Uniform<int> batchAtlas;
+
+const char *batchVShader = R"(
+	#version 410 core
+)" STEREO_VERTEX_CODE R"(
+	in vec4 position;
+	in vec4 color;
+	in float size;
+	in float shape;
+	in vec2 uv;
+	out vec4 vColor;
+	out vec2 vUv;
+	flat out float vShape;
+	void main() {
+		gl_Position = StereoPosition(position);
+		gl_PointSize = size;
+		vColor = color;
+		vUv = uv;
+		vShape = shape;
+	}
+)";
+
+const char *batchPShader = R"(
+	#version 410 core
+	in vec4 vColor;
+	in vec2 vUv;
+	flat in float vShape;
+	out vec4 pColor;
+	uniform sampler2D atlas;
+	float Fade(float t) {
+		if (t < .95) return 1.;
+		if (t > 1.05) return 0.;
+		return 1-smoothstep(0, 1, (t-.95)/(1.05-.95));
+	}
+	float Ring(float t) {
+		if (t < .7) return 0.;
+		if (t > .9) return 1.;
+		return smoothstep(0, 1, (t-.7)/(.9-.7));
+	}
+	void main() {
+		float o = vColor.a;
+		float r = texture(atlas, vUv).r, w = .7*fwidth(r);
+		if (vShape > 4.5)
+			// signed distance, .5 at glyph edge: antialias over about a pixel at any scale
+			o *= smoothstep(.5-w, .5+w, r);
+		else if (vShape > 3.5)
+			o *= 1-r;
+		else if (vShape > 2.5)
+			o *= r;
+		else if (vShape > .5) {
+			// round point from gl_PointCoord
+			vec2 d = 1-2*gl_PointCoord;
+			float t = length(d);
+			o *= vShape > 1.5? Fade(t)*Ring(t) : Fade(t);
+		}
+		pColor = vec4(vColor.rgb, o);
+	}
+)";
+
+void InitBatch() {
+	batchShader = LinkProgramViaCode(&batchVShader, &batchPShader);
+	batchStereo = Uniform<bool>(batchShader, "stereo");
+	batchStereoMatrices[0] = Uniform<mat4>(batchShader, "stereoMatrices[0]");
+	batchStereoMatrices[1] = Uniform<mat4>(batchShader, "stereoMatrices[1]");
+	batchAtlas = Uniform<int>(batchShader, "atlas");
+	glGenVertexArrays(1, &batchVAO);
+	glGenBuffers(1, &batchVBO);
+	glBindVertexArray(batchVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, batchVBO);
+	GLsizeiptr nBytes = 3*batchRegionSize*sizeof(BatchVertex);
+	if (glBufferStorage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, nBytes, NULL, flags);
+		batchMapped = (BatchVertex *) glMapBufferRange(GL_ARRAY_BUFFER, 0, nBytes, flags);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, nBytes, NULL, GL_STREAM_DRAW);
+	int stride = sizeof(BatchVertex);
+	VertexAttribPointer(batchShader, "position", 4, stride, (void *) 0);
+	VertexAttribPointer(batchShader, "color", 4, stride, (void *) sizeof(vec4));
+	VertexAttribPointer(batchShader, "size", 1, stride, (void *) (2*sizeof(vec4)));
+	VertexAttribPointer(batchShader, "shape", 1, stride, (void *) (2*sizeof(vec4)+sizeof(float)));
+	VertexAttribPointer(batchShader, "uv", 2, stride, (void *) (2*sizeof(vec4)+2*sizeof(float)));
+	glBindVertexArray(0);
+}
+
+void BatchAppend(GLenum mode, float lineWidth, BatchVertex *v, int n, GLuint atlas = 0) {
+	if (nBatchVertices+n > batchRegionSize)
+		FlushDrawBatch();
+	BatchGroup *g = NULL;
+	for (BatchGroup &b : batchGroups)
+		if (b.mode == mode && b.atlas == atlas && (mode != GL_LINES || b.lineWidth == lineWidth))
+			g = &b;
+	if (!g) {
+		batchGroups.resize(batchGroups.size()+1);
+		g = &batchGroups.back();
+		g->mode = mode;
+		g->lineWidth = lineWidth;
+		g->atlas = atlas;
+	}
+	g->vertices.insert(g->vertices.end(), v, v+n);
+	nBatchVertices += n;
+}
+
+vec4 BatchPoint(vec3 p) { return drawView*vec4(p, 1); }
+
+} // end namespace
+
+void BeginDrawBatch() {
+	batching = true;
+}
+
+void EndDrawBatch() {
+	FlushDrawBatch();
+	batching = false;
+}
+
+bool DrawBatching() { return batching; }
+
+void AtlasQuads(GLuint atlas, int coverage, int nQuads, vec4 *corners, vec3 color, mat4 view, float opacity) {
+	for (int i = 0; i < nQuads; i++) {
+		BatchVertex q[4];
+		for (int k = 0; k < 4; k++) {
+			vec4 &c = corners[4*i+k];
+			q[k] = BatchVertex(view*vec4(c.x, c.y, 0, 1), color, opacity, 1, (float) (3+coverage));
+			q[k].uv = vec2(c.z, c.w);
+		}
+		BatchVertex v[] = { q[0], q[1], q[2], q[0], q[2], q[3] };
+		BatchAppend(GL_TRIANGLES, 1, v, 6, atlas);
+	}
+	if (!batching)
+		FlushDrawBatch();
+}
+
+void FlushDrawBatch() {
+	if (!nBatchVertices)
+		return;
+	int was = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
+	if (!batchShader)
+		InitBatch();
+	if (batchOffset+nBatchVertices > batchRegionSize) {
+		// fence current region, move to next once GPU has finished reading it (normally long since)
+		if (batchMapped)
+			batchFences[batchRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		batchRegion = (batchRegion+1)%3;
+		batchOffset = 0;
+		if (GLsync &f = batchFences[batchRegion]) {
+			glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			glDeleteSync(f);
+			f = NULL;
+		}
+	}
+	// copy groups into stream
+	glBindVertexArray(batchVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, batchVBO);
+	int first = batchRegion*batchRegionSize+batchOffset, start = first;
+	for (BatchGroup &g : batchGroups) {
+		int n = (int) g.vertices.size();
+		if (batchMapped)
+			std::copy(g.vertices.begin(), g.vertices.end(), batchMapped+start);
+		else
+			glBufferSubData(GL_ARRAY_BUFFER, start*sizeof(BatchVertex), n*sizeof(BatchVertex), g.vertices.data());
+		start += n;
+	}
+	// one draw per group
+	glUseProgram(batchShader);
+	batchStereo.Set(stereo);
+	batchAtlas.Set(batchTextureUnit);
+	if (stereo) {
+		batchStereoMatrices[0].Set(stereoMatrices[0]);
+		batchStereoMatrices[1].Set(stereoMatrices[1]);
+	}
+	start = first;
+	for (BatchGroup &g : batchGroups) {
+		int n = (int) g.vertices.size();
+		if (g.mode == GL_POINTS) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glEnable(GL_PROGRAM_POINT_SIZE);
+			glEnable(0x8861); // GL_POINT_SPRITE, for gl_PointCoord in compatibility profile
+		}
+		if (g.mode == GL_LINES)
+			glLineWidth(g.lineWidth);
+		if (g.atlas) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glActiveTexture(GL_TEXTURE0+batchTextureUnit);
+			glBindTexture(GL_TEXTURE_2D, g.atlas);
+		}
+		glDrawArraysInstanced(g.mode, start, n, StereoInstances());
+		if (g.mode == GL_POINTS)
+			glDisable(GL_PROGRAM_POINT_SIZE);
+		start += n;
+	}
+	batchOffset += nBatchVertices;
+	nBatchVertices = 0;
+	batchGroups.resize(0);
+	glBindVertexArray(0);
+	glUseProgram(was);
+}
+
 // Disks
 
 GLuint diskVBO = 0, diskVAO = 0;
@@ -249,6 +527,11 @@ void Disk(vec2 p, float diameter, vec3 color, float opacity, bool ring) {
 
 void Disk(vec3 p, float diameter, vec3 color, float opacity, bool ring) {
 	// diameter should be >= 0, <= 20
+	if (batching) {
+		BatchVertex v(BatchPoint(p), color, opacity, diameter, ring? 2.f : 1.f);
+		BatchAppend(GL_POINTS, 1, &v, 1);
+		return;
+	}
 	UseDrawShader();
 	// create buffer for single vertex (x,y,z,r,g,b)
 	if (!diskVBO) {
@@ -282,7 +565,7 @@ void Disk(vec3 p, float diameter, vec3 color, float opacity, bool ring) {
 	glEnable(0x8861); // same as GL_POINT_SMOOTH [this is a 4.5 core bug]
 	SetUniform(drawShader, "fadeToCenter", true); // needed if GL_POINT_SMOOTH and GL_POINT_SPRITE fail
 #endif
-	glDrawArrays(GL_POINTS, 0, 1);
+	glDrawArraysInstanced(GL_POINTS, 0, 1, StereoInstances());
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -291,6 +574,11 @@ void Disk(vec3 p, float diameter, vec3 color, float opacity, bool ring) {
 GLuint lineVBO = 0, lineVAO = 0;
 
 void Line(vec3 p1, vec3 p2, float width, vec3 col1, vec3 col2, float opacity) {
+	if (batching) {
+		BatchVertex v[] = { BatchVertex(BatchPoint(p1), col1, opacity), BatchVertex(BatchPoint(p2), col2, opacity) };
+		BatchAppend(GL_LINES, width, v, 2);
+		return;
+	}
 	UseDrawShader();
 	// create a vertex buffer for the array
 	vec3 data[] = {p1, p2, col1, col2};
@@ -312,7 +600,7 @@ void Line(vec3 p1, vec3 p2, float width, vec3 col1, vec3 col2, float opacity) {
 	SetUniform(drawShader, "opacity", opacity);
 	// draw
 	glLineWidth(width);
-	glDrawArrays(GL_LINES, 0, 2);
+	glDrawArraysInstanced(GL_LINES, 0, 2, StereoInstances());
 	// cleanup
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -359,6 +647,11 @@ void LineDot(vec3 p1, vec3 p2, mat4 view, float width, vec3 col, float opacity,
 GLuint lineStripVBO = 0, lineStripVAO = 0;
 
 void LineStrip(int nPoints, vec3 *points, vec3 &color, float opacity, float width) {
+	if (batching) {
+		for (int i = 1; i < nPoints; i++)
+			Line(points[i-1], points[i], width, color, color, opacity);
+		return;
+	}
 	int pSize = nPoints*sizeof(vec3);
 	if (!lineStripVBO) {
 		glGenVertexArrays(1, &lineStripVAO);
@@ -377,7 +670,7 @@ void LineStrip(int nPoints, vec3 *points, vec3 &color, float opacity, float widt
 	SetUniform(drawShader, "fadeToCenter", false);
 	SetUniform(drawShader, "opacity", opacity);
 	glLineWidth(width);
-	glDrawArrays(GL_LINE_STRIP, 0, nPoints);
+	glDrawArraysInstanced(GL_LINE_STRIP, 0, nPoints, StereoInstances());
 }
 
 // Quads
@@ -389,6 +682,21 @@ void QuadInner(vec3 p1, vec3 p2, vec3 p3, vec3 p4, bool solid, vec3 col, float o
 	Triangle(p1, p2, p3, col, col, col, opacity, !solid, col, lineWidth);
 	Triangle(p1, p3, p4, col, col, col, opacity, !solid, col, lineWidth);
 #else
+	if (batching && !texture) {
+		vec4 q[] = { BatchPoint(p1), BatchPoint(p2), BatchPoint(p3), BatchPoint(p4) };
+		if (solid) {
+			BatchVertex v[] = { BatchVertex(q[0], col, opacity), BatchVertex(q[1], col, opacity), BatchVertex(q[2], col, opacity),
+								BatchVertex(q[0], col, opacity), BatchVertex(q[2], col, opacity), BatchVertex(q[3], col, opacity) };
+			BatchAppend(GL_TRIANGLES, 1, v, 6);
+		}
+		else
+			for (int i = 0; i < 4; i++) {
+				BatchVertex v[] = { BatchVertex(q[i], col, opacity), BatchVertex(q[(i+1)%4], col, opacity) };
+				BatchAppend(GL_LINES, lineWidth, v, 2);
+			}
+		return;
+	}
+	FlushDrawBatch();
 	vec3 data[] = { p1, p2, p3, p4, col, col, col, col };
 	UseDrawShader();
 	if (quadVBO == 0) {
@@ -413,7 +721,7 @@ void QuadInner(vec3 p1, vec3 p2, vec3 p3, vec3 p4, bool solid, vec3 col, float o
 		SetUniform(drawShader, "textureImage", textureUnit);
 	}
 	glLineWidth(lineWidth);
-	glDrawArrays(solid? GL_QUADS : GL_LINE_LOOP, 0, 4);
+	glDrawArraysInstanced(solid? GL_QUADS : GL_LINE_LOOP, 0, 4, StereoInstances());
 	SetUniform(drawShader, "useTexture", false);
 #endif
 }
@@ -562,6 +870,7 @@ void Cylinder(vec3 p1, vec3 p2, float r1, float r2, mat4 modelview, mat4 persp,
 			pColor = intensity*color;
 		}
 	)";
+	FlushDrawBatch();
 	if (!cylinderShader)
 		cylinderShader = LinkProgramViaCode(&vShader, &tcShader, &teShader, NULL, &pShader);
 	//	cylinderShader = LinkProgramViaCode(&vShader, NULL, &teShader, NULL, &pShader);
@@ -671,10 +980,18 @@ const char *triPShaderCode = R"(
 void UseTriangleShader(mat4 view) {
 	UseTriangleShader();
 	SetUniform(triShader, "view", view);
+	triView = view;
 }
 
 void Triangle(vec3 p1, vec3 p2, vec3 p3, vec3 c1, vec3 c2, vec3 c3,
 			  float opacity, bool outline, vec4 outlineCol, float outlineWidth, float transition) {
+	if (batching && !outline) {
+		BatchVertex v[] = { BatchVertex(triView*vec4(p1, 1), c1, opacity), BatchVertex(triView*vec4(p2, 1), c2, opacity),
+							BatchVertex(triView*vec4(p3, 1), c3, opacity) };
+		BatchAppend(GL_TRIANGLES, 1, v, 3);
+		return;
+	}
+	FlushDrawBatch();
 	vec3 data[] = { p1, p2, p3, c1, c2, c3 };
 	UseTriangleShader();
 	if (triVBO == 0) {
@@ -1,11 +1,13 @@
 // GLXtras.cpp - GLSL support (c) 2019-2022 Jules Bloomenthal
 
 #include <glad.h>
-#include <gl/glu.h>
+#include <GL/glu.h>
 #include "GLXtras.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace {
@@ -20,6 +22,11 @@ MouseWheelCallback mwcb = NULL;
 ResizeCallback rcb = NULL;
 KeyboardCallback kcb = NULL;
 
+// uniform locations per program, name->location (-1 cached for unknown names)
+std::unordered_map<int, std::unordered_map<std::string, GLint>> programUniforms;
+int uniformEpoch = 0;			// incremented when any program is reflected or deleted
+int nLookupsAvoided = 0;
+
 double InvertY(GLFWwindow *w, double y) {
 	// given y wrt upper left, return wrt lower left
 	int h;
@@ -286,6 +293,7 @@ void LinkProgramViaCode(GLuint computeProgram, const char **computeCode) {
 	GLint status;
 	glGetProgramiv(computeProgram, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) PrintProgramLog(computeProgram);
+	ReflectUniforms(computeProgram);
 }
 
 GLuint LinkProgramViaCode(const char **computeCode) {
@@ -304,6 +312,7 @@ GLuint LinkProgramViaFile(const char *computeShaderFile) {
 	GLint status;
 	glGetProgramiv(program, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) PrintProgramLog(program);
+	ReflectUniforms(program);
 	return program;
 }
 
@@ -328,6 +337,7 @@ GLuint LinkProgram(GLuint vshader, GLuint tcshader, GLuint teshader, GLuint gsha
 		GLint status;
 		glGetProgramiv(program, GL_LINK_STATUS, &status);
 		if (status == GL_FALSE) PrintProgramLog(program);
+		ReflectUniforms(program);
 	}
 	return program;
 }
@@ -354,6 +364,8 @@ void DeleteProgram(int program) {
 	for (int i = 0; i < nShaders; i++)
 		glDeleteShader(shaderNames[i]);
 	glDeleteProgram(program);
+	programUniforms.erase(program);
+	uniformEpoch++;
 }
 
 // Binary Read/Write **** NOT SUPPORTED BY OPENGL3.x
@@ -386,6 +398,7 @@ bool ReadProgramBinary(GLuint program, const char *filename) {
 		fread((char *) &data[0], 1, sizeBinary, in);
 		fclose(in);
 		glProgramBinary(program, binaryFormat, &data[0], sizeBinary);
+		ReflectUniforms(program);
 		return true;
 	}
 	return false;
@@ -414,8 +427,78 @@ bool Bad(const char *name) {
 	return false;
 }
 
-bool SetUniform(int program, const char *name, bool val) {
+// Uniform Cache
+
+void ReflectUniforms(int program) {
+	std::unordered_map<std::string, GLint> &u = programUniforms[program];
+	u.clear();
+	uniformEpoch++;
+	GLenum type;
+	GLchar name[201];
+	GLint nUniforms = 0, length, size;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &nUniforms);
+	for (int i = 0; i < nUniforms; i++) {
+		glGetActiveUniform(program, i, 200, &length, &size, &type, name);
+		GLint id = glGetUniformLocation(program, name);
+		if (id < 0)
+			continue; // in a uniform block
+		u[name] = id;
+		// arrays are reported as name[0]; also accept the bare name
+		if (length > 3 && !strcmp(name+length-3, "[0]"))
+			u[std::string(name, length-3)] = id;
+	}
+}
+
+GLint UniformLocation(int program, const char *name) {
+	auto p = programUniforms.find(program);
+	if (p == programUniforms.end()) {
+		// linked other than by LinkProgram
+		ReflectUniforms(program);
+		p = programUniforms.find(program);
+	}
+	std::unordered_map<std::string, GLint> &u = p->second;
+	auto i = u.find(name);
+	if (i != u.end()) {
+		nLookupsAvoided++;
+		return i->second;
+	}
+	// not active (eg, optimized away) or array element other than [0]
 	GLint id = glGetUniformLocation(program, name);
+	u[name] = id;
+	return id;
+}
+
+GLint ResolveUniform(int program, const char *name, GLint &id, int &epoch) {
+	if (epoch == uniformEpoch) {
+		nLookupsAvoided++;
+		return id;
+	}
+	id = name && program > 0? UniformLocation(program, name) : -1;
+	epoch = uniformEpoch;
+	return id;
+}
+
+int UniformLookupsAvoided(bool reset) {
+	int n = nLookupsAvoided;
+	if (reset)
+		nLookupsAvoided = 0;
+	return n;
+}
+
+// Uniform Access by Location
+
+bool SetUniform(GLint id, bool val) { if (id < 0) return false; glUniform1ui(id, val? 1 : 0); return true; }
+bool SetUniform(GLint id, int val) { if (id < 0) return false; glUniform1i(id, val); return true; }
+bool SetUniform(GLint id, float val) { if (id < 0) return false; glUniform1f(id, val); return true; }
+bool SetUniform(GLint id, vec2 v) { if (id < 0) return false; glUniform2f(id, v.x, v.y); return true; }
+bool SetUniform(GLint id, vec3 v) { if (id < 0) return false; glUniform3f(id, v.x, v.y, v.z); return true; }
+bool SetUniform(GLint id, vec4 v) { if (id < 0) return false; glUniform4f(id, v.x, v.y, v.z, v.w); return true; }
+bool SetUniform(GLint id, mat4 m) { if (id < 0) return false; glUniformMatrix4fv(id, 1, true, (float *) &m[0][0]); return true; }
+
+// Uniform Access by Name
+
+bool SetUniform(int program, const char *name, bool val) {
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1ui(id, val? 1 : 0);
@@ -423,7 +506,7 @@ bool SetUniform(int program, const char *name, bool val) {
 }
 
 bool SetUniform(int program, const char *name, int val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1i(id, val);
@@ -432,7 +515,7 @@ bool SetUniform(int program, const char *name, int val) {
 
 // following might confuse some compilers
 bool SetUniform(int program, const char *name, GLuint val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1ui(id, val);
@@ -440,7 +523,7 @@ bool SetUniform(int program, const char *name, GLuint val) {
 }
 
 bool SetUniformv(int program, const char *name, int count, int *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1iv(id, count, v);
@@ -448,7 +531,7 @@ bool SetUniformv(int program, const char *name, int count, int *v) {
 }
 
 bool SetUniform(int program, const char *name, float val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1f(id, val);
@@ -456,7 +539,7 @@ bool SetUniform(int program, const char *name, float val) {
 }
 
 bool SetUniformv(int program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1fv(id, count, v);
@@ -464,7 +547,7 @@ bool SetUniformv(int program, const char *name, int count, float *v) {
 }
 
 bool SetUniform(int program, const char *name, vec2 v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform2f(id, v.x, v.y);
@@ -472,7 +555,7 @@ bool SetUniform(int program, const char *name, vec2 v) {
 }
 
 bool SetUniform(int program, const char *name, vec3 v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3f(id, v.x, v.y, v.z);
@@ -480,7 +563,7 @@ bool SetUniform(int program, const char *name, vec3 v) {
 }
 
 bool SetUniform(int program, const char *name, vec4 v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform4f(id, v.x, v.y, v.z, v.w);
@@ -488,7 +571,7 @@ bool SetUniform(int program, const char *name, vec4 v) {
 }
 
 bool SetUniform(int program, const char *name, vec3 *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3fv(id, 1, (float *) v);
@@ -496,7 +579,7 @@ bool SetUniform(int program, const char *name, vec3 *v) {
 }
 
 bool SetUniform(int program, const char *name, vec4 *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform4fv(id, 1, (float *) v);
@@ -504,7 +587,7 @@ bool SetUniform(int program, const char *name, vec4 *v) {
 }
 
 bool SetUniform3(int program, const char *name, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3fv(id, 1, v);
@@ -512,7 +595,7 @@ bool SetUniform3(int program, const char *name, float *v) {
 }
 
 bool SetUniform2v(int program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform2fv(id, count, v);
@@ -520,7 +603,7 @@ bool SetUniform2v(int program, const char *name, int count, float *v) {
 }
 
 bool SetUniform3v(int program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3fv(id, count, v);
@@ -528,7 +611,7 @@ bool SetUniform3v(int program, const char *name, int count, float *v) {
 }
 
 bool SetUniform4v(int program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform4fv(id, count, v);
@@ -536,7 +619,7 @@ bool SetUniform4v(int program, const char *name, int count, float *v) {
 }
 
 bool SetUniform(int program, const char *name, mat4 m) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniformMatrix4fv(id, 1, true, (float *) &m[0][0]);
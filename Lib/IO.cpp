@@ -2,8 +2,15 @@
 
 #include "Draw.h"
 #include "IO.h"
+#include "Misc.h"
+#include "PixelFormat.h"
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
 #include <fstream>
+#include <map>
 #include <string.h>
+#include <thread>
 
 using std::string;
 using std::vector;
@@ -14,27 +21,17 @@ using std::ifstream;
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image.h"
-#include "stb_image_write.h"
+#include "STB_Image.h"
+#include "STB_Image_Write.h"
 
 void LoadTexture(unsigned char *pixels, int width, int height, int bpp, unsigned int textureName, bool bgr, bool mipmap) {
-	unsigned char *temp = pixels;
-	if (false && bpp == 4) {
-		int bytesPerImage = 3*width*height;
-		temp = new unsigned char[bytesPerImage];
-		unsigned char *p = pixels, *t = temp;
-		for (int j = 0; j < height; j++)
-			for (int i = 0; i < width; i++, p++)
-				for (int k = 0; k < 3; k++)
-					*t++ = *p++;
-	}
 	glBindTexture(GL_TEXTURE_2D, textureName);      // bind current texture to textureName
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);          // accommodate width not multiple of 4
 	// specify target, format, dimension, transfer data
 	if (bpp == 4)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, temp);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, bgr? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	else
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, bgr? GL_BGR : GL_RGB, GL_UNSIGNED_BYTE, temp);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, bgr? GL_BGR : GL_RGB, GL_UNSIGNED_BYTE, pixels);
 	if (mipmap) {
 		glGenerateMipmap(GL_TEXTURE_2D);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -43,7 +40,6 @@ void LoadTexture(unsigned char *pixels, int width, int height, int bpp, unsigned
 	else
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// if (bpp == 4) delete [] temp;
 	glBindTexture(GL_TEXTURE_2D, 0); // **** ???
 }
 
@@ -55,7 +51,235 @@ GLuint LoadTexture(unsigned char *pixels, int width, int height, int bpp, bool b
 	return textureName;
 }
 
+namespace {
+
+struct TextureRecord {
+	string key;
+	int nChannels = 0, width = 0, height = 0, nRefs = 0;
+};
+
+// never destroyed: global meshes and sprites release their textures during static destruction
+std::map<string, GLuint> &textureNames = *new std::map<string, GLuint>;			// filename+mipmap to texture name
+std::map<GLuint, TextureRecord> &textureRecords = *new std::map<GLuint, TextureRecord>;
+
+GLuint FindTexture(const string &key, int *n = NULL, int *w = NULL, int *h = NULL) {
+	std::map<string, GLuint>::iterator it = textureNames.find(key);
+	if (it == textureNames.end())
+		return 0;
+	TextureRecord &r = textureRecords[it->second];
+	r.nRefs++;
+	if (n) *n = r.nChannels;
+	if (w) *w = r.width;
+	if (h) *h = r.height;
+	return it->second;
+}
+
+GLuint AddTexture(const string &key, GLuint textureName, int nChannels, int width, int height) {
+	TextureRecord &r = textureRecords[textureName];
+	r.key = key;
+	r.nChannels = nChannels;
+	r.width = width;
+	r.height = height;
+	r.nRefs = 1;
+	textureNames[key] = textureName;
+	return textureName;
+}
+
+GLuint AddTexture(const string &key, unsigned char *pixels, int width, int height, int nChannels, bool mipmap) {
+	GLuint textureName = 0;
+	glGenTextures(1, &textureName);
+	LoadTexture(pixels, width, height, nChannels, textureName, false, mipmap);
+	return AddTexture(key, textureName, nChannels, width, height);
+}
+
+} // end namespace
+
+// Cooked Texture Cache
+
+namespace {
+
+bool useTextureCache = true;
+
+const int texCacheVersion = 1;
+
+struct TexCacheHeader {
+	char magic[4];							// "TEXB"
+	int version, width, height, nChannels, nLevels;
+	long long sourceSize, sourceModified;	// cache is stale if either differs from the image file
+};
+
+void LevelSize(int width, int height, int level, int &w, int &h) {
+	w = width >> level;
+	h = height >> level;
+	w = w < 1? 1 : w;
+	h = h < 1? 1 : h;
+}
+
+int NLevels(int width, int height) {
+	int n = 1;
+	while ((width >> n) || (height >> n))
+		n++;
+	return n;
+}
+
+size_t LevelsSize(int width, int height, int nLevels) {
+	size_t size = 0;
+	for (int l = 0, w, h; l < nLevels; l++) {
+		LevelSize(width, height, l, w, h);
+		size += 4*w*h;
+	}
+	return size;
+}
+
+void SetLevels(CookedTexture &t, const unsigned char *p, int nLevels) {
+	t.levels.resize(nLevels);
+	for (int l = 0, w, h; l < nLevels; l++, p += 4*w*h) {
+		LevelSize(t.width, t.height, l, w, h);
+		t.levels[l] = p;
+	}
+}
+
+void Cook(unsigned char *pixels, int width, int height, int nChannels, CookedTexture &t) {
+	// rgba level 0, then each level the 2x2 average of the previous (last row or column repeated if odd)
+	int nLevels = NLevels(width, height);
+	t.width = width;
+	t.height = height;
+	t.nChannels = nChannels;
+	t.pixels.resize(LevelsSize(width, height, nLevels));
+	unsigned char *p = t.pixels.data();
+	if (nChannels == 4)
+		memcpy(p, pixels, 4*width*height);
+	else if (nChannels == 3)
+		RgbToRgba(pixels, p, width*height);
+	else
+		for (int i = 0; i < width*height; i++, pixels += nChannels) {
+			p[4*i] = p[4*i+1] = p[4*i+2] = pixels[0];
+			p[4*i+3] = nChannels == 2? pixels[1] : 255;
+		}
+	p += 4*width*height;
+	unsigned char *prev = t.pixels.data();
+	for (int l = 1, pw = width, ph = height, w, h; l < nLevels; l++, pw = w, ph = h) {
+		LevelSize(width, height, l, w, h);
+		for (int j = 0; j < h; j++) {
+			unsigned char *r0 = prev+4*pw*(2*j < ph? 2*j : ph-1), *r1 = prev+4*pw*(2*j+1 < ph? 2*j+1 : ph-1);
+			for (int i = 0; i < w; i++, p += 4) {
+				int i0 = 4*(2*i < pw? 2*i : pw-1), i1 = 4*(2*i+1 < pw? 2*i+1 : pw-1);
+				for (int k = 0; k < 4; k++)
+					p[k] = (unsigned char) ((r0[i0+k]+r0[i1+k]+r1[i0+k]+r1[i1+k]+2)/4);
+			}
+		}
+		prev = p-4*w*h;
+	}
+	SetLevels(t, t.pixels.data(), nLevels);
+}
+
+bool ReadTexCache(const char *cacheName, long long sourceSize, long long sourceModified, CookedTexture &t) {
+	if (!t.file.Open(cacheName))
+		return false;
+	TexCacheHeader h;
+	if (t.file.size < sizeof(h))
+		return false;
+	memcpy(&h, t.file.data, sizeof(h));
+	if (strncmp(h.magic, "TEXB", 4) || h.version != texCacheVersion ||
+		h.sourceSize != sourceSize || h.sourceModified != sourceModified ||
+		h.width < 1 || h.height < 1 || h.nLevels != NLevels(h.width, h.height) ||
+		t.file.size != sizeof(h)+LevelsSize(h.width, h.height, h.nLevels)) {
+		t.file.Close();
+		return false;
+	}
+	t.width = h.width;
+	t.height = h.height;
+	t.nChannels = h.nChannels;
+	SetLevels(t, (const unsigned char *) t.file.data+sizeof(h), h.nLevels);
+	return true;
+}
+
+bool WriteTexCache(const char *cacheName, long long sourceSize, long long sourceModified, CookedTexture &t) {
+	// as WriteObjCache: temporary file, then rename, so a reader (possibly another process) never maps a partial cache
+	string tmpName = string(cacheName)+".tmp"+std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())%100000);
+	FILE *out = fopen(tmpName.c_str(), "wb");
+	if (!out)
+		return false;							// eg, read-only directory: cache silently skipped
+	TexCacheHeader h;
+	memcpy(h.magic, "TEXB", 4);
+	h.version = texCacheVersion;
+	h.width = t.width;
+	h.height = t.height;
+	h.nChannels = t.nChannels;
+	h.nLevels = (int) t.levels.size();
+	h.sourceSize = sourceSize;
+	h.sourceModified = sourceModified;
+	fwrite(&h, sizeof(h), 1, out);
+	fwrite(t.pixels.data(), 1, t.pixels.size(), out);
+	bool ok = !ferror(out);
+	ok = !fclose(out) && ok;
+	std::error_code err;
+	if (ok)
+		std::filesystem::rename(tmpName, cacheName, err);	// replaces any existing cache (fails on Windows if mapped)
+	if (!ok || err)
+		remove(tmpName.c_str());
+	return ok && !err;
+}
+
+GLuint LoadCooked(CookedTexture &t, bool mipmap) {
+	GLuint textureName = 0;
+	int nLevels = mipmap? (int) t.levels.size() : 1;
+	glGenTextures(1, &textureName);
+	glBindTexture(GL_TEXTURE_2D, textureName);
+	glTexStorage2D(GL_TEXTURE_2D, nLevels, GL_RGBA8, t.width, t.height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);			// rgba rows
+	for (int l = 0, w, h; l < nLevels; l++) {
+		LevelSize(t.width, t.height, l, w, h);
+		glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, t.levels[l]);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmap? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return textureName;
+}
+
+} // end namespace
+
+void SetTextureCache(bool use) { useTextureCache = use; }
+
+bool CookTexture(const char *filename, CookedTexture &t) {
+	t.levels.resize(0);
+	t.pixels.resize(0);
+	t.file.Close();
+	long size = FileSize(filename);
+	long long modified = (long long) FileModified(filename);
+	string cacheName = string(filename)+".tex";
+	if (size >= 0 && useTextureCache && ReadTexCache(cacheName.c_str(), size, modified, t))
+		return true;
+	DecodedImage image;
+	if (!DecodeImage(filename, image))
+		return false;
+	Cook(image.pixels, image.width, image.height, image.nChannels, t);
+	if (useTextureCache)
+		WriteTexCache(cacheName.c_str(), size, modified, t);
+	return true;
+}
+
+GLuint ReadTexture(const char *filename, CookedTexture &t, bool mipmap) {
+	string key = string(filename)+(mipmap? "|m" : "|");
+	if (GLuint textureName = FindTexture(key))
+		return textureName;
+	return t.levels.size()? AddTexture(key, LoadCooked(t, mipmap), t.nChannels, t.width, t.height) : 0;
+}
+
 GLuint ReadTexture(const char *filename, bool mipmap, int *n, int *w, int *h) {
+	string key = string(filename)+(mipmap? "|m" : "|");
+	if (GLuint textureName = FindTexture(key, n, w, h))
+		return textureName;
+	if (useTextureCache) {
+		CookedTexture t;
+		if (!CookTexture(filename, t))
+			return 0;
+		if (n) *n = t.nChannels;
+		if (w) *w = t.width;
+		if (h) *h = t.height;
+		return ReadTexture(filename, t, mipmap);
+	}
 	int width, height, nChannels;
 	stbi_set_flip_vertically_on_load(true);
 	unsigned char *data = stbi_load(filename, &width, &height, &nChannels, 0);
@@ -66,25 +290,46 @@ GLuint ReadTexture(const char *filename, bool mipmap, int *n, int *w, int *h) {
 	if (n) *n = nChannels;
 	if (w) *w = width;
 	if (h) *h = height;
-	GLuint textureName = 0;
-	glGenTextures(1, &textureName);
-	LoadTexture(data, width, height, nChannels, textureName, false, mipmap);
+	GLuint textureName = AddTexture(key, data, width, height, nChannels, mipmap);
 	stbi_image_free(data);
 	return textureName;
 }
 
+DecodedImage::~DecodedImage() { if (pixels) stbi_image_free(pixels); }
+
+bool DecodeImage(const char *filename, DecodedImage &image) {
+	if (image.pixels)
+		stbi_image_free(image.pixels);
+	stbi_set_flip_vertically_on_load_thread(true);	// global setting may be changed by GL thread
+	image.pixels = stbi_load(filename, &image.width, &image.height, &image.nChannels, 0);
+	if (!image.pixels)
+		printf("DecodeImage: can't open %s (%s)\n", filename, stbi_failure_reason());
+	return image.pixels != NULL;
+}
+
+GLuint ReadTexture(const char *filename, DecodedImage &image, bool mipmap) {
+	string key = string(filename)+(mipmap? "|m" : "|");
+	if (GLuint textureName = FindTexture(key))
+		return textureName;
+	return image.pixels? AddTexture(key, image.pixels, image.width, image.height, image.nChannels, mipmap) : 0;
+}
+
+void ReleaseTexture(GLuint textureName) {
+	std::map<GLuint, TextureRecord>::iterator it = textureRecords.find(textureName);
+	if (it == textureRecords.end() || --it->second.nRefs > 0)
+		return;
+	textureNames.erase(it->second.key);
+	textureRecords.erase(it);
+	glDeleteTextures(1, &textureName);
+}
+
 unsigned char *GetData(int &width, int &height) {
 	ViewportSize(width, height);
-	int npixels = width*height;
-	unsigned char *cPixels = new unsigned char[3*npixels], *c = cPixels;
-	float *fPixels = new float[3*npixels*sizeof(float)], *f = fPixels;
-	glReadPixels(0, 0, width, height, GL_BGR, GL_FLOAT, fPixels);   // Targa is BGR ordered
-	for (int i = 0; i < npixels; i++) {
-		*c++ = (unsigned char) (255.f*(*f++));
-		*c++ = (unsigned char) (255.f*(*f++));
-		*c++ = (unsigned char) (255.f*(*f++));
-	}
-	delete [] fPixels;
+	// rgb bytes, top row first (stb writers convert to each format's channel and row order)
+	unsigned char *cPixels = new unsigned char[3*width*height];
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, cPixels);
+	FlipVertical(cPixels, width, height, 3);
 	return cPixels;
 }
 
@@ -567,6 +812,616 @@ bool ReadAsciiObj(const char      *filename,
 	return true;
 } // end ReadAsciiObj
 
+// Parallel ASCII OBJ
+
+namespace {
+
+// a chunk is a line-aligned section of the file, parsed independently of other chunks; any
+// statement whose effect depends on earlier lines (f, g, usemtl, mtllib) is recorded as a
+// command, replayed in file order by the merge, which applies the same rules as ReadAsciiObj
+
+struct ObjCmd {
+	enum Type { Face, Group, UseMtl, MtlLib, BadV, BadVn, BadVt, TooLong } type;
+	int line = 0;						// line number within chunk
+	int nV = 0, nT = 0, nN = 0;			// # v, vt, vn lines in chunk preceding this command
+	int start = 0, count = 0;			// Face: range in ObjChunk::vids; else range in ObjChunk::names
+	bool badFormat = false;				// Face: terminated by a non-positive index
+	ObjCmd(Type t, int l) : type(t), line(l) { }
+};
+
+struct ObjChunk {
+	const char *begin = NULL, *end = NULL;	// end is just past a newline
+	int nLines = 0;
+	vector<vec3> v, vn;
+	vector<vec2> vt;
+	vector<int3> vids;						// vid, tid, nid, zero-based
+	string names;
+	vector<ObjCmd> cmds;
+};
+
+inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+
+bool ParseFloat(const char *&p, const char *end, float &f) {
+	// equivalent to sscanf %g: skip white space, optional sign, decimal or inf/nan
+	while (p < end && IsSpace(*p)) p++;
+	const char *s = p;
+	if (s < end && *s == '+' && s+1 < end && *(s+1) != '-') s++;	// from_chars rejects leading +
+	std::from_chars_result r = std::from_chars(s, end, f);
+	if (r.ec == std::errc::invalid_argument)
+		return false;
+	if (r.ec == std::errc::result_out_of_range)
+		f = strtof(string(p, r.ptr).c_str(), NULL);					// match strtof over/underflow
+	p = r.ptr;
+	return true;
+}
+
+int ParseInt(const char *s) {
+	// equivalent to atoi for a word without white space
+	int i = 0;
+	if (*s == '+' && *(s+1) != '-') s++;
+	std::from_chars(s, s+strlen(s), i);
+	return i;
+}
+
+void ParseObjChunk(ObjChunk &c) {
+	char word[WordLim];
+	for (const char *line = c.begin; line < c.end; c.nLines++) {
+		const char *eol = (const char *) memchr(line, '\n', c.end-line), *next = eol+1;
+		if (eol > line && *(eol-1) == '\r') eol--;	// as in text mode
+		int lineNum = c.nLines;
+		if (eol-line+1 >= LineLim-1) {				// as in fgets
+			c.cmds.push_back(ObjCmd(ObjCmd::TooLong, lineNum));
+			return;
+		}
+		const char *p = line;
+		line = next;
+		// read keyword
+		while (p < eol && (*p == ' ' || *p == '\t')) p++;
+		const char *w = p;
+		while (p < eol && *p != ' ' && *p != '\t') p++;
+		size_t nw = p-w;
+		if (!nw || *w == '#' || nw > 6)
+			continue;
+		char key[8];
+		for (size_t i = 0; i < nw; i++)
+			key[i] = tolower(w[i]);
+		key[nw] = 0;
+		if (!strcmp(key, "v") || !strcmp(key, "vn")) {
+			vec3 v;
+			if (!ParseFloat(p, eol, v.x) || !ParseFloat(p, eol, v.y) || !ParseFloat(p, eol, v.z)) {
+				c.cmds.push_back(ObjCmd(key[1]? ObjCmd::BadVn : ObjCmd::BadV, lineNum));
+				return;
+			}
+			(key[1]? c.vn : c.v).push_back(v);
+		}
+		else if (!strcmp(key, "vt")) {
+			vec2 t;
+			if (!ParseFloat(p, eol, t.x) || !ParseFloat(p, eol, t.y)) {
+				c.cmds.push_back(ObjCmd(ObjCmd::BadVt, lineNum));
+				return;
+			}
+			c.vt.push_back(t);
+		}
+		else if (!strcmp(key, "f")) {
+			ObjCmd f(ObjCmd::Face, lineNum);
+			f.nV = (int) c.v.size(); f.nT = (int) c.vt.size(); f.nN = (int) c.vn.size();
+			f.start = (int) c.vids.size();
+			for (;;) {
+				while (p < eol && (*p == ' ' || *p == '\t')) p++;
+				const char *s = p;
+				while (p < eol && *p != ' ' && *p != '\t') p++;
+				if (p == s)
+					break;
+				size_t n = p-s < WordLim-1? p-s : WordLim-1;
+				memcpy(word, s, n);
+				word[n] = 0;
+				// as in ReadAsciiObj
+				char *tPtr = strchr(word+1, '/');
+				char *nPtr = tPtr? strchr(tPtr+1, '/') : NULL;
+				int vid = ParseInt(word);
+				if (!vid)
+					break;
+				int tid = tPtr && *++tPtr != '/'? ParseInt(tPtr) : vid;
+				int nid = nPtr && *++nPtr != 0? ParseInt(nPtr) : vid;
+				vid--;
+				tid--;
+				nid--;
+				if (vid < 0 || tid < 0 || nid < 0) {
+					f.badFormat = true;
+					break;
+				}
+				c.vids.push_back(int3(vid, tid, nid));
+			}
+			f.count = (int) c.vids.size()-f.start;
+			c.cmds.push_back(f);
+		}
+		else if (!strcmp(key, "g") || !strcmp(key, "mtllib") || !strcmp(key, "usemtl")) {
+			ObjCmd cmd(*key == 'g'? ObjCmd::Group : *key == 'm'? ObjCmd::MtlLib : ObjCmd::UseMtl, lineNum);
+			const char *s = p, *e = eol;
+			if (cmd.type == ObjCmd::Group) {
+				const char *paren = (const char *) memchr(s, '(', e-s);
+				if (paren) e = paren;				// group name is remainder of line, up to any '('
+			}
+			else {
+				while (s < e && (*s == ' ' || *s == '\t')) s++;
+				const char *t = s;
+				while (t < e && *t != ' ' && *t != '\t') t++;
+				if (t == s)
+					continue;
+				e = t-s < WordLim-1? t : s+WordLim-1;
+			}
+			cmd.start = (int) c.names.size();
+			cmd.count = (int) (e-s);
+			c.names.append(s, e-s);
+			c.cmds.push_back(cmd);
+		}
+	}
+}
+
+class VidHash {
+	// open-addressing (linear probe) map from vid/tid/nid triplet to point index
+	vector<int3> keys;
+	vector<int> values;						// -1 if slot empty
+	size_t mask = 0, count = 0;
+	static size_t Hash(const int3 &k) {
+		unsigned long long h = (unsigned) k.i1*0x9E3779B97F4A7C15ull;
+		h ^= (unsigned) k.i2*0xC2B2AE3D27D4EB4Full;
+		h ^= (unsigned) k.i3*0x165667B19E3779F9ull;
+		return (size_t) (h^(h >> 29));
+	}
+	void Grow() {
+		vector<int3> oldKeys;
+		vector<int> oldValues;
+		oldKeys.swap(keys);
+		oldValues.swap(values);
+		size_t size = oldKeys.size()? 2*oldKeys.size() : 1024;
+		keys.resize(size);
+		values.assign(size, -1);
+		mask = size-1;
+		for (size_t i = 0; i < oldKeys.size(); i++)
+			if (oldValues[i] >= 0) {
+				size_t s = Hash(oldKeys[i])&mask;
+				while (values[s] >= 0) s = (s+1)&mask;
+				keys[s] = oldKeys[i];
+				values[s] = oldValues[i];
+			}
+	}
+public:
+	int FindOrAdd(const int3 &k, int value) {
+		// return value for key k, or if k absent add k with value and return -1
+		if (2*(count+1) > keys.size())
+			Grow();
+		size_t s = Hash(k)&mask;
+		for (; values[s] >= 0; s = (s+1)&mask)
+			if (keys[s].i1 == k.i1 && keys[s].i2 == k.i2 && keys[s].i3 == k.i3)
+				return values[s];
+		keys[s] = k;
+		values[s] = value;
+		count++;
+		return -1;
+	}
+};
+
+} // end namespace
+
+bool ReadAsciiObjParallel(const char    *filename,
+						  vector<vec3>  &points,
+						  vector<int3>  &triangles,
+						  vector<vec3>  *normals,
+						  vector<vec2>  *textures,
+						  vector<Group> *triangleGroups,
+						  vector<Mtl>   *triangleMtls,
+						  vector<int4>  *quads,
+						  vector<int2>  *segs,
+						  int            nThreads) {
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+	// a final line without newline is ignored, as in ReadAsciiObj
+	const char *begin = file.data, *end = file.data+file.size;
+	while (end > begin && *(end-1) != '\n') end--;
+	if (file.data+file.size-end >= LineLim-1) {
+		printf("line %d too long\n", (int) std::count(begin, end, '\n'));
+		return false;
+	}
+	// split into line-aligned chunks, parse in parallel
+	if (nThreads <= 0)
+		nThreads = (int) std::thread::hardware_concurrency();
+	int nChunks = (int) ((end-begin)/(1 << 18))+1;		// at least 256K per chunk
+	nChunks = nChunks < nThreads? nChunks : nThreads > 0? nThreads : 1;
+	vector<ObjChunk> chunks(nChunks);
+	const char *p = begin;
+	for (int i = 0; i < nChunks; i++) {
+		const char *e = i == nChunks-1? end : begin+(end-begin)*(i+1)/nChunks;
+		if (e < p) e = p;
+		while (e < end && *(e-1) != '\n') e++;
+		chunks[i].begin = p;
+		chunks[i].end = p = e;
+	}
+	vector<std::thread> threads;
+	for (int i = 1; i < nChunks; i++)
+		threads.push_back(std::thread(ParseObjChunk, std::ref(chunks[i])));
+	ParseObjChunk(chunks[0]);
+	for (std::thread &t : threads)
+		t.join();
+	// concatenate vertex data
+	vector<vec3> tmpVertices, tmpNormals;
+	vector<vec2> tmpTextures;
+	size_t nV = 0, nN = 0, nT = 0;
+	for (ObjChunk &c : chunks) {
+		nV += c.v.size();
+		nN += c.vn.size();
+		nT += c.vt.size();
+	}
+	tmpVertices.reserve(nV);
+	tmpNormals.reserve(nN);
+	tmpTextures.reserve(nT);
+	for (ObjChunk &c : chunks) {
+		tmpVertices.insert(tmpVertices.end(), c.v.begin(), c.v.end());
+		tmpNormals.insert(tmpNormals.end(), c.vn.begin(), c.vn.end());
+		tmpTextures.insert(tmpTextures.end(), c.vt.begin(), c.vt.end());
+	}
+	// replay commands in file order
+	bool hashedTriangles = false, hashedVertices = false;
+	VidHash vidHash;
+	MtlMap mtlMap;
+	vector<int> vids;
+	int nQuadsConvertedToTris = 0, lineOffset = 0, vOffset = 0, tOffset = 0, nOffset = 0;
+	for (ObjChunk &c : chunks) {
+		for (ObjCmd &cmd : c.cmds) {
+			int lineNum = lineOffset+cmd.line;
+			string name(c.names, cmd.type == ObjCmd::Face? 0 : cmd.start, cmd.type == ObjCmd::Face? 0 : cmd.count);
+			switch (cmd.type) {
+			case ObjCmd::TooLong:
+				printf("line %d too long\n", lineNum);
+				return false;
+			case ObjCmd::BadV:
+			case ObjCmd::BadVn:
+				printf("bad line %d in object file", lineNum);
+				return false;
+			case ObjCmd::BadVt:
+				printf("bad line in object file");
+				return false;
+			case ObjCmd::MtlLib: {
+				const char *slash = strrchr(filename, '/');
+				mtlMap = ReadMaterial((slash? string(filename, slash-filename+1)+name : name).c_str());
+				break;
+			}
+			case ObjCmd::UseMtl: {
+				MtlMap::iterator it = mtlMap.find(name);
+				if (it != mtlMap.end() && triangleMtls) {
+					Mtl m = it->second;
+					m.startTriangle = triangles.size();
+					triangleMtls->push_back(m);
+				}
+				break;
+			}
+			case ObjCmd::Group:
+				if (triangleGroups)
+					triangleGroups->push_back(Group(triangles.size(), name));
+				break;
+			case ObjCmd::Face: {
+				int nvids = vOffset+cmd.nV, ntids = tOffset+cmd.nT, nnids = nOffset+cmd.nN;
+				if ((ntids && ntids != nvids) || (nnids && nnids != nvids))
+					hashedVertices = true;
+				vids.resize(0);
+				for (int i = 0; i < cmd.count; i++) {
+					int3 &k = c.vids[cmd.start+i];
+					int vid = k.i1, tid = k.i2, nid = k.i3;
+					if (tid != vid || nid != vid)
+						hashedTriangles = true;
+					if (!hashedVertices && !hashedTriangles)
+						vids.push_back(vid);
+					else {
+						int nvrts = (int) points.size(), found = vidHash.FindOrAdd(k, nvrts);
+						if (found < 0) {
+							points.push_back(tmpVertices[vid]);
+							if (normals && nnids > nid)
+								normals->push_back(tmpNormals[nid]);
+							if (textures && ntids > tid)
+								textures->push_back(tmpTextures[tid]);
+							vids.push_back(nvrts);
+						}
+						else
+							vids.push_back(found);
+					}
+				}
+				if (cmd.badFormat)
+					printf("bad format on line %d\n", lineNum);
+				int nids = vids.size();
+				if (nids == 3) {
+					int id1 = vids[0], id2 = vids[1], id3 = vids[2];
+					if (normals && (int) normals->size() > id1) {
+						vec3 p1, p2, p3;
+						if (hashedVertices || hashedTriangles) { p1 = points[id1]; p2 = points[id2]; p3 = points[id3]; }
+						else { p1 = tmpVertices[id1]; p2 = tmpVertices[id2]; p3 = tmpVertices[id3]; }
+						vec3 a(p2-p1), b(p3-p2), n(cross(a, b));
+						if (dot(n, (*normals)[id1]) < 0)
+							std::swap(id1, id3);		// reverse triangle order to correspond with vertex normal
+					}
+					triangles.push_back(int3(id1, id2, id3));
+				}
+				else if (nids == 4 && quads)
+					quads->push_back(int4(vids[0], vids[1], vids[2], vids[3]));
+				else if (nids == 2 && segs)
+					segs->push_back(int2(vids[0], vids[1]));
+				else
+					for (int i = 1; i < nids-1; i++)
+						triangles.push_back(int3(vids[0], vids[i], vids[(i+1)%nids]));
+				if (nids == 4 && !quads) nQuadsConvertedToTris++;
+				break;
+			}
+			}
+		}
+		lineOffset += c.nLines;
+		vOffset += (int) c.v.size();
+		tOffset += (int) c.vt.size();
+		nOffset += (int) c.vn.size();
+	}
+	if (nQuadsConvertedToTris) printf("(%i quads converted to triangles)\n", nQuadsConvertedToTris);
+	if (!hashedVertices && !hashedTriangles) {
+		points = tmpVertices;
+		if (normals) *normals = tmpNormals;
+		if (textures) *textures = tmpTextures;
+	}
+	if (triangleGroups) {
+		int nGroups = triangleGroups->size();
+		for (int i = 0; i < nGroups; i++) {
+			int next = i < nGroups-1? (*triangleGroups)[i+1].startTriangle : triangles.size();
+			(*triangleGroups)[i].nTriangles = next-(*triangleGroups)[i].startTriangle;
+		}
+	}
+	if (triangleMtls) {
+		int nMtls = triangleMtls->size();
+		for (int i = 0; i < nMtls; i++) {
+			int next = i < nMtls-1? (*triangleMtls)[i+1].startTriangle : triangles.size();
+			(*triangleMtls)[i].nTriangles = next-(*triangleMtls)[i].startTriangle;
+		}
+	}
+	return true;
+} // end ReadAsciiObjParallel
+
+// Binary OBJ Cache
+
+namespace {
+
+bool useObjCache = true;
+
+const int objCacheVersion = 2;
+
+enum { CacheNormals = 1, CacheUvs = 2, CacheGroups = 4, CacheMtls = 8, CacheQuads = 16 };
+
+struct ObjCacheHeader {
+	char magic[4];							// "OBJB"
+	int version, contents;					// contents: which optional arrays were requested
+	int nPoints, nNormals, nUvs, nTriangles, nQuads, nGroups, nMtls, nMtlFiles;
+	long long sourceSize, sourceModified;	// cache is stale if either differs from the OBJ file
+};
+
+// a material file's name (as resolved by the OBJ parser), size and time; stale if either differs
+struct MtlFile {
+	string name;
+	long long size = -1, modified = 0;
+};
+
+struct CacheReader {
+	const char *p, *end;
+	bool Read(void *dst, size_t n) {
+		if (n > (size_t) (end-p)) return false;
+		memcpy(dst, p, n);
+		p += n;
+		return true;
+	}
+	bool Fits(int n, size_t elementSize) {
+		// n elements of at least elementSize bytes remain
+		return n >= 0 && (size_t) n <= (size_t) (end-p)/elementSize;
+	}
+	template<class T> bool Array(vector<T> &v, int n) {
+		if (!Fits(n, sizeof(T))) return false;
+		v.resize(n);
+		return Read(v.data(), n*sizeof(T));
+	}
+	bool String(string &s) {
+		int n = 0;
+		if (!Read(&n, sizeof(int)) || n < 0 || n > end-p) return false;
+		s.assign(p, n);
+		p += n;
+		return true;
+	}
+};
+
+void WriteString(FILE *out, const string &s) {
+	int n = (int) s.size();
+	fwrite(&n, sizeof(int), 1, out);
+	fwrite(s.data(), 1, n, out);
+}
+
+void MtlFiles(const char *filename, vector<MtlFile> &files) {
+	// mtllib statements, resolved relative to the OBJ file as by the parser
+	MappedFile file;
+	if (!file.Open(filename))
+		return;
+	const char *p = file.data, *end = file.data+file.size, *slash = strrchr(filename, '/');
+	for (; p < end; p++) {
+		while (p < end && (*p == ' ' || *p == '\t')) p++;
+		const char *key = "mtllib";
+		int k = 0;
+		while (k < 6 && p+k < end && tolower(p[k]) == key[k]) k++;
+		if (k == 6 && p+6 < end && (p[6] == ' ' || p[6] == '\t')) {
+			const char *s = p+6;
+			while (s < end && (*s == ' ' || *s == '\t')) s++;
+			const char *e = s;
+			while (e < end && !isspace((unsigned char) *e)) e++;
+			MtlFile f;
+			f.name = (slash? string(filename, slash-filename+1) : string())+string(s, e-s);
+			f.size = FileSize(f.name.c_str());
+			f.modified = f.size < 0? 0 : (long long) FileModified(f.name.c_str());
+			files.push_back(f);
+		}
+		p = (const char *) memchr(p, '\n', end-p);
+		if (!p) break;
+	}
+}
+
+void ClearObj(vector<vec3> &points, vector<int3> &triangles, vector<vec3> *normals, vector<vec2> *textures,
+			  vector<Group> *triangleGroups, vector<Mtl> *triangleMtls, vector<int4> *quads) {
+	// discard any arrays filled by a partially valid cache
+	points.resize(0);
+	triangles.resize(0);
+	if (normals) normals->resize(0);
+	if (textures) textures->resize(0);
+	if (triangleGroups) triangleGroups->resize(0);
+	if (triangleMtls) triangleMtls->resize(0);
+	if (quads) quads->resize(0);
+}
+
+int CacheContents(vector<vec3> *normals, vector<vec2> *textures, vector<Group> *triangleGroups, vector<Mtl> *triangleMtls, vector<int4> *quads) {
+	return (normals? CacheNormals : 0) | (textures? CacheUvs : 0) | (triangleGroups? CacheGroups : 0) |
+		   (triangleMtls? CacheMtls : 0) | (quads? CacheQuads : 0);
+}
+
+bool ReadObjCache(const char *cacheName, long long sourceSize, long long sourceModified,
+				  vector<vec3> &points, vector<int3> &triangles, vector<vec3> *normals, vector<vec2> *textures,
+				  vector<Group> *triangleGroups, vector<Mtl> *triangleMtls, vector<int4> *quads) {
+	MappedFile file;
+	if (!file.Open(cacheName))
+		return false;
+	CacheReader r = { file.data, file.data+file.size };
+	ObjCacheHeader h;
+	if (!r.Read(&h, sizeof(h)) || strncmp(h.magic, "OBJB", 4) || h.version != objCacheVersion)
+		return false;
+	if (h.sourceSize != sourceSize || h.sourceModified != sourceModified ||
+		h.contents != CacheContents(normals, textures, triangleGroups, triangleMtls, quads))
+		return false;
+	vector<int4> tmpQuads;
+	vector<vec3> tmpNormals;
+	vector<vec2> tmpUvs;
+	if (!r.Array(points, h.nPoints) || !r.Array(normals? *normals : tmpNormals, h.nNormals) ||
+		!r.Array(textures? *textures : tmpUvs, h.nUvs) || !r.Array(triangles, h.nTriangles) ||
+		!r.Array(quads? *quads : tmpQuads, h.nQuads))
+		return false;
+	if (triangleGroups) {
+		if (!r.Fits(h.nGroups, 3*sizeof(int)+sizeof(vec3)))
+			return false;
+		triangleGroups->resize(h.nGroups);
+		for (Group &g : *triangleGroups)
+			if (!r.String(g.name) || !r.Read(&g.startTriangle, sizeof(int)) ||
+				!r.Read(&g.nTriangles, sizeof(int)) || !r.Read(&g.color, sizeof(vec3)))
+				return false;
+	}
+	if (triangleMtls) {
+		if (!r.Fits(h.nMtls, 3*sizeof(int)+3*sizeof(vec3)))
+			return false;
+		triangleMtls->resize(h.nMtls);
+		for (Mtl &m : *triangleMtls)
+			if (!r.String(m.name) || !r.Read(&m.startTriangle, sizeof(int)) || !r.Read(&m.nTriangles, sizeof(int)) ||
+				!r.Read(&m.ka, sizeof(vec3)) || !r.Read(&m.kd, sizeof(vec3)) || !r.Read(&m.ks, sizeof(vec3)))
+				return false;
+	}
+	if (!r.Fits(h.nMtlFiles, sizeof(int)+2*sizeof(long long)))
+		return false;
+	for (int i = 0; i < h.nMtlFiles; i++) {
+		MtlFile f;
+		if (!r.String(f.name) || !r.Read(&f.size, sizeof(long long)) || !r.Read(&f.modified, sizeof(long long)))
+			return false;
+		long long size = FileSize(f.name.c_str()), modified = size < 0? 0 : (long long) FileModified(f.name.c_str());
+		if (size != f.size || modified != f.modified)
+			return false;
+	}
+	return true;
+}
+
+bool WriteObjCache(const char *cacheName, long long sourceSize, long long sourceModified,
+				   vector<vec3> &points, vector<int3> &triangles, vector<vec3> *normals, vector<vec2> *textures,
+				   vector<Group> *triangleGroups, vector<Mtl> *triangleMtls, vector<int4> *quads, vector<MtlFile> &mtlFiles) {
+	// write to a temporary file, then rename, so no reader sees a partial cache
+	string tmpName = string(cacheName)+".tmp"+std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())%100000);
+	FILE *out = fopen(tmpName.c_str(), "wb");
+	if (!out)
+		return false;							// eg, read-only directory: cache silently skipped
+	ObjCacheHeader h;
+	memcpy(h.magic, "OBJB", 4);
+	h.version = objCacheVersion;
+	h.contents = CacheContents(normals, textures, triangleGroups, triangleMtls, quads);
+	h.nPoints = (int) points.size();
+	h.nNormals = normals? (int) normals->size() : 0;
+	h.nUvs = textures? (int) textures->size() : 0;
+	h.nTriangles = (int) triangles.size();
+	h.nQuads = quads? (int) quads->size() : 0;
+	h.nGroups = triangleGroups? (int) triangleGroups->size() : 0;
+	h.nMtls = triangleMtls? (int) triangleMtls->size() : 0;
+	h.nMtlFiles = (int) mtlFiles.size();
+	h.sourceSize = sourceSize;
+	h.sourceModified = sourceModified;
+	fwrite(&h, sizeof(h), 1, out);
+	fwrite(points.data(), sizeof(vec3), h.nPoints, out);
+	if (h.nNormals) fwrite(normals->data(), sizeof(vec3), h.nNormals, out);
+	if (h.nUvs) fwrite(textures->data(), sizeof(vec2), h.nUvs, out);
+	fwrite(triangles.data(), sizeof(int3), h.nTriangles, out);
+	if (h.nQuads) fwrite(quads->data(), sizeof(int4), h.nQuads, out);
+	for (int i = 0; i < h.nGroups; i++) {
+		Group &g = (*triangleGroups)[i];
+		WriteString(out, g.name);
+		fwrite(&g.startTriangle, sizeof(int), 1, out);
+		fwrite(&g.nTriangles, sizeof(int), 1, out);
+		fwrite(&g.color, sizeof(vec3), 1, out);
+	}
+	for (int i = 0; i < h.nMtls; i++) {
+		Mtl &m = (*triangleMtls)[i];
+		WriteString(out, m.name);
+		fwrite(&m.startTriangle, sizeof(int), 1, out);
+		fwrite(&m.nTriangles, sizeof(int), 1, out);
+		fwrite(&m.ka, sizeof(vec3), 1, out);
+		fwrite(&m.kd, sizeof(vec3), 1, out);
+		fwrite(&m.ks, sizeof(vec3), 1, out);
+	}
+	for (MtlFile &f : mtlFiles) {
+		WriteString(out, f.name);
+		fwrite(&f.size, sizeof(long long), 1, out);
+		fwrite(&f.modified, sizeof(long long), 1, out);
+	}
+	bool ok = !ferror(out);
+	ok = !fclose(out) && ok;
+	std::error_code err;
+	if (ok)
+		std::filesystem::rename(tmpName, cacheName, err);	// replaces any existing cache
+	if (!ok || err)
+		remove(tmpName.c_str());
+	return ok && !err;
+}
+
+} // end namespace
+
+void SetObjCache(bool use) { useObjCache = use; }
+
+bool ReadObj(const char    *filename,
+			 vector<vec3>  &points,
+			 vector<int3>  &triangles,
+			 vector<vec3>  *normals,
+			 vector<vec2>  *textures,
+			 vector<Group> *triangleGroups,
+			 vector<Mtl>   *triangleMtls,
+			 vector<int4>  *quads) {
+	long size = FileSize(filename);
+	if (size < 0)
+		return false;
+	long long modified = (long long) FileModified(filename);
+	string cacheName = string(filename)+".bin";
+	if (useObjCache) {
+		if (ReadObjCache(cacheName.c_str(), size, modified, points, triangles, normals, textures, triangleGroups, triangleMtls, quads))
+			return true;
+		ClearObj(points, triangles, normals, textures, triangleGroups, triangleMtls, quads);
+	}
+	if (!ReadAsciiObjParallel(filename, points, triangles, normals, textures, triangleGroups, triangleMtls, quads))
+		return false;
+	if (useObjCache) {
+		vector<MtlFile> mtlFiles;
+		MtlFiles(filename, mtlFiles);
+		WriteObjCache(cacheName.c_str(), size, modified, points, triangles, normals, textures, triangleGroups, triangleMtls, quads, mtlFiles);
+	}
+	return true;
+}
+
 bool WriteAsciiObj(const char    *filename,
 				   vector<vec3>  &points,
 				   vector<vec3>  &normals,
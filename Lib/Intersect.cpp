@@ -0,0 +1,245 @@
+// Intersect.cpp - vectorized line/triangle intersection over structure-of-arrays packets
+
+#include <string.h>
+#include "Intersect.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+	#define INTERSECT_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define TARGET_SSE
+		#define TARGET_AVX2
+	#else
+		#define TARGET_SSE __attribute__((target("sse2")))
+		#define TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+// Packets
+
+namespace {
+
+void SetLane(TriPacket &t, int lane, vec3 &p1, vec3 &p2, vec3 &p3, int id) {
+	vec3 e1 = p2-p1, e2 = p3-p1;
+	for (int k = 0; k < 3; k++) {
+		t.v0[k][lane] = p1[k];
+		t.e1[k][lane] = e1[k];
+		t.e2[k][lane] = e2[k];
+	}
+	t.ids[lane] = id;
+}
+
+TriPacket EmptyPacket() {
+	// unused lanes have zero edges (determinant 0, never hit)
+	TriPacket t;
+	memset(&t, 0, sizeof(t));
+	for (int i = 0; i < 8; i++)
+		t.ids[i] = -1;
+	return t;
+}
+
+template<class AddPrimitive>
+void BuildPackets(TriPackets &tp, vector<int2> &leaves, int trianglesPerPrimitive, AddPrimitive add) {
+	tp.packets.resize(0);
+	tp.nodePackets.assign(leaves.size(), int2(0, 0));
+	for (size_t n = 0; n < leaves.size(); n++) {
+		int start = leaves[n].i1, count = leaves[n].i2;
+		if (!count)
+			continue;
+		int nTriangles = count*trianglesPerPrimitive, nPackets = (nTriangles+7)/8;
+		tp.nodePackets[n] = int2((int) tp.packets.size(), nPackets);
+		tp.packets.resize(tp.packets.size()+nPackets, EmptyPacket());
+		TriPacket *packets = &tp.packets[tp.nodePackets[n].i1];
+		for (int i = 0, lane = 0; i < count; i++)
+			for (int k = 0; k < trianglesPerPrimitive; k++, lane++)
+				add(packets[lane/8], lane%8, start+i, k);
+	}
+}
+
+} // end namespace
+
+void TriPackets::Build(vector<vec3> &points, vector<int3> &triangles, vector<int> &order, vector<int2> &leaves) {
+	BuildPackets(*this, leaves, 1, [&](TriPacket &t, int lane, int i, int) {
+		int3 &tri = triangles[order[i]];
+		SetLane(t, lane, points[tri.i1], points[tri.i2], points[tri.i3], order[i]);
+	});
+}
+
+void TriPackets::Build(vector<vec3> &points, vector<int4> &quads, vector<int> &order, vector<int2> &leaves) {
+	BuildPackets(*this, leaves, 2, [&](TriPacket &t, int lane, int i, int k) {
+		int4 &q = quads[order[i]];
+		SetLane(t, lane, points[q.i1], points[k? q.i3 : q.i2], points[k? q.i4 : q.i3], order[i]);
+	});
+}
+
+// Kernels
+
+namespace {
+
+inline void Update(float t, int id, float &alpha, int &picked) {
+	// nearest hit, ties to lower id (as in linear search)
+	if (t < alpha || (t == alpha && picked >= 0 && id < picked)) {
+		alpha = t;
+		picked = id;
+	}
+}
+
+void IntersectScalar(vec3 p, vec3 d, TriPacket *packets, int nPackets, float &alpha, int &picked) {
+	// operations in same order as vector kernels, for identical results
+	for (int n = 0; n < nPackets; n++) {
+		TriPacket &tp = packets[n];
+		for (int i = 0; i < 8 && tp.ids[i] >= 0; i++) {
+			float e1x = tp.e1[0][i], e1y = tp.e1[1][i], e1z = tp.e1[2][i];
+			float e2x = tp.e2[0][i], e2y = tp.e2[1][i], e2z = tp.e2[2][i];
+			float px = d.y*e2z-d.z*e2y, py = d.z*e2x-d.x*e2z, pz = d.x*e2y-d.y*e2x;
+			float det = e1x*px+e1y*py+e1z*pz;
+			if (det == 0)
+				continue;
+			float inv = 1/det;
+			float tx = p.x-tp.v0[0][i], ty = p.y-tp.v0[1][i], tz = p.z-tp.v0[2][i];
+			float u = (tx*px+ty*py+tz*pz)*inv;
+			float qx = ty*e1z-tz*e1y, qy = tz*e1x-tx*e1z, qz = tx*e1y-ty*e1x;
+			float v = (d.x*qx+d.y*qy+d.z*qz)*inv;
+			float t = (e2x*qx+e2y*qy+e2z*qz)*inv;
+			if (u >= 0 && v >= 0 && u+v <= 1 && t <= alpha)
+				Update(t, tp.ids[i], alpha, picked);
+		}
+	}
+}
+
+#ifdef INTERSECT_X86
+
+TARGET_SSE void IntersectSSE(vec3 p, vec3 d, TriPacket *packets, int nPackets, float &alpha, int &picked) {
+	__m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+	__m128 px0 = _mm_set1_ps(p.x), py0 = _mm_set1_ps(p.y), pz0 = _mm_set1_ps(p.z);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+	for (int n = 0; n < nPackets; n++) {
+		TriPacket &tp = packets[n];
+		for (int h = 0; h < 8 && tp.ids[h] >= 0; h += 4) {
+			__m128 e1x = _mm_loadu_ps(tp.e1[0]+h), e1y = _mm_loadu_ps(tp.e1[1]+h), e1z = _mm_loadu_ps(tp.e1[2]+h);
+			__m128 e2x = _mm_loadu_ps(tp.e2[0]+h), e2y = _mm_loadu_ps(tp.e2[1]+h), e2z = _mm_loadu_ps(tp.e2[2]+h);
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inv = _mm_div_ps(one, det);
+			__m128 tx = _mm_sub_ps(px0, _mm_loadu_ps(tp.v0[0]+h));
+			__m128 ty = _mm_sub_ps(py0, _mm_loadu_ps(tp.v0[1]+h));
+			__m128 tz = _mm_sub_ps(pz0, _mm_loadu_ps(tp.v0[2]+h));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv);
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+			__m128 hit = _mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_cmpge_ps(u, zero));
+			hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+			hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			hit = _mm_and_ps(hit, _mm_cmple_ps(t, _mm_set1_ps(alpha)));
+			int mask = _mm_movemask_ps(hit);
+			if (mask) {
+				alignas(16) float ts[4];
+				_mm_store_ps(ts, t);
+				for (int i = 0; i < 4; i++)
+					if (mask & (1 << i) && tp.ids[h+i] >= 0)
+						Update(ts[i], tp.ids[h+i], alpha, picked);
+			}
+		}
+	}
+}
+
+TARGET_AVX2 void IntersectAVX2(vec3 p, vec3 d, TriPacket *packets, int nPackets, float &alpha, int &picked) {
+	__m256 dx = _mm256_set1_ps(d.x), dy = _mm256_set1_ps(d.y), dz = _mm256_set1_ps(d.z);
+	__m256 px0 = _mm256_set1_ps(p.x), py0 = _mm256_set1_ps(p.y), pz0 = _mm256_set1_ps(p.z);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+	for (int n = 0; n < nPackets; n++) {
+		TriPacket &tp = packets[n];
+		__m256 e1x = _mm256_loadu_ps(tp.e1[0]), e1y = _mm256_loadu_ps(tp.e1[1]), e1z = _mm256_loadu_ps(tp.e1[2]);
+		__m256 e2x = _mm256_loadu_ps(tp.e2[0]), e2y = _mm256_loadu_ps(tp.e2[1]), e2z = _mm256_loadu_ps(tp.e2[2]);
+		__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+		__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+		__m256 inv = _mm256_div_ps(one, det);
+		__m256 tx = _mm256_sub_ps(px0, _mm256_loadu_ps(tp.v0[0]));
+		__m256 ty = _mm256_sub_ps(py0, _mm256_loadu_ps(tp.v0[1]));
+		__m256 tz = _mm256_sub_ps(pz0, _mm256_loadu_ps(tp.v0[2]));
+		__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv);
+		__m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+		__m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+		__m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+		__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv);
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(alpha), _CMP_LE_OQ));
+		int mask = _mm256_movemask_ps(hit);
+		if (mask) {
+			alignas(32) float ts[8];
+			_mm256_store_ps(ts, t);
+			for (int i = 0; i < 8; i++)
+				if (mask & (1 << i) && tp.ids[i] >= 0)
+					Update(ts[i], tp.ids[i], alpha, picked);
+		}
+	}
+}
+
+bool CpuHasSSE2() {
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(_MSC_VER)
+	int r[4];
+	__cpuid(r, 1);
+	return (r[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool CpuHasAVX2() {
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7)
+		return false;
+	__cpuid(r, 1);
+	bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)		// OS must save ymm registers
+		return false;
+	__cpuidex(r, 7, 0);
+	return (r[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // INTERSECT_X86
+
+typedef void (*Kernel)(vec3, vec3, TriPacket *, int, float &, int &);
+
+struct KernelChoice { const char *name; Kernel kernel; };
+
+KernelChoice Choose(const char *name) {
+	// name NULL: fastest supported
+#ifdef INTERSECT_X86
+	if ((!name || !strcmp(name, "avx2")) && CpuHasAVX2())
+		return { "avx2", IntersectAVX2 };
+	if ((!name || !strcmp(name, "avx2") || !strcmp(name, "sse")) && CpuHasSSE2())
+		return { "sse", IntersectSSE };
+#endif
+	return { "scalar", IntersectScalar };
+}
+
+KernelChoice kernel = Choose(NULL);
+
+} // end namespace
+
+void IntersectPackets(vec3 p, vec3 d, TriPacket *packets, int nPackets, float &alpha, int &id) {
+	kernel.kernel(p, d, packets, nPackets, alpha, id);
+}
+
+const char *IntersectKernel() { return kernel.name; }
+
+void SetIntersectKernel(const char *name) { kernel = Choose(name); }
@@ -8,6 +8,8 @@
 #include "IO.h"
 #include "Letters.h"
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
 namespace {
 
@@ -55,175 +57,126 @@ B50034DDEC57007AFFFFFFC30047FFFFFFFF690089FFFFFFFFFFFFFFFFDD2300DD47000000000000
 FF340000000011DDFF47000000000047FF98000000000000FFC3000000000047FFFFFFFFFFC30089FFFF470000000011DDFFDD000000000047FFFFEC1111ECFFFFFFEC110000000000C3FF470000000069FF\
 FFEC69000057D0FFFF47000000000047FF89000000000000FFC30000003489ECFFFFFFFFFFC30089FFFF4700001169DDFFFFFFB534001169ECFFFF890089FFFFFFFFFFC334000034B5FFFF4700003498FFFF";
 
-// transform 2D vertex by view, separate uv from vec4
-const char *vertexShader = R"(
-	#version 130
-	in vec4 point;
-	out vec2 vUv;
-	uniform mat4 view;
-	void main() {
-		gl_Position = view*vec4(point.xy, 0, 1);
-		vUv = point.zw;
-	}
-)";
-
-// opacity depends on darkness of texture map
-const char *pixelShader = R"(
-	#version 130
-	in vec2 vUv;
-	out vec4 pColor;
-	uniform sampler2D textureImage;
-	uniform vec3 color;
-	void main() {
-		float a = texture(textureImage, vUv).r;
-		pColor = vec4(color, 1-a);
-	}
-)";
+// atlas: lower case, upper case, numbers, stacked, each bordered by replicated edge texels
+// (avoids bleeding between images under linear and mipmap filtering)
 
-GLuint shaderProgram = 0, vBufferId = 0;
-GLuint textureNameLower = 0, textureNameUpper = 0, textureNameNumber = 0;
-int textureUnitLower = 2, textureUnitUpper = 3, textureUnitNumber = 4; // this dies if GLUint?!
+struct AtlasImage {
+	const char *hex;
+	int width, height, nChars, x, y;	// x, y: image origin in atlas
+};
 
-} // end namespace
+AtlasImage lowerCase = { lowerCaseImage, 0, 13, 26 }, upperCase = { upperCaseImage, 0, 13, 26 }, numbers = { numberImage, 0, 10, 10 };
 
-int MakeLetterTexture(unsigned char *image) {//, int textureUnit) {
-	// create and load texture raster
-	int nchars = strlen(lowerCaseImage), npixels = nchars/2, height = 13, width = npixels/height;
-	unsigned char *pixels = new unsigned char[3*npixels], *p = pixels, *n = (unsigned char *) image;
-	for (int i = 0; i < npixels; i++) {
-		char c1 = *n++, c2 = *n++;
-		int k1 = c1 < 58? c1-'0' : 10+c1-'A', k2 = c2 < 58? c2-'0' : 10+c2-'A', b = 16*k1+k2;
-		for (int k = 0; k < 3; k++)
-			*p++ = (unsigned char) b;
-	}
-	int textureName = LoadTexture(pixels, width, height, 3);//, textureUnit);
-	delete [] pixels;
-	return textureName;
+const int atlasBorder = 2;
+int atlasWidth = 0, atlasHeight = 0;
+GLuint atlasName = 0;
+
+void Unpack(AtlasImage &a, unsigned char *atlas) {
+	for (int j = -atlasBorder; j < a.height+atlasBorder; j++)
+		for (int i = -atlasBorder; i < a.width+atlasBorder; i++) {
+			int jj = j < 0? 0 : j < a.height? j : a.height-1, ii = i < 0? 0 : i < a.width? i : a.width-1;
+			const char *n = a.hex+2*(jj*a.width+ii);
+			char c1 = n[0], c2 = n[1];
+			int k1 = c1 < 58? c1-'0' : 10+c1-'A', k2 = c2 < 58? c2-'0' : 10+c2-'A';
+			unsigned char *p = atlas+3*((a.y+j)*atlasWidth+a.x+i);
+			p[0] = p[1] = p[2] = (unsigned char) (16*k1+k2);
+		}
 }
 
-int MakeNumberTexture(unsigned char *image) {//, int textureUnit) {
-	// create and load texture raster
-	int nchars = strlen(numberImage), npixels = nchars/2, height = 10, width = npixels/height;
-	unsigned char *pixels = new unsigned char[3*npixels], *p = pixels, *n = (unsigned char *) image;
-	for (int i = 0; i < npixels; i++) {
-		char c1 = *n++, c2 = *n++;
-		int k1 = c1 < 58? c1-'0' : 10+c1-'A', k2 = c2 < 58? c2-'0' : 10+c2-'A', b = 16*k1+k2;
-		for (int k = 0; k < 3; k++)
-			*p++ = (unsigned char) b;
+void MakeAtlas() {
+	AtlasImage *images[] = { &lowerCase, &upperCase, &numbers };
+	atlasWidth = atlasHeight = 0;
+	for (AtlasImage *a : images) {
+		a->width = (int) strlen(a->hex)/2/a->height;
+		a->x = atlasBorder;
+		a->y = atlasHeight+atlasBorder;
+		atlasWidth = a->width+2*atlasBorder > atlasWidth? a->width+2*atlasBorder : atlasWidth;
+		atlasHeight += a->height+2*atlasBorder;
 	}
-	int textureName = LoadTexture(pixels, width, height, 3);//, textureUnit);
+	unsigned char *pixels = new unsigned char[3*atlasWidth*atlasHeight];
+	memset(pixels, 255, 3*atlasWidth*atlasHeight);
+	for (AtlasImage *a : images)
+		Unpack(*a, pixels);
+	atlasName = LoadTexture(pixels, atlasWidth, atlasHeight, 3);
 	delete [] pixels;
-	return textureName;
+	if (!atlasName)
+		printf("can't make letter atlas\n");
 }
 
-void Letter(int x, int y, char c, vec3 color, float ptSize) {
-	if (c < 48 || c == 61 || c == 94) { // 32(space), 40((), 41()), 43(+), 45(-), 46(.), 47(/), 61(=), 94(^)
-		float lineWidth = ptSize/3; // = 2;
-		UseDrawShader(ScreenMode());
-		int size = (int) ptSize, h = (int)(ptSize*.5f), hh = (int)(ptSize*.75f);
-		if (c == 40) {
-			vec2 p1(x+h, y+size+1), p2(x+2, y+(int)(.75f*ptSize)), p3(x+2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
-			Line(p1, p2, lineWidth, color); Line(p2, p3, lineWidth, color); Line(p3, p4, lineWidth, color);
-		}
-		if (c == 41) {
-			vec2 p1(x+h, y+size+1), p2(x+size-2, y+(int)(.75f*ptSize)), p3(x+size-2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
-			Line(p1, p2, lineWidth, color); Line(p2, p3, lineWidth, color); Line(p3, p4, lineWidth, color);
-		}
-		if (c == 61) {
-			Line(x+1, y+h+3, x+h+6, y+h+3, lineWidth, color);
-			Line(x+1, y+h-3, x+h+6, y+h-3, lineWidth, color);
-		}
-		if (c == 43) {
-			Line(x+1, y+h+1, x+h+6, y+h+1, lineWidth, color);
-			Line(x+h, y+2, x+h, y+h+6, lineWidth, color);
-		}
-		if (c == 45) Line(x+1, y+h, x+h+3, y+h, lineWidth, color);
-		if (c == 46) Disk(vec2(x+h, y+3), ptSize/3, color);
-		if (c == 47) Line(x+1, y, x+size-1, y+size, lineWidth, color);
-		if (c == 94) {
-			Line(x+1, y+2, x+h, y+h+4, lineWidth, color);
-			Line(x+h, y+h+4, x+size-2, y+2, lineWidth, color);
-		}
-		return;
+void Punctuation(int x, int y, char c, vec3 color, float ptSize) {
+	// 32(space), 40((), 41()), 43(+), 45(-), 46(.), 47(/), 61(=), 94(^)
+	float lineWidth = ptSize/3; // = 2;
+	UseDrawShader(ScreenMode());
+	int size = (int) ptSize, h = (int)(ptSize*.5f), hh = (int)(ptSize*.75f);
+	if (c == 40) {
+		vec2 p1(x+h, y+size+1), p2(x+2, y+(int)(.75f*ptSize)), p3(x+2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
+		Line(p1, p2, lineWidth, color); Line(p2, p3, lineWidth, color); Line(p3, p4, lineWidth, color);
 	}
-	enum { Upper, Lower, Number, Unknown } type =
-		c >= 65 && c <= 90?  Upper  :
-		c >= 97 && c <= 122? Lower  :
-		c >= 48 && c <= 57?  Number :
-							 Unknown;
-	if (type == Unknown)
-		return;
-	if (!textureNameLower)
-		textureNameLower = MakeLetterTexture((unsigned char *) lowerCaseImage);//, textureUnitLower);
-	if (!textureNameUpper)
-		textureNameUpper = MakeLetterTexture((unsigned char *) upperCaseImage);//, textureUnitUpper);
-	if (!textureNameNumber)
-		textureNameNumber = MakeNumberTexture((unsigned char *) numberImage);//, textureUnitNumber);
-	if (!textureNameLower || !textureNameUpper || !textureNameNumber)
-		printf("can't make texture maps\n");
-	if (!shaderProgram)
-		shaderProgram = LinkProgramViaCode(&vertexShader, &pixelShader);
-	glUseProgram(shaderProgram);
-	if (!vBufferId) {
-		glGenBuffers(1, &vBufferId);
-		glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*6, NULL, GL_DYNAMIC_DRAW);
-			// need 4 vertices for quad, but 6 if triangles
+	if (c == 41) {
+		vec2 p1(x+h, y+size+1), p2(x+size-2, y+(int)(.75f*ptSize)), p3(x+size-2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
+		Line(p1, p2, lineWidth, color); Line(p2, p3, lineWidth, color); Line(p3, p4, lineWidth, color);
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
-	VertexAttribPointer(shaderProgram, "point", 4, 4*sizeof(float), 0);
-		// each vertex is 4 floats, stride is 4 floats
-	int texUnit = type == Upper? textureUnitUpper : type == Lower? textureUnitLower : textureUnitNumber;
-	GLuint texName = type == Upper? textureNameUpper : type == Lower? textureNameLower : textureNameNumber;
-	glActiveTexture(GL_TEXTURE0+texUnit);
-	glBindTexture(GL_TEXTURE_2D, texName);
-	// set screen-mode
-	SetUniform(shaderProgram, "view", ScreenMode());
-	// set text color and texture map, activate texture
-	SetUniform(shaderProgram, "color", color);
-	SetUniform(shaderProgram, "textureImage", texUnit);
-	// enable blended overwrite of color buffer
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	// display character c, value determines horizontal position along texture
-	float w = .8f*ptSize, h = ptSize, xx = (float) x, yy = (float) y;
-	float t = 0, dt = 0;
-	if (type == Number) {
-		int value = c-'0';
-		dt = 1.f/10.f; t = (float) value*dt;
-		float vertices[][4] = { {xx, yy, t, 1}, {xx+w, yy, t+dt, 1}, {xx+w, yy+h, t+dt, 0}, {xx, yy+h, t, 0} };
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+	if (c == 61) {
+		Line(x+1, y+h+3, x+h+6, y+h+3, lineWidth, color);
+		Line(x+1, y+h-3, x+h+6, y+h-3, lineWidth, color);
 	}
-	else {
-		int letterID = type == Upper? c-'A' : type == Lower? c-'a' : c-'0';
-		dt = 1.f/26.f; t = (float)letterID*dt;
-	//	float vertices[][4] = { {xx, yy+h, t, 1}, {xx+w, yy+h, t+dt, 1}, {xx+w, yy, t+dt, 0}, {xx, yy, t, 0} };
-		float vertices[][4] = { {xx, yy, t, 1}, {xx+w, yy, t+dt, 1}, {xx+w, yy+h, t+dt, 0}, {xx, yy+h, t, 0} };
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+	if (c == 43) {
+		Line(x+1, y+h+1, x+h+6, y+h+1, lineWidth, color);
+		Line(x+h, y+2, x+h, y+h+6, lineWidth, color);
+	}
+	if (c == 45) Line(x+1, y+h, x+h+3, y+h, lineWidth, color);
+	if (c == 46) Disk(vec2(x+h, y+3), ptSize/3, color);
+	if (c == 47) Line(x+1, y, x+size-1, y+size, lineWidth, color);
+	if (c == 94) {
+		Line(x+1, y+2, x+h, y+h+4, lineWidth, color);
+		Line(x+h, y+h+4, x+size-2, y+2, lineWidth, color);
 	}
-	// display as one quad or two triangles, mapped to 1/26 width of texture map
-#ifdef GL_QUADS
-	glDrawArrays(GL_QUADS, 0, 4);
-#else
-	float vertices[][4] = {{xx, yy, t, 1}, {xx+w, yy, t+dt, 1},   {xx+w, yy+h, t+dt, 0},
-					       {xx, yy, t, 1}, {xx+w, yy+h, t+dt, 0}, {xx, yy+h, t, 0}};
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-#endif
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void AddLetter(std::vector<vec4> &quads, int x, int y, char c, float ptSize) {
+	// append quad for character c, value determines horizontal position along atlas image
+	AtlasImage *a = c >= 65 && c <= 90?  &upperCase :
+					c >= 97 && c <= 122? &lowerCase :
+					c >= 48 && c <= 57?  &numbers   :
+										 NULL;
+	if (!a)
+		return;
+	int id = c-(a == &upperCase? 'A' : a == &lowerCase? 'a' : '0');
+	float w = .8f*ptSize, h = ptSize, xx = (float) x, yy = (float) y;
+	float u1 = (a->x+(float) id/a->nChars*a->width)/atlasWidth, u2 = (a->x+(float) (id+1)/a->nChars*a->width)/atlasWidth;
+	float vTop = (float) a->y/atlasHeight, vBottom = (float) (a->y+a->height)/atlasHeight;
+	vec4 q[] = { vec4(xx, yy, u1, vBottom), vec4(xx+w, yy, u2, vBottom), vec4(xx+w, yy+h, u2, vTop), vec4(xx, yy+h, u1, vTop) };
+	quads.insert(quads.end(), q, q+4);
+}
+
+} // end namespace
+
 void Letters(int x, int y, const char *letters, vec3 color, float ptSize) {
-	for (int i = 0; i < (int) strlen(letters); i++)
-		Letter((int) (x+i*ptSize), y, letters[i], color, ptSize);
+	// letters are quads into one atlas, drawn with one call; punctuation is batched Line and Disk
+	if (!atlasName)
+		MakeAtlas();
+	bool batched = DrawBatching();
+	if (!batched)
+		BeginDrawBatch();
+	std::vector<vec4> quads;
+	for (int i = 0; i < (int) strlen(letters); i++) {
+		int xx = (int) (x+i*ptSize);
+		char c = letters[i];
+		if (c < 48 || c == 61 || c == 94)
+			Punctuation(xx, y, c, color, ptSize);
+		else
+			AddLetter(quads, xx, y, c, ptSize);
+	}
+	if (quads.size())
+		// opacity depends on darkness of atlas
+		AtlasQuads(atlasName, 1, (int) quads.size()/4, quads.data(), color, ScreenMode());
+	if (!batched)
+		EndDrawBatch();
 }
 
 void Letters(vec3 p, mat4 m, const char *letters, vec3 color, float ptSize) {
 	vec2 pp = ScreenPoint(p, m);
-	for (int i = 0; i < (int) strlen(letters); i++)
-	//	Letter((int) (pp.x+i*10.9f), (int) pp.y, letters[i], color, ptSize);
-		Letter((int) (pp.x+i*ptSize), (int) pp.y, letters[i], color, ptSize);
+	Letters((int) pp.x, (int) pp.y, letters, color, ptSize);
 }
 
 /*	// method to convert image to hexadecimal data
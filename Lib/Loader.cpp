@@ -0,0 +1,184 @@
+// Loader.cpp - background loading of meshes and textures
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "Loader.h"
+
+namespace {
+
+// a job is queued for the worker pool (mutex-protected), parsed and cooked by a worker, then
+// pushed onto a lock-free stack of completed jobs; the GL thread takes the whole stack at once,
+// sorts it by request order and uploads jobs subject to a time budget
+
+struct SharedImage;
+
+struct LoadJob {
+	Mesh *mesh = NULL;
+	string objFile, texFile;
+	bool standardize = true, forceTriangles = false;
+	std::shared_ptr<MeshGeometry> geometry;
+	std::shared_ptr<SharedImage> image;
+	int id = 0;
+	LoadJob *next = NULL;					// in completed stack
+};
+
+std::deque<LoadJob *> jobs;					// waiting for a worker
+std::mutex jobsMutex;
+std::condition_variable jobsReady;
+std::vector<std::thread> workers;
+int nWorkers = 0, nextId = 0;
+bool stopping = false;
+
+std::atomic<LoadJob *> completed(NULL);		// lock-free stack, pushed by workers
+std::map<int, LoadJob *> uploads;			// completed jobs in request order, GL thread only
+std::atomic<int> nPending(0);
+
+// cooked images shared by concurrent loads of the same texture file
+struct SharedImage {
+	std::once_flag cooked;					// later requests wait for the first to cook
+	CookedTexture image;
+};
+std::map<string, std::weak_ptr<SharedImage>> images;
+std::mutex imagesMutex;
+
+void PushCompleted(LoadJob *job) {
+	job->next = completed.load(std::memory_order_relaxed);
+	while (!completed.compare_exchange_weak(job->next, job, std::memory_order_release, std::memory_order_relaxed))
+		;
+}
+
+std::shared_ptr<SharedImage> Cook(const string &texFile) {
+	std::shared_ptr<SharedImage> s;
+	{
+		std::lock_guard<std::mutex> lock(imagesMutex);
+		s = images[texFile].lock();
+		if (!s)
+			images[texFile] = s = std::make_shared<SharedImage>();
+	}
+	std::call_once(s->cooked, [&]() { CookTexture(texFile.c_str(), s->image); });
+	return s;
+}
+
+void Work() {
+	for (;;) {
+		LoadJob *job = NULL;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsReady.wait(lock, []{ return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job->geometry = ReadGeometry(job->objFile, job->standardize, job->forceTriangles);
+		if (!job->texFile.empty())
+			job->image = Cook(job->texFile);
+		PushCompleted(job);
+	}
+}
+
+void Upload(LoadJob *job) {
+	Mesh &m = *job->mesh;
+	if (!job->geometry)
+		printf("LoadAsync: can't read %s\n", job->objFile.c_str());
+	else {
+		m.geometry = job->geometry;
+		m.objFilename = job->objFile;
+		if (!m.geometry->vao)
+			m.Buffer();
+	}
+	if (!job->texFile.empty()) {
+		m.texFilename = job->texFile;
+		ReleaseTexture(m.textureName);
+		m.textureName = ReadTexture(job->texFile.c_str(), job->image->image);
+		if (!m.textureName)
+			printf("LoadAsync: bad texture name\n");
+	}
+	delete job;
+	nPending--;
+}
+
+void TakeCompleted() {
+	for (LoadJob *job = completed.exchange(NULL, std::memory_order_acquire); job; ) {
+		LoadJob *next = job->next;
+		uploads[job->id] = job;
+		job = next;
+	}
+}
+
+} // end namespace
+
+void SetLoaderThreads(int nThreads) { nWorkers = nThreads; }
+
+void LoadAsync(Mesh &mesh, string objFile, mat4 *m, bool standardize, bool forceTriangles) {
+	LoadAsync(mesh, objFile, "", m, standardize, forceTriangles);
+}
+
+void LoadAsync(Mesh &mesh, string objFile, string texFile, mat4 *m, bool standardize, bool forceTriangles) {
+	if (m)
+		mesh.toWorld = *m;
+	LoadJob *job = new LoadJob();
+	job->mesh = &mesh;
+	job->objFile = objFile;
+	job->texFile = texFile;
+	job->standardize = standardize;
+	job->forceTriangles = forceTriangles;
+	job->id = nextId++;
+	nPending++;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = false;
+		jobs.push_back(job);
+	}
+	if (workers.empty()) {
+		int n = nWorkers > 0? nWorkers : (int) std::thread::hardware_concurrency()-1;
+		for (int i = 0; i < (n > 0? n : 1); i++)
+			workers.push_back(std::thread(Work));
+	}
+	jobsReady.notify_one();
+}
+
+int UploadPending(float budgetMs) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	TakeCompleted();
+	while (!uploads.empty()) {
+		Upload(uploads.begin()->second);
+		uploads.erase(uploads.begin());
+		std::chrono::duration<float, std::milli> spent = std::chrono::steady_clock::now()-start;
+		if (spent.count() >= budgetMs)
+			break;
+	}
+	return nPending;
+}
+
+int NPendingLoads() { return nPending; }
+
+void FinishLoads() {
+	while (UploadPending(1000) > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void StopLoader() {
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+		for (LoadJob *job : jobs)
+			delete job;
+		nPending -= (int) jobs.size();
+		jobs.clear();
+	}
+	jobsReady.notify_all();
+	for (std::thread &t : workers)
+		t.join();
+	workers.clear();
+	TakeCompleted();
+	for (std::pair<const int, LoadJob *> &u : uploads)
+		delete u.second;
+	nPending -= (int) uploads.size();
+	uploads.clear();
+}
@@ -3,14 +3,43 @@
 #include "GLXtras.h"
 #include "Draw.h"
 #include "Mesh.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <thread>
 
 namespace {
 
 GLuint meshShaderLines = 0, meshShaderNoLines = 0;
 
+struct MeshUniforms {
+	// uniforms set by Display, resolved once per shader
+	Uniform<bool> useTexture, useInstance, useInstanceColor, stereo;
+	Uniform<int> textureImage;
+	Uniform<mat4> modelview, persp, vp, stereoLeft, stereoRight;
+	Uniform<vec3> color;
+	MeshUniforms(int s = 0) : useTexture(s, "useTexture"), useInstance(s, "useInstance"),
+		useInstanceColor(s, "useInstanceColor"), stereo(s, "stereo"), textureImage(s, "textureImage"),
+		modelview(s, "modelview"), persp(s, "persp"), vp(s, "vp"),
+		stereoLeft(s, "stereoMatrices[0]"), stereoRight(s, "stereoMatrices[1]"), color(s, "color") { }
+	void SetStereo() {
+		stereo.Set(Stereo());
+		if (Stereo()) {
+			stereoLeft.Set(StereoMatrix(0));
+			stereoRight.Set(StereoMatrix(1));
+		}
+	}
+};
+
+MeshUniforms meshUniformsLines, meshUniformsNoLines;
+
+MeshUniforms &GetMeshUniforms(bool lines) { return lines? meshUniformsLines : meshUniformsNoLines; }
+
 // vertex shader
 const char *meshVertexShader = R"(
 	#version 410 core
+)" STEREO_VERTEX_CODE R"(
 	layout (location = 0) in vec3 point;
 	layout (location = 1) in vec3 normal;
 	layout (location = 2) in vec2 uv;
@@ -20,7 +49,7 @@ const char *meshVertexShader = R"(
 	out vec3 vPoint;
 	out vec3 vNormal;
 	out vec2 vUv;
-//	out vec3 vColor;
+	out vec3 vColor;
 	uniform bool useInstance = false;
 	uniform mat4 modelview;
 	uniform mat4 persp;
@@ -28,9 +57,9 @@ const char *meshVertexShader = R"(
 		mat4 m = useInstance? modelview*instance : modelview;
 		vPoint = (m*vec4(point, 1)).xyz;
 		vNormal = (m*vec4(normal, 0)).xyz;
-		gl_Position = persp*vec4(vPoint, 1);
+		gl_Position = StereoPosition(persp*vec4(vPoint, 1));
 		vUv = uv;
-//		vColor = color;
+		vColor = color;
 	}
 )";
 
@@ -39,9 +68,9 @@ const char *meshGeometryShader = R"(
 	#version 410 core
 	layout (triangles) in;
 	layout (triangle_strip, max_vertices = 3) out;
-	in vec3 vPoint[], vNormal[];
+	in vec3 vPoint[], vNormal[], vColor[];
 	in vec2 vUv[];
-	out vec3 gPoint, gNormal;
+	out vec3 gPoint, gNormal, gColor;
 	out vec2 gUv;
 	noperspective out vec3 gEdgeDistance;
 	uniform mat4 vp;
@@ -63,7 +92,9 @@ const char *meshGeometryShader = R"(
 			gPoint = vPoint[i];
 			gNormal = vNormal[i];
 			gUv = vUv[i];
+			gColor = vColor[i];
 			gl_Position = gl_in[i].gl_Position;
+			gl_ClipDistance[0] = gl_in[i].gl_ClipDistance[0];
 			EmitVertex();
 		}
 		EndPrimitive();
@@ -73,7 +104,7 @@ const char *meshGeometryShader = R"(
 // pixel shader
 const char *meshPixelShaderLines = R"(
 	#version 410 core
-	in vec3 gPoint, gNormal;
+	in vec3 gPoint, gNormal, gColor;
 	in vec2 gUv;
 	noperspective in vec3 gEdgeDistance;
 	uniform sampler2D textureImage;
@@ -81,6 +112,7 @@ const char *meshPixelShaderLines = R"(
 	uniform vec3 lights[20];
 	uniform vec3 defaultLight = vec3(1, 1, 1);
 	uniform vec3 color = vec3(1);
+	uniform bool useInstanceColor = false;
 	uniform float opacity = 1;
 	uniform float ambient = .2;
 	uniform bool useLight = true;
@@ -113,16 +145,17 @@ const char *meshPixelShaderLines = R"(
 					intensity += Intensity(N, E, gPoint, lights[i]);
 		}
 		intensity = clamp(intensity, 0, 1);
+		vec3 c = useInstanceColor? gColor : color;
 		if (useTexture) {
 			pColor = vec4(intensity*texture(textureImage, gUv).rgb, opacity);
 			if (useTint) {
-				pColor.r *= color.r;
-				pColor.g *= color.g;
-				pColor.b *= color.b;
+				pColor.r *= c.r;
+				pColor.g *= c.g;
+				pColor.b *= c.b;
 			}
 		}
 		else
-			pColor = vec4(intensity*color, opacity);
+			pColor = vec4(intensity*c, opacity);
 		float minDist = min(gEdgeDistance.x, gEdgeDistance.y);
 		minDist = min(minDist, gEdgeDistance.z);
 		float t = smoothstep(outlineWidth-outlineTransition, outlineWidth+outlineTransition, minDist);
@@ -133,7 +166,7 @@ const char *meshPixelShaderLines = R"(
 
 const char *meshPixelShaderNoLines = R"(
 	#version 410 core
-	in vec3 vPoint, vNormal;
+	in vec3 vPoint, vNormal, vColor;
 	in vec2 vUv;
 	uniform mat4 persp;
 	uniform sampler2D textureImage;
@@ -141,6 +174,7 @@ const char *meshPixelShaderNoLines = R"(
 	uniform vec3 lights[20];
 	uniform vec3 defaultLight = vec3(1, 1, 1);
 	uniform vec3 color = vec3(1, 1, 1);
+	uniform bool useInstanceColor = false;
 	uniform float opacity = 1;
 	uniform float ambient = .2;
 	uniform bool useLight = true;
@@ -179,16 +213,17 @@ const char *meshPixelShaderNoLines = R"(
 					Intensity(lights[i]);
 			ads = clamp(amb+dif*d, 0, 1)+spc*s;
 		}
+		vec3 c = useInstanceColor? vColor : color;
 		if (useTexture) {
 			pColor = vec4(ads*texture(textureImage, vUv).rgb, opacity);
 			if (useTint) {
-				pColor.r *= color.r;
-				pColor.g *= color.g;
-				pColor.b *= color.b;
+				pColor.r *= c.r;
+				pColor.g *= c.g;
+				pColor.b *= c.b;
 			}
 		}
 		else
-			pColor = vec4(ads*color, opacity);
+			pColor = vec4(ads*c, opacity);
 	}
 )";
 
@@ -198,13 +233,17 @@ const char *GetMeshPixelShaderNoLines() { return meshPixelShaderNoLines; }
 
 GLuint GetMeshShader(bool lines) {
 	if (lines) {
-		if (!meshShaderLines)
+		if (!meshShaderLines) {
 			meshShaderLines = LinkProgramViaCode(&meshVertexShader, NULL, NULL, &meshGeometryShader, &meshPixelShaderLines);
+			meshUniformsLines = MeshUniforms(meshShaderLines);
+		}
 		return meshShaderLines;
 	}
 	else {
-		if (!meshShaderNoLines)
+		if (!meshShaderNoLines) {
 			meshShaderNoLines = LinkProgramViaCode(&meshVertexShader, &meshPixelShaderNoLines);
+			meshUniformsNoLines = MeshUniforms(meshShaderNoLines);
+		}
 		return meshShaderNoLines;
 	}
 }
@@ -215,6 +254,55 @@ GLuint UseMeshShader(bool lines) {
 	return s;
 }
 
+// Mesh Geometry
+
+namespace {
+
+std::map<string, std::weak_ptr<MeshGeometry>> geometries;	// obj filename+options to shared geometry
+std::mutex geometriesMutex;
+
+void PruneGeometries() {
+	// erase entries whose geometry has been released; caller holds geometriesMutex
+	for (std::map<string, std::weak_ptr<MeshGeometry>>::iterator it = geometries.begin(); it != geometries.end(); )
+		if (it->second.expired())
+			it = geometries.erase(it);
+		else
+			it++;
+}
+
+} // end namespace
+
+std::shared_ptr<MeshGeometry> ReadGeometry(string objFile, bool standardize, bool forceTriangles) {
+	string key = objFile+(standardize? "|s" : "|")+(forceTriangles? "t" : "");
+	{
+		std::lock_guard<std::mutex> lock(geometriesMutex);
+		std::map<string, std::weak_ptr<MeshGeometry>>::iterator it = geometries.find(key);
+		if (it != geometries.end())
+			if (std::shared_ptr<MeshGeometry> g = it->second.lock())
+				return g;
+	}
+	// parse without lock; if another thread reads the same file meanwhile, first to finish is kept
+	std::shared_ptr<MeshGeometry> g = std::make_shared<MeshGeometry>();
+	if (!ReadObj(objFile.c_str(), g->points, g->triangles, &g->normals, &g->uvs, &g->triangleGroups, &g->triangleMtls, forceTriangles? NULL : &g->quads))
+		return NULL;
+	g->objFilename = objFile;
+	if (standardize)
+		Standardize(g->points.data(), g->points.size(), 1);
+	std::lock_guard<std::mutex> lock(geometriesMutex);
+	if (std::shared_ptr<MeshGeometry> first = geometries[key].lock())
+		return first;
+	PruneGeometries();
+	geometries[key] = g;
+	return g;
+}
+
+MeshGeometry::~MeshGeometry() {
+	if (vBufferId) glDeleteBuffers(1, &vBufferId);
+	if (eBufferId) glDeleteBuffers(1, &eBufferId);
+	if (iBufferId) glDeleteBuffers(1, &iBufferId);
+	if (vao) glDeleteVertexArrays(1, &vao);
+}
+
 // Mesh Class
 
 void Mesh::SetToWorld() {
@@ -240,50 +328,132 @@ bool Mesh::SetWrtParent() {
 }
 
 void Mesh::Display(Camera camera, int textureUnit, bool lines, bool useGroupColor) {
-	size_t nTris = triangles.size(), nQuads = quads.size();
+	MeshGeometry &g = *geometry;
+	size_t nTris = g.triangles.size(), nQuads = g.quads.size();
 	// enable shader and vertex array object
 	int shader = UseMeshShader(lines);
-	glBindVertexArray(vao);
+	MeshUniforms &u = GetMeshUniforms(lines);
+	glBindVertexArray(g.vao);
 	// texture
-	bool useTexture = textureName > 0 && uvs.size() > 0 && textureUnit >= 0;
+	bool useTexture = textureName > 0 && g.uvs.size() > 0 && textureUnit >= 0;
 //	if (!textureName || !uvs.size() || textureUnit < 0)
 //		SetUniform(shader, "useTexture", false);
 //	else {
-	SetUniform(shader, "useTexture", useTexture);
+	u.useTexture.Set(useTexture);
 	if (useTexture) {
 		glActiveTexture(GL_TEXTURE0+textureUnit);
 		glBindTexture(GL_TEXTURE_2D, textureName);
-		SetUniform(shader, "textureImage", textureUnit); // but app can unset useTexture
+		u.textureImage.Set(textureUnit); // but app can unset useTexture
 	}
 	// set matrices
-	SetUniform(shader, "modelview", camera.modelview*toWorld);
-	SetUniform(shader, "persp", camera.persp);
+	u.modelview.Set(camera.modelview*toWorld);
+	u.persp.Set(camera.persp);
 	if (lines)
-		SetUniform(shader, "vp", Viewport());
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eBufferId);
+		u.vp.Set(Viewport());
+	u.SetStereo();
+	int nEyes = StereoInstances();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.eBufferId);
 	if (useGroupColor) {
 		int textureSet = 0;
-		glGetUniformiv(shader, glGetUniformLocation(shader, "useTexture"), &textureSet);
+		glGetUniformiv(shader, u.useTexture.Id(), &textureSet);
 		// show ungrouped triangles without texture mapping
-		int nGroups = triangleGroups.size(), nUngrouped = nGroups? triangleGroups[0].startTriangle : nTris;
-		SetUniform(shader, "useTexture", false);
-		glDrawElements(GL_TRIANGLES, 3*nUngrouped, GL_UNSIGNED_INT, 0); // triangles.data());
+		int nGroups = g.triangleGroups.size(), nUngrouped = nGroups? g.triangleGroups[0].startTriangle : nTris;
+		u.useTexture.Set(false);
+		glDrawElementsInstanced(GL_TRIANGLES, 3*nUngrouped, GL_UNSIGNED_INT, 0, nEyes); // triangles.data());
 		// show grouped triangles with texture mapping
-		SetUniform(shader, "useTexture", textureSet == 1);
+		u.useTexture.Set(textureSet == 1);
 		for (int i = 0; i < nGroups; i++) {
-			Group g = triangleGroups[i];
-			SetUniform(shader, "color", g.color);
-			glDrawElements(GL_TRIANGLES, 3*g.nTriangles, GL_UNSIGNED_INT, (void *) (3*g.startTriangle*sizeof(int)));
+			Group &group = g.triangleGroups[i];
+			u.color.Set(group.color);
+			glDrawElementsInstanced(GL_TRIANGLES, 3*group.nTriangles, GL_UNSIGNED_INT, (void *) (3*group.startTriangle*sizeof(int)), nEyes);
 		}
 	}
 	else {
-		glDrawElements(GL_TRIANGLES, 3*nTris, GL_UNSIGNED_INT, 0);
+		glDrawElementsInstanced(GL_TRIANGLES, 3*nTris, GL_UNSIGNED_INT, 0, nEyes);
+#ifdef GL_QUADS
+		// quads follow triangles in the element buffer; instanced so each eye draws them
+		if (nQuads)
+			glDrawElementsInstanced(GL_QUADS, 4*nQuads, GL_UNSIGNED_INT, (void *) (nTris*sizeof(int3)), nEyes);
+#endif
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::DisplayInstanced(Camera camera, vector<mat4> &transforms, vector<vec3> *colors, int textureUnit, bool lines) {
+	MeshGeometry &g = *geometry;
+	int nInstances = transforms.size(), nTris = g.triangles.size(), nQuads = g.quads.size();
+	bool useColors = colors && (int) colors->size() >= nInstances;
+	if (!nInstances || (!nTris && !nQuads) || !g.vao)
+		return;
+	UseMeshShader(lines);
+	MeshUniforms &u = GetMeshUniforms(lines);
+	glBindVertexArray(g.vao);
+	// texture
+	bool useTexture = textureName > 0 && g.uvs.size() > 0 && textureUnit >= 0;
+	u.useTexture.Set(useTexture);
+	if (useTexture) {
+		glActiveTexture(GL_TEXTURE0+textureUnit);
+		glBindTexture(GL_TEXTURE_2D, textureName);
+		u.textureImage.Set(textureUnit);
+	}
+	// stream instance data: orphan last frame's storage, then fill
+	// VecMat matrices are row-major, shader attributes column-major
+	size_t sizeMats = nInstances*sizeof(mat4), sizeColors = useColors? nInstances*sizeof(vec3) : 0;
+	size_t size = sizeMats+sizeColors;
+	if (!g.iBufferId)
+		glGenBuffers(1, &g.iBufferId);
+	glBindBuffer(GL_ARRAY_BUFFER, g.iBufferId);
+	if (size > g.iBufferSize)
+		g.iBufferSize = std::max(size, 2*g.iBufferSize);
+	glBufferData(GL_ARRAY_BUFFER, g.iBufferSize, NULL, GL_STREAM_DRAW);
+	mat4 *mats = (mat4 *) glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!mats) {
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+		return;
+	}
+	for (int i = 0; i < nInstances; i++)
+		mats[i] = Transpose(transforms[i]);
+	if (useColors)
+		memcpy((char *) mats+sizeMats, colors->data(), sizeColors);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	// instance attributes: mat4 at locations 3-6, color at 7, advanced once per instance (per eye pair if stereo)
+	int nEyes = StereoInstances();
+	for (int k = 0; k < 4; k++) {
+		glEnableVertexAttribArray(3+k);
+		glVertexAttribPointer(3+k, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void *) (k*sizeof(vec4)));
+		glVertexAttribDivisor(3+k, nEyes);
+	}
+	if (useColors) {
+		glEnableVertexAttribArray(7);
+		glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void *) sizeMats);
+		glVertexAttribDivisor(7, nEyes);
+	}
+	// set matrices
+	u.modelview.Set(camera.modelview);
+	u.persp.Set(camera.persp);
+	if (lines)
+		u.vp.Set(Viewport());
+	u.useInstance.Set(true);
+	u.useInstanceColor.Set(useColors);
+	u.SetStereo();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.eBufferId);
+	if (nTris)
+		glDrawElementsInstanced(GL_TRIANGLES, 3*nTris, GL_UNSIGNED_INT, 0, nEyes*nInstances);
 #ifdef GL_QUADS
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		glDrawElements(GL_QUADS, 4*nQuads, GL_UNSIGNED_INT, quads.data());
+	if (nQuads)
+		glDrawElementsInstanced(GL_QUADS, 4*nQuads, GL_UNSIGNED_INT, (void *) (nTris*sizeof(int3)), nEyes*nInstances);
 #endif
+	// restore non-instanced state
+	u.useInstance.Set(false);
+	u.useInstanceColor.Set(false);
+	for (int k = 3; k < 8; k++) {
+		glVertexAttribDivisor(k, 0);
+		glDisableVertexAttribArray(k);
 	}
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
 
@@ -295,10 +465,11 @@ void Enable(int id, int ncomps, int offset) {
 void Mesh::Buffer(vector<vec3> &pts, vector<vec3> *nrms, vector<vec2> *tex) {
 	size_t nPts = pts.size(), nNrms = nrms? nrms->size() : 0, nUvs = tex? tex->size() : 0;
 	if (!nPts) { printf("Buffer: no points!\n"); return; }
+	MeshGeometry &g = *geometry;
 	// create vertex buffer
-	if (!vBufferId)
-		glGenBuffers(1, &vBufferId);
-	glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
+	if (!g.vBufferId)
+		glGenBuffers(1, &g.vBufferId);
+	glBindBuffer(GL_ARRAY_BUFFER, g.vBufferId);
 	// allocate GPU memory for vertex position, texture, normals
 	size_t sizePoints = nPts*sizeof(vec3), sizeNormals = nNrms*sizeof(vec3), sizeUvs = nUvs*sizeof(vec2);
 	int bufferSize = sizePoints+sizeUvs+sizeNormals;
@@ -307,14 +478,18 @@ void Mesh::Buffer(vector<vec3> &pts, vector<vec3> *nrms, vector<vec2> *tex) {
 	if (nPts) glBufferSubData(GL_ARRAY_BUFFER, 0, sizePoints, pts.data());
 	if (nNrms) glBufferSubData(GL_ARRAY_BUFFER, sizePoints, sizeNormals, nrms->data());
 	if (nUvs) glBufferSubData(GL_ARRAY_BUFFER, sizePoints+sizeNormals, sizeUvs, tex->data());
-	// create and load element buffer for triangles
-	size_t sizeTriangles = sizeof(int3)*triangles.size();
-	glGenBuffers(1, &eBufferId);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eBufferId);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeTriangles, triangles.data(), GL_STATIC_DRAW);
+	// create and load element buffer for triangles, then quads
+	size_t sizeTriangles = sizeof(int3)*g.triangles.size(), sizeQuads = sizeof(int4)*g.quads.size();
+	if (!g.eBufferId)
+		glGenBuffers(1, &g.eBufferId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.eBufferId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeTriangles+sizeQuads, NULL, GL_STATIC_DRAW);
+	if (sizeTriangles) glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeTriangles, g.triangles.data());
+	if (sizeQuads) glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeTriangles, sizeQuads, g.quads.data());
 	// create vertex array object for mesh
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	if (!g.vao)
+		glGenVertexArrays(1, &g.vao);
+	glBindVertexArray(g.vao);
 	// enable attributes
 	if (nPts) Enable(0, 3, 0);						// VertexAttribPointer(shader, "point", 3, 0, (void *) 0);
 	if (nNrms) Enable(1, 3, sizePoints);			// VertexAttribPointer(shader, "normal", 3, 0, (void *) sizePoints);
@@ -324,18 +499,19 @@ void Mesh::Buffer(vector<vec3> &pts, vector<vec3> *nrms, vector<vec2> *tex) {
 }
 
 void Mesh::Clear() {
-	points.resize(0);
-	normals.resize(0);
-	uvs.resize(0);
-	triangles.resize(0);
-	quads.resize(0);
-	triangleGroups.resize(0);
-	triangleMtls.resize(0);
+	geometry = std::make_shared<MeshGeometry>();
 }
 
-void Mesh::Buffer() { Buffer(points, normals.size()? &normals : NULL, uvs.size()? &uvs : NULL); }
+void Mesh::Buffer() {
+	MeshGeometry &g = *geometry;
+	Buffer(g.points, g.normals.size()? &g.normals : NULL, g.uvs.size()? &g.uvs : NULL);
+}
 
 void Mesh::Set(vector<vec3> &pts, vector<vec3> *nrms, vector<vec2> *tex, vector<int> *tris, vector<int> *quas) {
+	if (geometry.use_count() > 1)
+		Clear();							// don't modify geometry shared with other meshes
+	vector<int3> &triangles = geometry->triangles;
+	vector<int4> &quads = geometry->quads;
 	if (tris) {
 		triangles.resize(tris->size()/3);
 		for (int i = 0; i < (int) triangles.size(); i++)
@@ -350,14 +526,14 @@ void Mesh::Set(vector<vec3> &pts, vector<vec3> *nrms, vector<vec2> *tex, vector<
 }
 
 bool Mesh::Read(string objFile, mat4 *m, bool standardize, bool buffer, bool forceTriangles) {
-	if (!ReadAsciiObj((char *) objFile.c_str(), points, triangles, &normals, &uvs, &triangleGroups, &triangleMtls, forceTriangles? NULL : &quads, NULL)) {
+	std::shared_ptr<MeshGeometry> g = ReadGeometry(objFile, standardize, forceTriangles);
+	if (!g) {
 		printf("Mesh.Read: can't read %s\n", objFile.c_str());
 		return false;
 	}
+	geometry = g;
 	objFilename = objFile;
-	if (standardize)
-		Standardize(points.data(), points.size(), 1);
-	if (buffer)
+	if (buffer && !g->vao)
 		Buffer();
 	if (m)
 		toWorld = *m;
@@ -369,6 +545,7 @@ bool Mesh::Read(string objFile, string texFile, mat4 *m, bool standardize, bool
 		return false;
 	objFilename = objFile;
 	texFilename = texFile;
+	ReleaseTexture(textureName);
 	textureName = ReadTexture((char *) texFile.c_str());
 	if (!textureName)
 		printf("Mesh.Read: bad texture name\n");
@@ -468,9 +645,269 @@ void BuildQuadInfos(vector<vec3> &points, vector<int4> &quads, vector<QuadInfo>
 		quadInfos[i] = QuadInfo(points[quads[i].i1], points[quads[i].i2], points[quads[i].i3], points[quads[i].i4]);
 }
 
-void Mesh::BuildInfos() {
-	BuildTriInfos(points, triangles, triInfos);
-	BuildQuadInfos(points, quads, quadInfos);
+void BVHLeaves(BVH &bvh, vector<int2> &leaves) {
+	leaves.resize(bvh.nodes.size());
+	for (size_t i = 0; i < bvh.nodes.size(); i++)
+		leaves[i] = int2(bvh.nodes[i].start, bvh.nodes[i].count);
+}
+
+void Mesh::BuildInfos(bool parallelBVH) {
+	MeshGeometry &g = *geometry;
+	BuildTriInfos(g.points, g.triangles, g.triInfos);
+	BuildQuadInfos(g.points, g.quads, g.quadInfos);
+	g.triBVH.Build(g.points, g.triangles, parallelBVH);
+	g.quadBVH.Build(g.points, g.quads, parallelBVH);
+	vector<int2> triLeaves, quadLeaves;
+	BVHLeaves(g.triBVH, triLeaves);
+	BVHLeaves(g.quadBVH, quadLeaves);
+	g.triPackets.Build(g.points, g.triangles, g.triBVH.indices, triLeaves);
+	g.quadPackets.Build(g.points, g.quads, g.quadBVH.indices, quadLeaves);
+}
+
+// BVH
+
+namespace {
+
+struct PrimBounds { vec3 min, max, center; };
+
+const int nBins = 12, maxLeafCount = 4, maxDepth = 48, minParallelCount = 4096;
+
+float HalfArea(vec3 d) { return d.x*d.y+d.y*d.z+d.z*d.x; }
+
+void Expand(vec3 &min, vec3 &max, const vec3 &p) {
+	min = vec3(p.x < min.x? p.x : min.x, p.y < min.y? p.y : min.y, p.z < min.z? p.z : min.z);
+	max = vec3(p.x > max.x? p.x : max.x, p.y > max.y? p.y : max.y, p.z > max.z? p.z : max.z);
+}
+
+int BuildNode(vector<PrimBounds> &prims, int *indices, int start, int count, vector<BVHNode> &nodes, int depth, int parallelDepth) {
+	// append node for indices[start, start+count) and its descendants, return node index
+	int n = nodes.size();
+	nodes.push_back(BVHNode());
+	vec3 min(FLT_MAX), max(-FLT_MAX), cmin(FLT_MAX), cmax(-FLT_MAX);
+	for (int i = start; i < start+count; i++) {
+		PrimBounds &b = prims[indices[i]];
+		Expand(min, max, b.min);
+		Expand(min, max, b.max);
+		Expand(cmin, cmax, b.center);
+	}
+	nodes[n].min = min;
+	nodes[n].max = max;
+	nodes[n].start = start;
+	nodes[n].count = count;
+	if (count <= maxLeafCount || depth >= maxDepth)
+		return n;
+	// split along axis of greatest centroid extent
+	vec3 extent = cmax-cmin;
+	int axis = extent.x > extent.y? (extent.x > extent.z? 0 : 2) : (extent.y > extent.z? 1 : 2);
+	float lo = cmin[axis], width = extent[axis];
+	int mid = start+count/2;
+	if (width > 0) {
+		// bin centroids, choose split with least surface area heuristic cost
+		int binCounts[nBins] = {0};
+		vec3 binMins[nBins], binMaxs[nBins];
+		for (int b = 0; b < nBins; b++)
+			binMins[b] = vec3(FLT_MAX), binMaxs[b] = vec3(-FLT_MAX);
+		auto Bin = [&](int i) { int b = (int) (nBins*(prims[i].center[axis]-lo)/width); return b < nBins? b : nBins-1; };
+		for (int i = start; i < start+count; i++) {
+			int p = indices[i], b = Bin(p);
+			binCounts[b]++;
+			Expand(binMins[b], binMaxs[b], prims[p].min);
+			Expand(binMins[b], binMaxs[b], prims[p].max);
+		}
+		float rightCosts[nBins];
+		vec3 rmin(FLT_MAX), rmax(-FLT_MAX);
+		for (int b = nBins-1, nRight = 0; b > 0; b--) {
+			nRight += binCounts[b];
+			Expand(rmin, rmax, binMins[b]);
+			Expand(rmin, rmax, binMaxs[b]);
+			rightCosts[b] = nRight? nRight*HalfArea(rmax-rmin) : 0;
+		}
+		float bestCost = FLT_MAX;
+		int bestBin = 0;
+		vec3 lmin(FLT_MAX), lmax(-FLT_MAX);
+		for (int b = 1, nLeft = 0; b < nBins; b++) {
+			nLeft += binCounts[b-1];
+			Expand(lmin, lmax, binMins[b-1]);
+			Expand(lmin, lmax, binMaxs[b-1]);
+			float cost = (nLeft? nLeft*HalfArea(lmax-lmin) : 0)+rightCosts[b];
+			if (nLeft && nLeft < count && cost < bestCost) {
+				bestCost = cost;
+				bestBin = b;
+			}
+		}
+		// cost relative to a leaf of count primitives (traversal cost = 1 primitive test)
+		float area = HalfArea(max-min);
+		if (bestBin && area > 0 && 1+bestCost/area >= count && count <= 4*maxLeafCount)
+			return n;
+		if (bestBin)
+			mid = (int) (std::partition(indices+start, indices+start+count, [&](int i) { return Bin(i) < bestBin; })-indices);
+	}
+	else
+		if (count <= 4*maxLeafCount)
+			return n;						// coincident centroids: no useful split
+	nodes[n].count = 0;
+	int nLeft = mid-start, nRight = count-nLeft;
+	if (parallelDepth > 0 && count >= minParallelCount) {
+		vector<BVHNode> rightNodes;
+		std::thread t(BuildNode, std::ref(prims), indices, mid, nRight, std::ref(rightNodes), depth+1, parallelDepth-1);
+		int left = BuildNode(prims, indices, start, nLeft, nodes, depth+1, parallelDepth-1);
+		t.join();
+		int offset = nodes.size();
+		for (BVHNode &r : rightNodes) {
+			if (!r.count) {
+				r.left += offset;
+				r.right += offset;
+			}
+			nodes.push_back(r);
+		}
+		nodes[n].left = left;
+		nodes[n].right = offset;
+	}
+	else {
+		int left = BuildNode(prims, indices, start, nLeft, nodes, depth+1, 0);
+		int right = BuildNode(prims, indices, mid, nRight, nodes, depth+1, 0);
+		nodes[n].left = left;
+		nodes[n].right = right;
+	}
+	return n;
+}
+
+void BuildBVH(BVH &bvh, vector<PrimBounds> &prims, bool parallel) {
+	int nPrims = prims.size();
+	bvh.nodes.resize(0);
+	bvh.indices.resize(nPrims);
+	for (int i = 0; i < nPrims; i++)
+		bvh.indices[i] = i;
+	if (!nPrims)
+		return;
+	bvh.nodes.reserve(2*nPrims/maxLeafCount+1);
+	BuildNode(prims, bvh.indices.data(), 0, nPrims, bvh.nodes, 0, parallel? 3 : 0);
+	// pad bounds so intersections computed by LineIntersectPlane are not culled by roundoff
+	vec3 rmin = bvh.nodes[0].min, rmax = bvh.nodes[0].max;
+	float maxAbs = std::max(std::max(std::max(fabs(rmin.x), fabs(rmin.y)), fabs(rmin.z)), std::max(std::max(fabs(rmax.x), fabs(rmax.y)), fabs(rmax.z)));
+	vec3 pad(1e-4f*length(rmax-rmin)+1e-6f*maxAbs+FLT_MIN);
+	for (BVHNode &node : bvh.nodes) {
+		node.min = node.min-pad;
+		node.max = node.max+pad;
+	}
+}
+
+bool LineBox(vec3 &p, vec3 &d, vec3 &min, vec3 &max, float &tmin, float &tmax) {
+	// interval of line p+t*d within box
+	tmin = -FLT_MAX;
+	tmax = FLT_MAX;
+	for (int k = 0; k < 3; k++) {
+		if (d[k] == 0) {
+			if (p[k] < min[k] || p[k] > max[k])
+				return false;
+			continue;
+		}
+		float t1 = (min[k]-p[k])/d[k], t2 = (max[k]-p[k])/d[k];
+		if (t1 > t2) std::swap(t1, t2);
+		if (t1 > tmin) tmin = t1;
+		if (t2 < tmax) tmax = t2;
+		if (tmin > tmax)
+			return false;
+	}
+	return true;
+}
+
+template<class Leaf>
+int Traverse(vec3 p1, vec3 p2, BVH &bvh, float &retAlpha, Leaf leaf) {
+	// leaf(n, minAlpha, picked) tests primitives of leaf node n, updating nearest hit; visit nodes
+	// in order of entry, cull nodes entered beyond nearest hit
+	int picked = -1;
+	float minAlpha = FLT_MAX;
+	if (bvh.nodes.empty()) {
+		retAlpha = minAlpha;
+		return picked;
+	}
+	vec3 d = p2-p1;
+	struct Entry { int node; float tmin; } stack[maxDepth+2];
+	int nStack = 0;
+	float tmin, tmax;
+	if (LineBox(p1, d, bvh.nodes[0].min, bvh.nodes[0].max, tmin, tmax))
+		stack[nStack++] = { 0, tmin };
+	while (nStack) {
+		Entry e = stack[--nStack];
+		if (e.tmin > minAlpha)
+			continue;
+		BVHNode &node = bvh.nodes[e.node];
+		if (node.count) {
+			leaf(e.node, minAlpha, picked);
+			continue;
+		}
+		float t1min, t2min;
+		bool h1 = LineBox(p1, d, bvh.nodes[node.left].min, bvh.nodes[node.left].max, t1min, tmax);
+		bool h2 = LineBox(p1, d, bvh.nodes[node.right].min, bvh.nodes[node.right].max, t2min, tmax);
+		// push farther child first
+		if (h1 && h2) {
+			bool leftFirst = t1min <= t2min;
+			stack[nStack++] = leftFirst? Entry{ node.right, t2min } : Entry{ node.left, t1min };
+			stack[nStack++] = leftFirst? Entry{ node.left, t1min } : Entry{ node.right, t2min };
+		}
+		else if (h1)
+			stack[nStack++] = { node.left, t1min };
+		else if (h2)
+			stack[nStack++] = { node.right, t2min };
+	}
+	retAlpha = minAlpha;
+	return picked;
+}
+
+template<class Hit>
+int TraverseHits(vec3 p1, vec3 p2, BVH &bvh, float &retAlpha, Hit hit) {
+	// hit(i, alpha) true if line intersects primitive i at alpha; ties resolve to lower index as in linear search
+	return Traverse(p1, p2, bvh, retAlpha, [&](int n, float &minAlpha, int &picked) {
+		BVHNode &node = bvh.nodes[n];
+		for (int k = node.start; k < node.start+node.count; k++) {
+			int i = bvh.indices[k];
+			float alpha;
+			if (hit(i, alpha) && (alpha < minAlpha || (alpha == minAlpha && picked >= 0 && i < picked))) {
+				minAlpha = alpha;
+				picked = i;
+			}
+		}
+	});
+}
+
+} // end namespace
+
+void BVH::Build(vector<vec3> &mins, vector<vec3> &maxs, bool parallel) {
+	vector<PrimBounds> prims(mins.size());
+	for (size_t i = 0; i < mins.size(); i++) {
+		prims[i].min = mins[i];
+		prims[i].max = maxs[i];
+		prims[i].center = .5f*(mins[i]+maxs[i]);
+	}
+	BuildBVH(*this, prims, parallel);
+}
+
+void BVH::Build(vector<vec3> &points, vector<int3> &triangles, bool parallel) {
+	vector<PrimBounds> prims(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++) {
+		PrimBounds &b = prims[i];
+		vec3 &p1 = points[triangles[i].i1], &p2 = points[triangles[i].i2], &p3 = points[triangles[i].i3];
+		b.min = b.max = p1;
+		Expand(b.min, b.max, p2);
+		Expand(b.min, b.max, p3);
+		b.center = .5f*(b.min+b.max);
+	}
+	BuildBVH(*this, prims, parallel);
+}
+
+void BVH::Build(vector<vec3> &points, vector<int4> &quads, bool parallel) {
+	vector<PrimBounds> prims(quads.size());
+	for (size_t i = 0; i < quads.size(); i++) {
+		PrimBounds &b = prims[i];
+		int4 &q = quads[i];
+		b.min = b.max = points[q.i1];
+		Expand(b.min, b.max, points[q.i2]);
+		Expand(b.min, b.max, points[q.i3]);
+		Expand(b.min, b.max, points[q.i4]);
+		b.center = .5f*(b.min+b.max);
+	}
+	BuildBVH(*this, prims, parallel);
 }
 
 int IntersectWithLine(vec3 p1, vec3 p2, vector<TriInfo> &triInfos, float &retAlpha) {
@@ -510,19 +947,50 @@ int IntersectWithLine(vec3 p1, vec3 p2, vector<QuadInfo> &quadInfos, float &retA
 	return picked;
 }
 
-bool Mesh::IntersectWithSegment(vec3 p1, vec3 p2, float *alpha) {
-	if (triInfos.size() == 0 && quadInfos.size() == 0)
+int IntersectWithLine(vec3 p1, vec3 p2, vector<TriInfo> &triInfos, BVH &bvh, float &retAlpha) {
+	return TraverseHits(p1, p2, bvh, retAlpha, [&](int i, float &alpha) {
+		TriInfo &t = triInfos[i];
+		vec3 inter;
+		return LineIntersectPlane(p1, p2, t.plane, &inter, &alpha) &&
+			   IsInside(MajPln(inter, t.majorPlane), t.p1, t.p2, t.p3);
+	});
+}
+
+int IntersectWithLine(vec3 p1, vec3 p2, vector<QuadInfo> &quadInfos, BVH &bvh, float &retAlpha) {
+	return TraverseHits(p1, p2, bvh, retAlpha, [&](int i, float &alpha) {
+		QuadInfo &q = quadInfos[i];
+		vec3 inter;
+		return LineIntersectPlane(p1, p2, q.plane, &inter, &alpha) &&
+			   (IsInside(MajPln(inter, q.majorPlane), q.p1, q.p2, q.p3) ||
+				IsInside(MajPln(inter, q.majorPlane), q.p1, q.p3, q.p4));
+	});
+}
+
+int IntersectWithLine(vec3 p1, vec3 p2, TriPackets &packets, BVH &bvh, float &retAlpha) {
+	vec3 d = p2-p1;
+	return Traverse(p1, p2, bvh, retAlpha, [&](int n, float &minAlpha, int &picked) {
+		int2 &np = packets.nodePackets[n];
+		IntersectPackets(p1, d, &packets.packets[np.i1], np.i2, minAlpha, picked);
+	});
+}
+
+bool Mesh::IntersectWithSegment(vec3 p1, vec3 p2, float *alpha, int *index, bool *isQuad) {
+	MeshGeometry &g = *geometry;
+	if (g.triInfos.size() == 0 && g.quadInfos.size() == 0)
 		BuildInfos();
 	float a;
-	if (IntersectWithLine(p1, p2, triInfos, a) >= 0 && a >= 0 && a <= 1) {
-		if (alpha) *alpha = a;
-		return true;
-	}
-	if (IntersectWithLine(p1, p2, quadInfos, a) >= 0 && a >= 0 && a <= 1) {
-		if (alpha) *alpha = a;
-		return true;
+	int i = IntersectWithLine(p1, p2, g.triPackets, g.triBVH, a);
+	bool quad = false;
+	if (i < 0 || a < 0 || a > 1) {
+		i = IntersectWithLine(p1, p2, g.quadPackets, g.quadBVH, a);
+		quad = true;
+		if (i < 0 || a < 0 || a > 1)
+			return false;
 	}
-	return false;
+	if (alpha) *alpha = a;
+	if (index) *index = i;
+	if (isQuad) *isQuad = quad;
+	return true;
 }
 
 /* Wayside
@@ -4,8 +4,14 @@
 #include <stdio.h>
 #include <float.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
-#include "stb_image.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "STB_Image.h"
 #include "Draw.h"
 #include "Misc.h"
 
@@ -15,8 +21,13 @@
 std::string GetDirectory() { return "unimplemented"; }
 #else
 std::string GetDirectory() {
-	char buf[256];
+	char buf[256] = "";
+#ifdef _WIN32
 	GetCurrentDirectoryA(256, buf);
+#else
+	if (!getcwd(buf, 256))
+		buf[0] = 0;
+#endif
 	for (size_t i = 0; i < strlen(buf); i++)
 		if (buf[i] == '\\') buf[i] = '/';
 	return std::string(buf)+std::string("/");
@@ -29,10 +40,78 @@ time_t FileModified(const char *name) {
 	return info.st_mtime;
 }
 
+long FileSize(const char *name) {
+	struct stat info;
+	if (stat(name, &info) != 0)
+		return -1;
+	return (long) info.st_size;
+}
+
 bool FileExists(const char *name) {
 	return fopen(name, "r") != NULL;
 }
 
+// Memory-mapped File
+
+#ifdef _WIN32
+bool MappedFile::Open(const char *name) {
+	Close();
+	file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = NULL;
+		return false;
+	}
+	LARGE_INTEGER s;
+	if (!GetFileSizeEx(file, &s) || s.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		data = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		Close();
+		return false;
+	}
+	size = (size_t) s.QuadPart;
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	data = NULL;
+	mapping = file = NULL;
+	size = 0;
+}
+#else
+bool MappedFile::Open(const char *name) {
+	Close();
+	int fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);								// mapping remains valid after close
+	if (p == MAP_FAILED)
+		return false;
+	data = (const char *) p;
+	size = (size_t) info.st_size;
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data) munmap((void *) data, size);
+	data = NULL;
+	size = 0;
+}
+#endif
+
 // Sphere
 
 float RaySphere(vec3 base, vec3 v, vec3 center, float radius) {
@@ -0,0 +1,186 @@
+// MockVR.cpp - in-process stand-in for the OpenVR system and compositor
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "MockVR.h"
+#include "Quaternion.h"
+
+using namespace vr;
+
+// Time
+
+double MockVR::Time() {
+	if (!pace)
+		return frame/(double) refreshRate;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Poses
+
+namespace {
+
+mat4 Lerp(mat4 &a, mat4 &b, float t) {
+	// slerp orientation, lerp position (presume rigid transforms)
+	Quaternion qa(a), qb(b), q;
+	q.Slerp(qa, qb, t);
+	mat4 m = q.GetMatrix();
+	for (int i = 0; i < 3; i++)
+		m[i][3] = a[i][3]+t*(b[i][3]-a[i][3]);
+	return m;
+}
+
+HmdMatrix34_t To3x4(mat4 m) {
+	HmdMatrix34_t r;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 4; j++)
+			r.m[i][j] = m[i][j];
+	return r;
+}
+
+void SetPose(TrackedDevicePose_t &pose, mat4 m) {
+	memset(&pose, 0, sizeof(pose));
+	pose.mDeviceToAbsoluteTracking = To3x4(m);
+	pose.eTrackingResult = TrackingResult_Running_OK;
+	pose.bPoseIsValid = true;
+	pose.bDeviceIsConnected = true;
+}
+
+} // end namespace
+
+void MockVR::GetPoses(double t, mat4 &head, mat4 &leftHand, mat4 &rightHand) {
+	head = leftHand = rightHand = mat4();
+	if (script) {
+		script(t, head, leftHand, rightHand);
+		return;
+	}
+	int n = poses.size();
+	if (!n)
+		return;
+	if (t <= poses[0].t || n == 1) {
+		head = poses[0].head; leftHand = poses[0].leftHand; rightHand = poses[0].rightHand;
+		return;
+	}
+	if (t >= poses[n-1].t) {
+		head = poses[n-1].head; leftHand = poses[n-1].leftHand; rightHand = poses[n-1].rightHand;
+		return;
+	}
+	int i = 0;
+	while (i < n-2 && poses[i+1].t < t)
+		i++;
+	MockPose &a = poses[i], &b = poses[i+1];
+	float alpha = b.t > a.t? (float) ((t-a.t)/(b.t-a.t)) : 0;
+	head = Lerp(a.head, b.head, alpha);
+	leftHand = Lerp(a.leftHand, b.leftHand, alpha);
+	rightHand = Lerp(a.rightHand, b.rightHand, alpha);
+}
+
+void MockVR::SetPoses(double t, TrackedDevicePose_t *p, uint32_t nPoses) {
+	mat4 m[nDevices];
+	GetPoses(t, m[hmdIndex], m[leftHandIndex], m[rightHandIndex]);
+	for (uint32_t i = 0; i < nPoses; i++)
+		if (i < nDevices)
+			SetPose(p[i], m[i]);
+		else
+			memset(&p[i], 0, sizeof(TrackedDevicePose_t));
+}
+
+bool MockVR::ReadPoses(const char *filename) {
+	FILE *in = fopen(filename, "r");
+	if (!in) {
+		printf("MockVR: can't read %s\n", filename);
+		return false;
+	}
+	poses.resize(0);
+	char line[2000];
+	while (fgets(line, 2000, in)) {
+		MockPose p;
+		float v[37];
+		char *s = line;
+		int k = 0, nChars = 0;
+		for (; k < 37 && sscanf(s, "%f%n", &v[k], &nChars) == 1; k++)
+			s += nChars;
+		if (k < 37)
+			continue; // comment or malformed
+		p.t = v[0];
+		mat4 *m[] = {&p.head, &p.leftHand, &p.rightHand};
+		for (int d = 0; d < 3; d++)
+			for (int i = 0; i < 3; i++)
+				for (int j = 0; j < 4; j++)
+					(*m[d])[i][j] = v[1+12*d+4*i+j];
+		poses.push_back(p);
+	}
+	fclose(in);
+	return poses.size() > 0;
+}
+
+bool MockVR::WritePoses(const char *filename, std::vector<MockPose> &p) {
+	FILE *out = fopen(filename, "w");
+	if (!out)
+		return false;
+	for (MockPose &pose : p) {
+		fprintf(out, "%g", pose.t);
+		mat4 *m[] = {&pose.head, &pose.leftHand, &pose.rightHand};
+		for (int d = 0; d < 3; d++)
+			for (int i = 0; i < 3; i++)
+				for (int j = 0; j < 4; j++)
+					fprintf(out, " %g", (*m[d])[i][j]);
+		fprintf(out, "\n");
+	}
+	fclose(out);
+	return true;
+}
+
+bool MockVR::WriteSubmits(const char *filename) {
+	FILE *out = fopen(filename, "w");
+	if (!out)
+		return false;
+	fprintf(out, "frame,eye,texture,uMin,vMin,uMax,vMax,time\n");
+	for (MockSubmit &s : submits)
+		fprintf(out, "%i,%s,%u,%g,%g,%g,%g,%.6f\n", s.frame, s.eye == Eye_Left? "left" : "right", s.textureName,
+				s.bounds.uMin, s.bounds.vMin, s.bounds.uMax, s.bounds.vMax, s.t);
+	fclose(out);
+	return true;
+}
+
+// Compositor
+
+EVRCompositorError MockVR::WaitGetPoses(TrackedDevicePose_t *renderPoses, uint32_t nRender, TrackedDevicePose_t *gamePoses, uint32_t nGame) {
+	double period = 1./refreshRate;
+	if (pace) {
+		// sleep until next vsync
+		double now = Time(), next = (floor(now/period)+1)*period;
+		std::this_thread::sleep_for(std::chrono::duration<double>(next-now));
+	}
+	frame++;
+	double display = Time()+period+vsyncToPhotons;
+	if (renderPoses) SetPoses(display, renderPoses, nRender);
+	if (gamePoses) SetPoses(display+period, gamePoses, nGame);
+	return VRCompositorError_None;
+}
+
+void MockVR::GetDeviceToAbsoluteTrackingPose(float secondsFromNow, TrackedDevicePose_t *p, uint32_t nPoses) {
+	SetPoses(Time()+secondsFromNow, p, nPoses);
+}
+
+bool MockVR::GetTimeSinceLastVsync(float *seconds, uint64_t *frameCounter) {
+	double period = 1./refreshRate, now = Time();
+	if (seconds) *seconds = pace? (float) (now-floor(now/period)*period) : 0;
+	if (frameCounter) *frameCounter = frame;
+	return true;
+}
+
+EVRCompositorError MockVR::Submit(EVREye eye, const Texture_t *texture, const VRTextureBounds_t *bounds) {
+	if (!texture || texture->eType != TextureType_OpenGL)
+		return VRCompositorError_InvalidTexture;
+	if (recordSubmits && submits.size() < maxSubmits) {
+		MockSubmit s;
+		s.frame = frame;
+		s.eye = eye;
+		s.textureName = (GLuint) (uintptr_t) texture->handle;
+		if (bounds) s.bounds = *bounds;
+		s.t = Time();
+		submits.push_back(s);
+	}
+	return VRCompositorError_None;
+}
@@ -0,0 +1,326 @@
+// PixelFormat.cpp - pixel format conversion for readbacks and uploads
+
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "PixelFormat.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+	#define PIXEL_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define TARGET_SSE2
+		#define TARGET_SSSE3
+		#define TARGET_AVX2
+	#else
+		#define TARGET_SSE2 __attribute__((target("sse2")))
+		#define TARGET_SSSE3 __attribute__((target("ssse3")))
+		#define TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+namespace {
+
+const size_t parallelMin = 1 << 20;		// # values or pixels before splitting across threads
+
+template<class F> void Parallel(size_t n, F f) {
+	// call f(begin, end) over [0, n), in chunks (multiples of 64) on hardware threads if n large
+	int nThreads = (int) std::thread::hardware_concurrency();
+	if (n < parallelMin || nThreads < 2) {
+		f((size_t) 0, n);
+		return;
+	}
+	size_t chunk = ((n+nThreads-1)/nThreads+63) & ~(size_t) 63;
+	std::vector<std::thread> threads;
+	for (size_t begin = chunk; begin < n; begin += chunk)
+		threads.push_back(std::thread(f, begin, begin+chunk < n? begin+chunk : n));
+	f((size_t) 0, chunk < n? chunk : n);
+	for (std::thread &t : threads)
+		t.join();
+}
+
+inline unsigned char Byte(float f) {
+	// as the SIMD kernels: +.5 and truncate, NaN to 0
+	float v = 255*f+.5f;
+	return (unsigned char) (v >= 255? 255 : v > 0? (int) v : 0);
+}
+
+// Kernels
+
+// each converts from index i as far as its vector width allows and returns where the next
+// (narrower) kernel, and finally the scalar loop, resumes; AVX2 implies SSSE3 implies SSE2
+
+enum Level { Scalar = 0, SSE2, SSSE3, AVX2 };
+
+#ifdef PIXEL_X86
+
+TARGET_SSE2 inline __m128i Int4(const float *src) {
+	// 255*src+.5, truncated; min with NaN first operand keeps NaN (converts to 0x80000000, packs to 0)
+	__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(255)), _mm_set1_ps(.5f));
+	return _mm_cvttps_epi32(_mm_min_ps(_mm_set1_ps(256), v));
+}
+
+TARGET_AVX2 inline __m256i Int8(const float *src) {
+	__m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src), _mm256_set1_ps(255)), _mm256_set1_ps(.5f));
+	return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_set1_ps(256), v));
+}
+
+TARGET_AVX2 size_t FloatToByteAVX2(const float *src, unsigned char *dst, size_t i, size_t end) {
+	// packs interleave 128-bit lanes; permute restores order
+	__m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	for (; i+32 <= end; i += 32) {
+		__m256i ab = _mm256_packs_epi32(Int8(src+i), Int8(src+i+8));
+		__m256i cd = _mm256_packs_epi32(Int8(src+i+16), Int8(src+i+24));
+		__m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+		_mm256_storeu_si256((__m256i *) (dst+i), bytes);
+	}
+	return i;
+}
+
+TARGET_SSE2 size_t FloatToByteSSE2(const float *src, unsigned char *dst, size_t i, size_t end) {
+	for (; i+16 <= end; i += 16) {
+		__m128i ab = _mm_packs_epi32(Int4(src+i), Int4(src+i+4));
+		__m128i cd = _mm_packs_epi32(Int4(src+i+8), Int4(src+i+12));
+		_mm_storeu_si128((__m128i *) (dst+i), _mm_packus_epi16(ab, cd));
+	}
+	return i;
+}
+
+TARGET_AVX2 size_t ByteToFloatAVX2(const unsigned char *src, float *dst, size_t i, size_t end) {
+	__m256 scale = _mm256_set1_ps(1.f/255);
+	for (; i+8 <= end; i += 8) {
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src+i)));
+		_mm256_storeu_ps(dst+i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	return i;
+}
+
+TARGET_SSE2 size_t ByteToFloatSSE2(const unsigned char *src, float *dst, size_t i, size_t end) {
+	__m128 scale = _mm_set1_ps(1.f/255);
+	__m128i zero = _mm_setzero_si128();
+	for (; i+16 <= end; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src+i));
+		__m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+		__m128i q[] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+						_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+		for (int k = 0; k < 4; k++)
+			_mm_storeu_ps(dst+i+4*k, _mm_mul_ps(_mm_cvtepi32_ps(q[k]), scale));
+	}
+	return i;
+}
+
+TARGET_SSSE3 size_t RgbToRgbaSSSE3(const unsigned char *rgb, unsigned char *rgba, unsigned char alpha, size_t i, size_t end) {
+	// 4 pixels per 16-byte load (reads 4 bytes past the 4th pixel, so stop short of end)
+	__m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m128i a = _mm_set1_epi32((int) ((unsigned) alpha << 24));
+	for (; 3*i+16 <= 3*end; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (rgb+3*i));
+		_mm_storeu_si128((__m128i *) (rgba+4*i), _mm_or_si128(_mm_shuffle_epi8(v, spread), a));
+	}
+	return i;
+}
+
+TARGET_SSSE3 size_t RgbaToRgbSSSE3(const unsigned char *rgba, unsigned char *rgb, size_t i, size_t end) {
+	// 4 pixels per 16-byte store (writes 4 bytes past the 4th pixel, so stop short of end)
+	__m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; 3*i+16 <= 3*end; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (rgba+4*i));
+		_mm_storeu_si128((__m128i *) (rgb+3*i), _mm_shuffle_epi8(v, pack));
+	}
+	return i;
+}
+
+TARGET_SSE2 size_t SwapRedBlue4SSE2(unsigned char *pixels, size_t i, size_t end) {
+	// per 32-bit pixel: keep g, a; exchange low and third bytes
+	__m128i ga = _mm_set1_epi32((int) 0xff00ff00), low = _mm_set1_epi32(0xff);
+	for (; i+4 <= end; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (pixels+4*i));
+		__m128i r = _mm_slli_epi32(_mm_and_si128(v, low), 16), b = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+		_mm_storeu_si128((__m128i *) (pixels+4*i), _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b)));
+	}
+	return i;
+}
+
+TARGET_SSSE3 size_t SwapRedBlue3SSSE3(unsigned char *pixels, size_t i, size_t end) {
+	// 5 pixels per 16 bytes, 16th byte unchanged
+	__m128i swap = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+	for (; 3*i+16 <= 3*end; i += 5) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (pixels+3*i));
+		_mm_storeu_si128((__m128i *) (pixels+3*i), _mm_shuffle_epi8(v, swap));
+	}
+	return i;
+}
+
+TARGET_SSE2 size_t PremultiplySSE2(unsigned char *rgba, size_t i, size_t end) {
+	__m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+	__m128i alphaLanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1), a255 = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+	for (; i+4 <= end; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (rgba+4*i)), out[2];
+		for (int k = 0; k < 2; k++) {
+			__m128i c = k? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero);
+			// each pixel's alpha in its rgb lanes, 255 in its alpha lane
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			a = _mm_or_si128(_mm_andnot_si128(alphaLanes, a), a255);
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), half);
+			out[k] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		}
+		_mm_storeu_si128((__m128i *) (rgba+4*i), _mm_packus_epi16(out[0], out[1]));
+	}
+	return i;
+}
+
+// CPU Support
+
+Level CpuLevel() {
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuid(r, 0);
+	int nIds = r[0];
+	__cpuid(r, 1);
+	bool sse2 = (r[3] & (1 << 26)) != 0, ssse3 = (r[2] & (1 << 9)) != 0;
+	bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0, avx2 = false;
+	if (nIds >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {		// OS must save ymm registers
+		__cpuidex(r, 7, 0);
+		avx2 = (r[1] & (1 << 5)) != 0;
+	}
+#else
+	bool sse2 = __builtin_cpu_supports("sse2"), ssse3 = __builtin_cpu_supports("ssse3"), avx2 = __builtin_cpu_supports("avx2");
+#endif
+	return avx2? AVX2 : ssse3? SSSE3 : sse2? SSE2 : Scalar;
+}
+
+#else
+
+Level CpuLevel() { return Scalar; }
+
+#endif // PIXEL_X86
+
+const char *levelNames[] = { "scalar", "sse2", "ssse3", "avx2" };
+
+Level Choose(const char *name) {
+	// name NULL: widest supported
+	Level cpu = CpuLevel();
+	for (int l = AVX2; name && l > Scalar; l--)
+		if (!strcmp(name, levelNames[l]))
+			return (Level) l < cpu? (Level) l : cpu;
+	return name? Scalar : cpu;
+}
+
+Level level = Choose(NULL);
+
+} // end namespace
+
+// Kernel Selection
+
+const char *PixelFormatKernel() { return levelNames[level]; }
+
+void SetPixelFormatKernel(const char *name) { level = Choose(name); }
+
+// Float and Byte
+
+void FloatToByte(const float *src, unsigned char *dst, size_t n) {
+	Parallel(n, [src, dst](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef PIXEL_X86
+		if (level >= AVX2) i = FloatToByteAVX2(src, dst, i, end);
+		if (level >= SSE2) i = FloatToByteSSE2(src, dst, i, end);
+#endif
+		for (; i < end; i++)
+			dst[i] = Byte(src[i]);
+	});
+}
+
+void ByteToFloat(const unsigned char *src, float *dst, size_t n) {
+	Parallel(n, [src, dst](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef PIXEL_X86
+		if (level >= AVX2) i = ByteToFloatAVX2(src, dst, i, end);
+		if (level >= SSE2) i = ByteToFloatSSE2(src, dst, i, end);
+#endif
+		for (; i < end; i++)
+			dst[i] = src[i]*(1.f/255);
+	});
+}
+
+// Channels
+
+void RgbToRgba(const unsigned char *rgb, unsigned char *rgba, size_t nPixels, unsigned char alpha) {
+	Parallel(nPixels, [rgb, rgba, alpha](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef PIXEL_X86
+		if (level >= SSSE3) i = RgbToRgbaSSSE3(rgb, rgba, alpha, i, end);
+#endif
+		for (; i < end; i++) {
+			const unsigned char *s = rgb+3*i;
+			unsigned char *d = rgba+4*i;
+			d[0] = s[0];
+			d[1] = s[1];
+			d[2] = s[2];
+			d[3] = alpha;
+		}
+	});
+}
+
+void RgbaToRgb(const unsigned char *rgba, unsigned char *rgb, size_t nPixels) {
+	Parallel(nPixels, [rgba, rgb](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef PIXEL_X86
+		if (level >= SSSE3) i = RgbaToRgbSSSE3(rgba, rgb, i, end);
+#endif
+		for (; i < end; i++) {
+			const unsigned char *s = rgba+4*i;
+			unsigned char *d = rgb+3*i;
+			d[0] = s[0];
+			d[1] = s[1];
+			d[2] = s[2];
+		}
+	});
+}
+
+void SwapRedBlue(unsigned char *pixels, size_t nPixels, int nChannels) {
+	if (nChannels != 3 && nChannels != 4)
+		return;
+	Parallel(nPixels, [pixels, nChannels](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef PIXEL_X86
+		if (nChannels == 4 && level >= SSE2) i = SwapRedBlue4SSE2(pixels, i, end);
+		if (nChannels == 3 && level >= SSSE3) i = SwapRedBlue3SSSE3(pixels, i, end);
+#endif
+		for (; i < end; i++) {
+			unsigned char *p = pixels+nChannels*i, t = p[0];
+			p[0] = p[2];
+			p[2] = t;
+		}
+	});
+}
+
+void Premultiply(unsigned char *rgba, size_t nPixels) {
+	// c*a/255, rounded: t = c*a+128, (t+(t>>8))>>8
+	Parallel(nPixels, [rgba](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef PIXEL_X86
+		if (level >= SSE2) i = PremultiplySSE2(rgba, i, end);
+#endif
+		for (; i < end; i++) {
+			unsigned char *p = rgba+4*i;
+			for (int k = 0; k < 3; k++) {
+				int t = p[k]*p[3]+128;
+				p[k] = (unsigned char) ((t+(t >> 8)) >> 8);
+			}
+		}
+	});
+}
+
+// Rows
+
+void FlipVertical(unsigned char *pixels, int width, int height, int bytesPerPixel) {
+	size_t rowSize = (size_t) width*bytesPerPixel;
+	std::vector<unsigned char> row(rowSize);
+	for (int j = 0; j < height/2; j++) {
+		unsigned char *a = pixels+j*rowSize, *b = pixels+(height-1-j)*rowSize;
+		memcpy(row.data(), a, rowSize);
+		memcpy(a, b, rowSize);
+		memcpy(b, row.data(), rowSize);
+	}
+}
@@ -0,0 +1,225 @@
+// Profiler.cpp - per-stage CPU and GPU frame timing
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "Draw.h"
+#include "Profiler.h"
+#include "Text.h"
+
+// Stages
+
+int Profiler::FindStage(const char *name) {
+	if (!stages.size()) {
+		stages.resize(1);
+		stages[0].name = "frame";
+	}
+	for (int i = 0; i < (int) stages.size(); i++)
+		if (!strcmp(stages[i].name.c_str(), name))
+			return i;
+	stages.resize(stages.size()+1);
+	Stage &s = stages.back();
+	s.name = string(name);
+	glGenQueries(2, s.queries);
+	return (int) stages.size()-1;
+}
+
+int Profiler::NStages() {
+	return (int) stages.size();
+}
+
+const char *Profiler::StageName(int stage) {
+	return stage >= 0 && stage < (int) stages.size()? stages[stage].name.c_str() : "";
+}
+
+// Timing
+
+namespace {
+
+float Ms(std::chrono::steady_clock::duration d) {
+	return std::chrono::duration<float, std::milli>(d).count();
+}
+
+} // end namespace
+
+void Profiler::BeginFrame() {
+	FindStage("frame");
+	frameStart = Clock::now();
+	current = -1;
+}
+
+void Profiler::Begin(const char *name) {
+	if (current >= 0)
+		End();
+	int b = frame%2;
+	current = FindStage(name);
+	Stage &s = stages[current];
+	queryActive = !s.issued[b];
+	if (queryActive) {
+		glBeginQuery(GL_TIME_ELAPSED, s.queries[b]);
+		s.issued[b] = true;
+	}
+	stageStart = Clock::now();
+}
+
+void Profiler::End() {
+	if (current < 0)
+		return;
+	Stage &s = stages[current];
+	float &cpu = s.cpu[frame%2];
+	cpu = (cpu < 0? 0 : cpu)+Ms(Clock::now()-stageStart);
+	if (queryActive)
+		glEndQuery(GL_TIME_ELAPSED);
+	queryActive = false;
+	current = -1;
+}
+
+void Profiler::EndFrame() {
+	End();
+	stages[0].cpu[frame%2] = Ms(Clock::now()-frameStart);
+	// GPU results for this frame are read at the end of the next
+	if (frame > 0)
+		Collect((frame-1)%2);
+	frame++;
+}
+
+void Profiler::Collect(int b) {
+	int nStages = (int) stages.size();
+	FrameRecord r;
+	r.frame = frame-1;
+	r.cpu.resize(nStages, -1);
+	r.gpu.resize(nStages, -1);
+	float gpuSum = 0;
+	bool gpuValid = true;
+	for (int i = 1; i < nStages; i++) {
+		Stage &s = stages[i];
+		if (s.issued[b]) {
+			GLint available = 0;
+			glGetQueryObjectiv(s.queries[b], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(s.queries[b], GL_QUERY_RESULT, &ns);
+				r.gpu[i] = (float) (ns/1.e6);
+			}
+			else
+				nGpuMissed++;	// query is simply re-issued next frame
+			s.issued[b] = false;
+		}
+		if (s.cpu[b] >= 0) {
+			if (r.gpu[i] >= 0) gpuSum += r.gpu[i];
+			else gpuValid = false;
+		}
+	}
+	r.gpu[0] = gpuValid? gpuSum : -1;
+	// rolling history
+	for (int i = 0; i < nStages; i++) {
+		Stage &s = stages[i];
+		r.cpu[i] = s.cpu[b];
+		s.cpu[b] = -1;
+		if ((int) s.cpuHistory.size() != historySize) {
+			s.cpuHistory.assign(historySize, -1);
+			s.gpuHistory.assign(historySize, -1);
+		}
+		s.cpuHistory[historyPos%historySize] = r.cpu[i];
+		s.gpuHistory[historyPos%historySize] = r.gpu[i];
+	}
+	historyPos = (historyPos+1)%historySize;
+	if ((int) records.size() < maxFrames)
+		records.push_back(r);
+}
+
+// Statistics
+
+ProfileStats Profiler::Stats(vector<float> &history) {
+	ProfileStats stats;
+	vector<float> v;
+	for (float t : history)
+		if (t >= 0)
+			v.push_back(t);
+	if (!(stats.n = (int) v.size()))
+		return stats;
+	std::sort(v.begin(), v.end());
+	float sum = 0;
+	for (float t : v)
+		sum += t;
+	stats.min = v[0];
+	stats.avg = sum/stats.n;
+	stats.p99 = v[std::min(stats.n-1, (int) (.99f*stats.n))];
+	return stats;
+}
+
+ProfileStats Profiler::CpuStats(int stage) {
+	return stage >= 0 && stage < (int) stages.size()? Stats(stages[stage].cpuHistory) : ProfileStats();
+}
+
+ProfileStats Profiler::GpuStats(int stage) {
+	return stage >= 0 && stage < (int) stages.size()? Stats(stages[stage].gpuHistory) : ProfileStats();
+}
+
+// Display
+
+void Profiler::Overlay(int x, int y, float textSize, vec3 color) {
+	int nStages = (int) stages.size(), dy = (int) (1.6f*textSize), w = (int) (36*textSize);
+	int h = (nStages+1)*dy+6;
+	UseDrawShader(ScreenMode());
+	glDisable(GL_DEPTH_TEST);
+	bool batched = DrawBatching();
+	if (!batched)
+		BeginDrawBatch();
+	Quad(x, y, x+w, y, x+w, y-h, x, y-h, true, vec3(1), .6f);
+	int tab1 = x+4, tab2 = x+(int) (9*textSize), tab3 = x+(int) (22.5f*textSize);
+	y -= dy;
+	Text(tab1, y, color, textSize, "ms");
+	Text(tab2, y, color, textSize, "cpu min/avg/p99");
+	Text(tab3, y, color, textSize, "gpu min/avg/p99");
+	for (int i = 0; i < nStages; i++) {
+		ProfileStats c = CpuStats(i), g = GpuStats(i);
+		y -= dy;
+		Text(tab1, y, color, textSize, stages[i].name.c_str());
+		Text(tab2, y, color, textSize, "%.2f/%.2f/%.2f", c.min, c.avg, c.p99);
+		if (g.n)
+			Text(tab3, y, color, textSize, "%.2f/%.2f/%.2f", g.min, g.avg, g.p99);
+		else
+			Text(tab3, y, color, textSize, "-");
+	}
+	if (!batched)
+		EndDrawBatch();
+}
+
+// CSV
+
+bool Profiler::WriteCSV(const char *filename) {
+	FILE *out = fopen(filename, "w");
+	if (!out) {
+		printf("Profiler: can't write %s\n", filename);
+		return false;
+	}
+	int nStages = (int) stages.size();
+	fprintf(out, "frame");
+	for (int i = 0; i < nStages; i++)
+		fprintf(out, ",%s cpu,%s gpu", stages[i].name.c_str(), stages[i].name.c_str());
+	fprintf(out, "\n");
+	for (FrameRecord &r : records) {
+		fprintf(out, "%i", r.frame);
+		for (int i = 0; i < nStages; i++) {
+			float cpu = i < (int) r.cpu.size()? r.cpu[i] : -1, gpu = i < (int) r.gpu.size()? r.gpu[i] : -1;
+			if (cpu >= 0) fprintf(out, ",%.4f", cpu); else fprintf(out, ",");
+			if (gpu >= 0) fprintf(out, ",%.4f", gpu); else fprintf(out, ",");
+		}
+		fprintf(out, "\n");
+	}
+	fclose(out);
+	return true;
+}
+
+// Cleanup
+
+void Profiler::Release() {
+	for (Stage &s : stages)
+		if (s.queries[0])
+			glDeleteQueries(2, s.queries);
+	stages.resize(0);
+	records.resize(0);
+	frame = historyPos = nGpuMissed = 0;
+	current = -1;
+}
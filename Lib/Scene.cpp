@@ -0,0 +1,165 @@
+// Scene.cpp - segment queries over a set of meshes
+
+#include <string.h>
+#include "Scene.h"
+
+// Scene
+
+void Scene::Add(Mesh &m) {
+	Entry e;
+	e.mesh = &m;
+	entries.push_back(e);
+	rebuild = true;
+}
+
+void Scene::Remove(Mesh &m) {
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].mesh == &m) {
+			entries.erase(entries.begin()+i);
+			rebuild = true;
+			return;
+		}
+}
+
+void Scene::Clear() {
+	entries.resize(0);
+	rebuild = true;
+}
+
+void Scene::Update() {
+	for (Entry &e : entries) {
+		Mesh &m = *e.mesh;
+		MeshGeometry *g = m.geometry.get();
+		if (e.valid && e.geometry == g && !memcmp(&e.toWorld, &m.toWorld, sizeof(mat4)))
+			continue;
+		e.valid = true;
+		e.geometry = g;
+		e.toWorld = m.toWorld;
+		e.inverse = Invert(m.toWorld);
+		nInverses++;
+		rebuild = true;
+		// object bounds from mesh BVHs
+		e.empty = true;
+		if (!g)
+			continue;
+		if (g->triInfos.empty() && g->quadInfos.empty())
+			m.BuildInfos();
+		vec3 min(FLT_MAX), max(-FLT_MAX);
+		for (BVH *b : { &g->triBVH, &g->quadBVH })
+			if (b->nodes.size()) {
+				vec3 bmin = b->nodes[0].min, bmax = b->nodes[0].max;
+				for (int k = 0; k < 3; k++) {
+					min[k] = bmin[k] < min[k]? bmin[k] : min[k];
+					max[k] = bmax[k] > max[k]? bmax[k] : max[k];
+				}
+			}
+		e.empty = min.x > max.x;
+		if (e.empty)
+			continue;
+		// world bounds of transformed corners
+		e.min = vec3(FLT_MAX);
+		e.max = vec3(-FLT_MAX);
+		for (int c = 0; c < 8; c++) {
+			vec3 p = Vec3(m.toWorld*vec4(c&1? max.x : min.x, c&2? max.y : min.y, c&4? max.z : min.z, 1));
+			for (int k = 0; k < 3; k++) {
+				e.min[k] = p[k] < e.min[k]? p[k] : e.min[k];
+				e.max[k] = p[k] > e.max[k]? p[k] : e.max[k];
+			}
+		}
+	}
+	if (!rebuild)
+		return;
+	vector<vec3> mins, maxs;
+	bvhEntries.resize(0);
+	for (size_t i = 0; i < entries.size(); i++)
+		if (!entries[i].empty) {
+			bvhEntries.push_back(i);
+			mins.push_back(entries[i].min);
+			maxs.push_back(entries[i].max);
+		}
+	bvh.Build(mins, maxs);
+	rebuild = false;
+}
+
+namespace {
+
+bool SegmentBox(vec3 &p, vec3 &d, vec3 &min, vec3 &max, float &tmin) {
+	// entry of segment p+t*d, 0 <= t <= 1, into box
+	float tmax = 1;
+	tmin = 0;
+	for (int k = 0; k < 3; k++) {
+		if (d[k] == 0) {
+			if (p[k] < min[k] || p[k] > max[k])
+				return false;
+			continue;
+		}
+		float t1 = (min[k]-p[k])/d[k], t2 = (max[k]-p[k])/d[k];
+		if (t1 > t2) { float t = t1; t1 = t2; t2 = t; }
+		if (t1 > tmin) tmin = t1;
+		if (t2 < tmax) tmax = t2;
+		if (tmin > tmax)
+			return false;
+	}
+	return true;
+}
+
+} // end namespace
+
+bool Scene::IntersectWithSegment(vec3 p1, vec3 p2, SceneHit *hit) {
+	Update();
+	if (bvh.nodes.empty())
+		return false;
+	vec3 d = p2-p1;
+	SceneHit nearest;
+	int nearestEntry = -1;
+	struct Visit { int node; float tmin; } stack[64];	// BVH depth is limited to 48
+	int nStack = 0;
+	float tmin;
+	if (SegmentBox(p1, d, bvh.nodes[0].min, bvh.nodes[0].max, tmin))
+		stack[nStack++] = { 0, tmin };
+	while (nStack) {
+		Visit v = stack[--nStack];
+		if (nearestEntry >= 0 && v.tmin > nearest.alpha)
+			continue;
+		BVHNode &node = bvh.nodes[v.node];
+		if (node.count) {
+			for (int k = node.start; k < node.start+node.count; k++) {
+				int i = bvhEntries[bvh.indices[k]];
+				Entry &e = entries[i];
+				if (!SegmentBox(p1, d, e.min, e.max, tmin) || (nearestEntry >= 0 && tmin > nearest.alpha))
+					continue;
+				vec3 xp1 = Vec3(e.inverse*vec4(p1, 1)), xp2 = Vec3(e.inverse*vec4(p2, 1));
+				float alpha;
+				int index;
+				bool quad;
+				if (e.mesh->IntersectWithSegment(xp1, xp2, &alpha, &index, &quad) &&
+					(nearestEntry < 0 || alpha < nearest.alpha || (alpha == nearest.alpha && i < nearestEntry))) {
+					nearest.mesh = e.mesh;
+					nearest.index = index;
+					nearest.quad = quad;
+					nearest.alpha = alpha;
+					nearestEntry = i;
+				}
+			}
+			continue;
+		}
+		float t1, t2;
+		bool h1 = SegmentBox(p1, d, bvh.nodes[node.left].min, bvh.nodes[node.left].max, t1);
+		bool h2 = SegmentBox(p1, d, bvh.nodes[node.right].min, bvh.nodes[node.right].max, t2);
+		if (h1 && h2) {
+			bool leftFirst = t1 <= t2;
+			stack[nStack++] = leftFirst? Visit{ node.right, t2 } : Visit{ node.left, t1 };
+			stack[nStack++] = leftFirst? Visit{ node.left, t1 } : Visit{ node.right, t2 };
+		}
+		else if (h1)
+			stack[nStack++] = { node.left, t1 };
+		else if (h2)
+			stack[nStack++] = { node.right, t2 };
+	}
+	if (nearestEntry < 0)
+		return false;
+	nearest.point = p1+nearest.alpha*d;
+	if (hit)
+		*hit = nearest;
+	return true;
+}
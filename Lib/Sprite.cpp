@@ -5,14 +5,17 @@
 #include "IO.h"
 #include "Sprite.h"
 #include <algorithm>
+#include <chrono>
+#include <map>
 #include <iostream>
+#include <thread>
 
 // Shader Storage Buffers for Collision Tests
 GLuint occupyBinding = 11, collideBinding = 12;
 GLuint occupyBuffer = 0, collideBuffer = 0;
 
 // Shaders
-GLuint spriteShader = 0, spriteCollisionShader = 0;
+GLuint spriteShader = 0, spriteCollisionShader = 0, spriteBatchShader = 0;
 
 namespace SpriteSpace {
 
@@ -35,14 +38,22 @@ int BuildSpriteShader(bool collisionTest = false) {
 		out vec4 pColor;
 		uniform mat4 uvTransform;
 		uniform sampler2D textureImage, textureMat;
+		uniform sampler2DArray textureFrames;
 		uniform bool useMat;
-		uniform int nTexChannels = 3;
+		uniform int nTexChannels = 3, nFrames = 0;
+		uniform float time = 0, startTime = 0, frameDuration = 1;
+		vec4 Image(vec2 st) {
+			if (nFrames == 0)
+				return texture(textureImage, st);
+			float frame = mod(floor(max(time-startTime, 0)/frameDuration), nFrames);
+			return texture(textureFrames, vec3(st, frame));
+		}
 		void main() {
 			vec2 st = (uvTransform*vec4(uv, 0, 1)).xy;
 			if (nTexChannels == 4)
-				pColor = texture(textureImage, st);
+				pColor = Image(st);
 			else {
-				pColor.rgb = texture(textureImage, st).rgb;
+				pColor.rgb = Image(st).rgb;
 				pColor.a = useMat? texture(textureMat, st).r : 1;
 			}
 			if (pColor.a < .02) // if nearly full matte,
@@ -60,14 +71,22 @@ int BuildSpriteShader(bool collisionTest = false) {
 		uniform vec4 vp;
 		uniform bool showOccupy = false, useMat = false;
 		uniform sampler2D textureImage, textureMat;
+		uniform sampler2DArray textureFrames;
 		uniform mat4 uvTransform;
-		uniform int spriteId = 0, nTexChannels = 3;
+		uniform int spriteId = 0, nTexChannels = 3, nFrames = 0;
+		uniform float time = 0, startTime = 0, frameDuration = 1;
+		vec4 Image(vec2 st) {
+			if (nFrames == 0)
+				return texture(textureImage, st);
+			float frame = mod(floor(max(time-startTime, 0)/frameDuration), nFrames);
+			return texture(textureFrames, vec3(st, frame));
+		}
 		void main() {
 			vec2 st = (uvTransform*vec4(uv, 0, 1)).xy;
 			if (nTexChannels == 4)
-				pColor = texture(textureImage, st);
+				pColor = Image(st);
 			else {
-				pColor.rgb = texture(textureImage, st).rgb;
+				pColor.rgb = Image(st).rgb;
 				pColor.a = useMat? texture(textureMat, st).r : 1;
 			}
 			if (pColor.a < .02) // if nearly full matte, don't tag z-buffer
@@ -99,6 +118,42 @@ GLuint GetCollisionShader() {
 	return spriteCollisionShader;
 }
 
+GLuint GetBatchShader() {
+	// per-instance transform rows, uv transform rows, z, layer, animation
+	const char *vShader = R"(
+		#version 330
+		in vec4 pt0, pt1, pt2, pt3, uv0, uv1;
+		in vec2 zLayer;
+		in vec3 flip;		// nFrames, frameDuration, startTime
+		out vec2 st;
+		flat out float layer;
+		uniform mat4 view;
+		uniform float time = 0;
+		void main() {
+			const vec2 pts[6] = vec2[6](vec2(-1,-1), vec2(1,-1), vec2(1,1), vec2(-1,1), vec2(-1,-1), vec2(1,1));
+			vec4 p = vec4(pts[gl_VertexID], zLayer.x, 1), uv = vec4((vec2(1,1)+pts[gl_VertexID])/2, 0, 1);
+			gl_Position = view*vec4(dot(pt0, p), dot(pt1, p), dot(pt2, p), dot(pt3, p));
+			st = vec2(dot(uv0, uv), dot(uv1, uv));
+			layer = zLayer.y+mod(floor(max(time-flip.z, 0)/flip.y), flip.x);
+		}
+	)";
+	const char *pShader = R"(
+		#version 330
+		in vec2 st;
+		flat in float layer;
+		out vec4 pColor;
+		uniform sampler2DArray textureArray;
+		void main() {
+			pColor = texture(textureArray, vec3(st, layer));
+			if (pColor.a < .02) // if nearly full matte,
+				discard;		// don't tag z-buffer
+		}
+	)";
+	if (!spriteBatchShader)
+		spriteBatchShader = LinkProgramViaCode(&vShader, &pShader);
+	return spriteBatchShader;
+}
+
 bool CrossPositive(vec2 a, vec2 b, vec2 c) { return cross(vec2(b-a), vec2(c-b)) > 0; }
 
 } // end namespace
@@ -203,7 +258,328 @@ int TestCollisions(vector<Sprite *> &sprites) {
 	return ReadCounter();
 }
 
-bool Sprite::Intersect(Sprite &s) {
+// Coverage Mask
+
+uint64_t CoverageMask::Get64(int i, int j) {
+	if (j < 0 || j >= height || i >= width || i <= -64)
+		return 0;
+	uint64_t *row = &words[j*wordsPerRow];
+	int w = i >= 0? i/64 : -1, shift = i-64*w;		// i = 64*w+shift, 0 <= shift < 64
+	uint64_t lo = w >= 0? row[w] : 0, hi = w+1 < wordsPerRow? row[w+1] : 0;
+	return shift? (lo >> shift) | (hi << (64-shift)) : lo;
+}
+
+namespace {
+
+void InitMask(CoverageMask &m, int width, int height) {
+	m.width = width;
+	m.height = height;
+	m.wordsPerRow = (width+63)/64;
+	m.words.assign(m.wordsPerRow*height, 0);
+}
+
+uint64_t EvenBits(uint64_t x) {
+	// bits 0, 2, 4 ... 62 of x to bits 0 through 31
+	x &= 0x5555555555555555ull;
+	x = (x | (x >> 1)) & 0x3333333333333333ull;
+	x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+	x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+	x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+	return (x | (x >> 16)) & 0x00000000ffffffffull;
+}
+
+} // end namespace
+
+void BuildCoverageMasks(unsigned char *pixels, int width, int height, int nChannels, int channel, vector<CoverageMask> &masks) {
+	masks.resize(0);
+	if (!pixels || width < 1 || height < 1 || channel >= nChannels)
+		return;
+	masks.resize(1);
+	CoverageMask &m = masks[0];
+	InitMask(m, width, height);
+	for (int j = 0; j < height; j++)
+		for (int i = 0; i < width; i++)
+			if (pixels[nChannels*(j*width+i)+channel] >= 6)
+				m.words[j*m.wordsPerRow+i/64] |= 1ull << (i%64);
+	// pyramid: or two rows, then adjacent bit pairs
+	while (masks.back().width > 1 || masks.back().height > 1) {
+		CoverageMask c;
+		const CoverageMask &f = masks.back();
+		InitMask(c, (f.width+1)/2, (f.height+1)/2);
+		for (int j = 0; j < c.height; j++) {
+			const uint64_t *r0 = &f.words[2*j*f.wordsPerRow], *r1 = 2*j+1 < f.height? r0+f.wordsPerRow : r0;
+			for (int k = 0; k < f.wordsPerRow; k++) {
+				uint64_t r = r0[k] | r1[k];
+				c.words[j*c.wordsPerRow+k/2] |= EvenBits(r | (r >> 1)) << (32*(k%2));
+			}
+		}
+		masks.push_back(c);
+	}
+}
+
+namespace {
+
+std::map<string, vector<CoverageMask>> maskCache;	// file|channel to masks
+
+} // end namespace
+
+void Sprite::BuildMasks() {
+	if (masksBuilt)
+		return;
+	masksBuilt = true;
+	masks.resize(0);
+	if (maskFile.empty())
+		return;
+	string key = maskFile+"|"+std::to_string(maskChannel);
+	std::map<string, vector<CoverageMask>>::iterator it = maskCache.find(key);
+	if (it == maskCache.end()) {
+		DecodedImage image;
+		DecodeImage(maskFile.c_str(), image);
+		it = maskCache.insert({key, vector<CoverageMask>()}).first;
+		BuildCoverageMasks(image.pixels, image.width, image.height, image.nChannels, maskChannel, it->second);
+	}
+	masks = it->second;
+}
+
+// CPU Collision
+
+namespace {
+
+struct SpriteBox {
+	vec2 corners[4], min, max;	// transformed quad and its bounds
+};
+
+SpriteBox GetBox(Sprite &s) {
+	SpriteBox b;
+	vec2 pts[] = { {-1,-1}, {-1,1}, {1,1}, {1,-1} };
+	b.min = vec2(FLT_MAX, FLT_MAX);
+	b.max = vec2(-FLT_MAX, -FLT_MAX);
+	for (int i = 0; i < 4; i++) {
+		vec2 p = b.corners[i] = s.PtTransform(pts[i]);
+		b.min = vec2(min(b.min.x, p.x), min(b.min.y, p.y));
+		b.max = vec2(max(b.max.x, p.x), max(b.max.y, p.y));
+	}
+	return b;
+}
+
+bool Separated(vec2 *a, vec2 *b) {
+	// is there a separating axis normal to an edge of a? (a parallelogram: two edges suffice)
+	for (int e = 0; e < 2; e++) {
+		vec2 edge = a[e+1]-a[e], axis(-edge.y, edge.x);
+		float aMin = FLT_MAX, aMax = -FLT_MAX, bMin = FLT_MAX, bMax = -FLT_MAX;
+		for (int i = 0; i < 4; i++) {
+			float da = dot(a[i], axis), db = dot(b[i], axis);
+			aMin = min(aMin, da); aMax = max(aMax, da);
+			bMin = min(bMin, db); bMax = max(bMax, db);
+		}
+		if (aMax < bMin || bMax < aMin)
+			return true;
+	}
+	return false;
+}
+
+bool Overlap(SpriteBox &a, SpriteBox &b) {
+	return !Separated(a.corners, b.corners) && !Separated(b.corners, a.corners);
+}
+
+CoverageMask OpaqueMask() {
+	CoverageMask m;
+	InitMask(m, 1, 1);
+	m.words[0] = 1;
+	return m;
+}
+
+CoverageMask opaqueMask = OpaqueMask();	// for sprites without alpha or matte
+
+mat4 Affine2D(mat4 m) {
+	// x, y rows of m, without z
+	mat4 a;
+	a[0] = vec4(m[0][0], m[0][1], 0, m[0][3]);
+	a[1] = vec4(m[1][0], m[1][1], 0, m[1][3]);
+	return a;
+}
+
+CoverageMask &Mask(Sprite &s, int level) {
+	if (!s.masks.size())
+		return opaqueMask;
+	return s.masks[level < (int) s.masks.size()? level : s.masks.size()-1];
+}
+
+mat4 TexelToNdc(Sprite &s, int level, mat4 *texelToUv = NULL) {
+	// texel coordinates (texel (i, j) spans i to i+1, j to j+1) of a mask level, to texture (st), to quad uv, to NDC
+	CoverageMask &m = Mask(s, 0);
+	float k = (float) (1 << level);
+	mat4 toUv = Invert(Affine2D(s.uvTransform))*Scale(k/m.width, k/m.height, 1);
+	if (texelToUv)
+		*texelToUv = toUv;
+	return Affine2D(s.ptTransform)*Translate(-1, -1, 0)*Scale(2, 2, 1)*toUv;
+}
+
+float TexelSize(Sprite &s, int level) {
+	mat4 m = TexelToNdc(s, level);
+	return sqrt(abs(m[0][0]*m[1][1]-m[0][1]*m[1][0]));
+}
+
+int Level(Sprite &s, float size) {
+	// coarsest mask level with texels no larger than size
+	int level = 0;
+	while (level+1 < (int) s.masks.size() && TexelSize(s, level+1) <= size*1.01f)
+		level++;
+	return level;
+}
+
+bool IsIdentity(mat4 &m) {
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			if (m[i][j] != (i == j? 1 : 0))
+				return false;
+	return true;
+}
+
+bool PixelOverlap(Sprite &s1, Sprite &s2, vec2 ndcMin, vec2 ndcMax) {
+	// sample the coarser mask at the centers of covered texels of the finer, within NDC region
+	// both masked: levels chosen so texels are about the size of the coarser sprite's full resolution texels
+	if (!s1.masks.size() && !s2.masks.size())
+		return true;
+	int l1 = 0, l2 = 0;
+	if (s1.masks.size() && s2.masks.size()) {
+		float size = max(TexelSize(s1, 0), TexelSize(s2, 0));
+		l1 = Level(s1, size);
+		l2 = Level(s2, size);
+	}
+	bool swap = !s1.masks.size() || (s2.masks.size() && TexelSize(s2, l2) < TexelSize(s1, l1));
+	Sprite &a = swap? s2 : s1, &b = swap? s1 : s2;
+	int la = swap? l2 : l1, lb = swap? l1 : l2;
+	CoverageMask &ma = Mask(a, la), &mb = Mask(b, lb);
+	mat4 aToUv, bToUv, aToNdc = TexelToNdc(a, la, &aToUv), bToNdc = TexelToNdc(b, lb, &bToUv);
+	mat4 ndcToA = Invert(aToNdc), aToB = Invert(bToNdc)*aToNdc, aToBUv = bToUv*aToB;
+	// texel range of a within region
+	float iMin = FLT_MAX, iMax = -FLT_MAX, jMin = FLT_MAX, jMax = -FLT_MAX;
+	vec2 corners[] = { ndcMin, vec2(ndcMin.x, ndcMax.y), ndcMax, vec2(ndcMax.x, ndcMin.y) };
+	for (vec2 c : corners) {
+		vec4 t = ndcToA*vec4(c, 0, 1);
+		iMin = min(iMin, t.x); iMax = max(iMax, t.x);
+		jMin = min(jMin, t.y); jMax = max(jMax, t.y);
+	}
+	int i0 = max(0, (int) floor(iMin)), i1 = min(ma.width-1, (int) floor(iMax));
+	int j0 = max(0, (int) floor(jMin)), j1 = min(ma.height-1, (int) floor(jMax));
+	// unrotated, equal texel size, untransformed uv: a row of a is a row of b, offset
+	bool shift = abs(aToB[0][0]-1) < 1e-4f && abs(aToB[1][0]) < 1e-4f && IsIdentity(a.uvTransform) && IsIdentity(b.uvTransform);
+	for (int j = j0; j <= j1; j++)
+		for (int i = i0; i <= i1; i += 64) {
+			uint64_t wa = ma.Get64(i, j), wb = 0;
+			if (i1-i < 63)
+				wa &= (2ull << (i1-i))-1;
+			if (!wa)
+				continue;
+			if (shift) {
+				vec4 t = aToB*vec4(i+.5f, j+.5f, 0, 1);
+				wb = mb.Get64((int) floor(t.x), (int) floor(t.y));
+			}
+			else
+				for (int k = 0; k < 64; k++) {
+					if (!((wa >> k) & 1))
+						continue;
+					vec4 p(i+k+.5f, j+.5f, 0, 1), ua = aToUv*p, ub = aToBUv*p, t = aToB*p;
+					if (ua.x >= 0 && ua.x <= 1 && ua.y >= 0 && ua.y <= 1 && ub.x >= 0 && ub.x <= 1 && ub.y >= 0 && ub.y <= 1 &&
+						mb.Get((int) floor(t.x), (int) floor(t.y)))
+						wb |= 1ull << k;
+				}
+			if (wa & wb)
+				return true;
+		}
+	return false;
+}
+
+} // end namespace
+
+int FindCollisions(vector<Sprite *> &sprites, int nThreads, bool pixels) {
+	int nsprites = sprites.size();
+	if (pixels)
+		for (Sprite *s : sprites)
+			s->BuildMasks();	// before pair tests, which may run on several threads
+	vector<SpriteBox> boxes(nsprites);
+	vec2 gridMin(FLT_MAX, FLT_MAX), gridMax(-FLT_MAX, -FLT_MAX);
+	float cellSize = 0;
+	for (int i = 0; i < nsprites; i++) {
+		sprites[i]->id = i;
+		SpriteBox &b = boxes[i] = GetBox(*sprites[i]);
+		gridMin = vec2(min(gridMin.x, b.min.x), min(gridMin.y, b.min.y));
+		gridMax = vec2(max(gridMax.x, b.max.x), max(gridMax.y, b.max.y));
+		cellSize += max(b.max.x-b.min.x, b.max.y-b.min.y)/nsprites;
+	}
+	// uniform grid, cell about the mean sprite extent, at most 512 by 512 cells
+	vec2 extent = gridMax-gridMin;
+	cellSize = max(cellSize, max(extent.x, extent.y)/512);
+	cellSize = max(cellSize, 1e-6f);
+	int nx = 1+(int) (extent.x/cellSize), ny = 1+(int) (extent.y/cellSize);
+	auto Cell = [&](vec2 p, int &x, int &y) {
+		x = min(nx-1, (int) ((p.x-gridMin.x)/cellSize));
+		y = min(ny-1, (int) ((p.y-gridMin.y)/cellSize));
+	};
+	vector<vector<int>> cells(nsprites? nx*ny : 0);
+	for (int i = 0; i < nsprites; i++) {
+		int x1, y1, x2, y2;
+		Cell(boxes[i].min, x1, y1);
+		Cell(boxes[i].max, x2, y2);
+		for (int y = y1; y <= y2; y++)
+			for (int x = x1; x <= x2; x++)
+				cells[y*nx+x].push_back(i);
+	}
+	// pair pass: each pair is tested once, in the cell holding the minimum corner of the bounds' intersection
+	if (nThreads <= 0)
+		nThreads = (int) std::thread::hardware_concurrency();
+	if (nThreads < 1 || nsprites < 256)
+		nThreads = 1;
+	vector<vector<int2>> pairs(nThreads);
+	auto TestPairs = [&](int thread) {
+		for (int i = thread; i < nsprites; i += nThreads) {
+			SpriteBox &a = boxes[i];
+			int x1, y1, x2, y2;
+			Cell(a.min, x1, y1);
+			Cell(a.max, x2, y2);
+			for (int y = y1; y <= y2; y++)
+				for (int x = x1; x <= x2; x++)
+					for (int j : cells[y*nx+x]) {
+						SpriteBox &b = boxes[j];
+						if (j <= i || a.max.x < b.min.x || b.max.x < a.min.x || a.max.y < b.min.y || b.max.y < a.min.y)
+							continue;
+						int cx, cy;
+						Cell(vec2(max(a.min.x, b.min.x), max(a.min.y, b.min.y)), cx, cy);
+						if (cx == x && cy == y && Overlap(a, b) && (!pixels ||
+							PixelOverlap(*sprites[i], *sprites[j], vec2(max(a.min.x, b.min.x), max(a.min.y, b.min.y)),
+														   vec2(min(a.max.x, b.max.x), min(a.max.y, b.max.y)))))
+							pairs[thread].push_back(int2(i, j));
+					}
+		}
+	};
+	if (nThreads == 1)
+		TestPairs(0);
+	else {
+		vector<std::thread> threads;
+		for (int t = 0; t < nThreads; t++)
+			threads.push_back(std::thread(TestPairs, t));
+		for (std::thread &t : threads)
+			t.join();
+	}
+	// record collision with the farther sprite (greater z), as drawn first by TestCollisions
+	int nPairs = 0;
+	for (Sprite *s : sprites)
+		s->collided.assign(nsprites, -1);
+	for (vector<int2> &p : pairs)
+		for (int2 ij : p) {
+			int i = ij.i1, j = ij.i2;
+			bool iFirst = sprites[i]->z > sprites[j]->z || (sprites[i]->z == sprites[j]->z && i < j);
+			if (iFirst)
+				sprites[j]->collided[i] = 1;
+			else
+				sprites[i]->collided[j] = 1;
+			nPairs++;
+		}
+	return nPairs;
+}
+
+bool Sprite::Intersect(Sprite &s, bool pixels) {
 	vec2 pts[] = { {-1,-1}, {-1,1}, {1,1}, {1,-1} };
 	float x1min = FLT_MAX, x1max = -FLT_MAX, y1min = FLT_MAX, y1max = -FLT_MAX;
 	float x2min = FLT_MAX, x2max = -FLT_MAX, y2min = FLT_MAX, y2max = -FLT_MAX;
@@ -217,9 +593,62 @@ bool Sprite::Intersect(Sprite &s) {
 	}
 	bool xNoOverlap = x1min > x2max || x2min > x1max;
 	bool yNoOverlap = y1min > y2max || y2min > y1max;
-	return !xNoOverlap && !yNoOverlap;
+	if (xNoOverlap || yNoOverlap)
+		return false;
+	if (pixels) {
+		BuildMasks();
+		s.BuildMasks();
+	}
+	return !pixels || PixelOverlap(*this, s, vec2(max(x1min, x2min), max(y1min, y2min)), vec2(min(x1max, x2max), min(y1max, y2max)));
 }
 
+// Texture Arrays
+
+namespace {
+
+float Sample(unsigned char *pixels, int width, int height, int nChannels, int channel, float x, float y) {
+	// bilinear, (x, y) in pixels
+	x = x < 0? 0 : x > width-1? (float) (width-1) : x;
+	y = y < 0? 0 : y > height-1? (float) (height-1) : y;
+	int i = (int) x, j = (int) y, i1 = i < width-1? i+1 : i, j1 = j < height-1? j+1 : j;
+	float a = x-i, b = y-j;
+	auto P = [&](int ii, int jj) { return (float) pixels[nChannels*(jj*width+ii)+channel]; };
+	return (1-b)*((1-a)*P(i, j)+a*P(i1, j))+b*((1-a)*P(i, j1)+a*P(i1, j1));
+}
+
+void ToLayer(unsigned char *pixels, int width, int height, int nChannels, unsigned char *matte, int layerWidth, int layerHeight, unsigned char *layer) {
+	// resample to rgba layer; opacity from 4th channel, else from matte (width by height, one channel), else 1
+	float sx = (float) width/layerWidth, sy = (float) height/layerHeight;
+	for (int j = 0; j < layerHeight; j++)
+		for (int i = 0; i < layerWidth; i++, layer += 4) {
+			float x = (i+.5f)*sx-.5f, y = (j+.5f)*sy-.5f;
+			for (int k = 0; k < 3; k++)
+				layer[k] = (unsigned char) Sample(pixels, width, height, nChannels, nChannels < 3? 0 : k, x, y);
+			layer[3] = (unsigned char) (nChannels == 4? Sample(pixels, width, height, 4, 3, x, y) :
+										matte? Sample(matte, width, height, 1, 0, x, y) : 255);
+		}
+}
+
+void LoadTextureArray(GLuint textureArray, int width, int height, int nLayers, unsigned char *rgba) {
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, nLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+} // end namespace
+
+float SpriteTime() {
+	static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Initialization
+
 void Sprite::Initialize(GLuint texName, float z) {
 	this->z = z;
 	textureName = texName;
@@ -227,23 +656,52 @@ void Sprite::Initialize(GLuint texName, float z) {
 
 void Sprite::Initialize(string imageFile, float z) {
 	this->z = z;
+	// texture shared (and cached) via ReadTexture; masks decoded only if needed
 	textureName = ReadTexture(imageFile.c_str(), true, &nTexChannels, &imgWidth, &imgHeight);
+	// coverage from alpha
+	maskFile = nTexChannels == 4? imageFile : "";
+	maskChannel = 3;
+	masksBuilt = false;
 }
 
 void Sprite::Initialize(string imageFile, string matFile, float z) {
 	Initialize(imageFile, z);
+	// coverage from matte, unless alpha (which the shader uses instead)
+	if (nTexChannels != 4) {
+		maskFile = matFile;
+		maskChannel = 0;
+	}
 	matName = ReadTexture(matFile.c_str());
 }
 
 void Sprite::Initialize(vector<string> &imageFiles, string matFile, float z) {
 	this->z = z;
-	nFrames = imageFiles.size();
-	textureNames.resize(nFrames);
-	for (size_t i = 0; i < nFrames; i++)
-		textureNames[i] = ReadTexture(imageFiles[i].c_str());
+	// frames as layers of one texture array
+	vector<unsigned char> layers;
+	nFrames = 0;
+	for (size_t i = 0; i < imageFiles.size(); i++) {
+		DecodedImage image;
+		if (!DecodeImage(imageFiles[i].c_str(), image))
+			continue;
+		if (!nFrames) {
+			imgWidth = image.width;
+			imgHeight = image.height;
+		}
+		layers.resize((nFrames+1)*imgWidth*imgHeight*4);
+		ToLayer(image.pixels, image.width, image.height, image.nChannels, NULL, imgWidth, imgHeight, &layers[nFrames*imgWidth*imgHeight*4]);
+		nFrames++;
+	}
+	if (nFrames) {
+		if (!frameArray)
+			glGenTextures(1, &frameArray);
+		LoadTextureArray(frameArray, imgWidth, imgHeight, nFrames, layers.data());
+	}
+	maskFile = matFile;
+	maskChannel = 0;
+	masksBuilt = false;
 	if (!matFile.empty())
 		matName = ReadTexture(matFile.c_str());
-	change = clock()+(time_t)(frameDuration*CLOCKS_PER_SEC);
+	startTime = SpriteTime();
 }
 
 bool Sprite::Hit(double x, double y) {
@@ -320,16 +778,16 @@ void Sprite::Display(mat4 *fullview, int textureUnit) {
 		s = SpriteSpace::GetShader();
 	glUseProgram(s);
 	glActiveTexture(GL_TEXTURE0+textureUnit);
-	if (nFrames) { // animation
-		time_t now = clock();
-		if (now > change) {
-			frame = (frame+1)%nFrames;
-			change = now+(time_t)(frameDuration*CLOCKS_PER_SEC);
-		}
-		glBindTexture(GL_TEXTURE_2D, textureNames[frame]);
-	}
-	else glBindTexture(GL_TEXTURE_2D, textureName);
+	glBindTexture(GL_TEXTURE_2D, textureName);
 	SetUniform(s, "textureImage", (int) textureUnit);
+	// animation frame chosen by shader; frames bound to own unit (samplers of different type can't share)
+	glActiveTexture(GL_TEXTURE0+textureUnit+2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, frameArray);
+	SetUniform(s, "textureFrames", (int) textureUnit+2);
+	SetUniform(s, "nFrames", (int) nFrames);
+	SetUniform(s, "time", SpriteTime());
+	SetUniform(s, "startTime", startTime);
+	SetUniform(s, "frameDuration", frameDuration);
 	SetUniform(s, "useMat", matName > 0);
 	SetUniform(s, "nTexChannels", nTexChannels);
 	SetUniform(s, "z", z);
@@ -350,6 +808,134 @@ void Sprite::Display(mat4 *fullview, int textureUnit) {
 void Sprite::SetFrameDuration(float dt) { frameDuration = dt; }
 
 void Sprite::Release() {
-	glDeleteBuffers(1, &textureName);
-	if (matName > 0) glDeleteBuffers(1, &matName);
+	// textures are shared via ReadTexture
+	ReleaseTexture(textureName);
+	ReleaseTexture(matName);
+	if (frameArray)
+		glDeleteTextures(1, &frameArray);
+	textureName = matName = frameArray = 0;
+	nFrames = 0;
+	masks.resize(0);
+	maskFile = "";
+	masksBuilt = false;
+}
+
+// Sprite Batch
+
+int SpriteBatch::AddImage(unsigned char *pixels, int width, int height, int nChannels, unsigned char *matte) {
+	// matte, if any, is width by height, one channel
+	if (!pixels || width < 1 || height < 1 || nChannels < 1)
+		return -1;
+	layers.resize((nLayers+1)*layerWidth*layerHeight*4);
+	ToLayer(pixels, width, height, nChannels, matte, layerWidth, layerHeight, layers.data()+nLayers*layerWidth*layerHeight*4);
+	return nLayers++;
+}
+
+int SpriteBatch::AddImage(string imageFile, string matFile) {
+	DecodedImage image, mat;
+	if (!DecodeImage(imageFile.c_str(), image))
+		return -1;
+	vector<unsigned char> matte;
+	if (!matFile.empty() && DecodeImage(matFile.c_str(), mat)) {
+		// red channel of matte, resampled to image size
+		matte.resize(image.width*image.height);
+		float sx = (float) mat.width/image.width, sy = (float) mat.height/image.height;
+		for (int j = 0; j < image.height; j++)
+			for (int i = 0; i < image.width; i++)
+				matte[j*image.width+i] = (unsigned char) Sample(mat.pixels, mat.width, mat.height, mat.nChannels, 0, (i+.5f)*sx-.5f, (j+.5f)*sy-.5f);
+	}
+	return AddImage(image.pixels, image.width, image.height, image.nChannels, matte.size()? matte.data() : NULL);
+}
+
+int SpriteBatch::NLayers() { return nLayers; }
+
+int SpriteBatch::AddFrames(vector<string> &imageFiles, string matFile) {
+	int first = nLayers;
+	for (size_t i = 0; i < imageFiles.size(); i++)
+		if (AddImage(imageFiles[i], matFile) < 0)
+			return -1;
+	return imageFiles.size()? first : -1;
+}
+
+void SpriteBatch::LoadLayers() {
+	// (re)allocate texture array if layers added
+	if (!textureArray)
+		glGenTextures(1, &textureArray);
+	LoadTextureArray(textureArray, layerWidth, layerHeight, nLayers, layers.data());
+	nLayersLoaded = nLayers;
+}
+
+void SpriteBatch::Clear() { instances.resize(0); }
+
+void SpriteBatch::Add(mat4 ptTransform, float z, int layer, mat4 uvTransform, int nFrames, float frameDuration, float startTime) {
+	Instance i;
+	for (int k = 0; k < 4; k++)
+		i.ptRows[k] = ptTransform[k];
+	for (int k = 0; k < 2; k++)
+		i.uvRows[k] = uvTransform[k];
+	i.z = z;
+	i.layer = (float) layer;
+	i.nFrames = (float) (nFrames > 1? nFrames : 1);
+	i.frameDuration = frameDuration > 0? frameDuration : 1;
+	i.startTime = startTime;
+	instances.push_back(i);
+}
+
+void SpriteBatch::Add(Sprite &s, int layer) { Add(s.ptTransform, s.z, layer, s.uvTransform, s.nFrames, s.frameDuration, s.startTime); }
+
+int SpriteBatch::NInstances() { return (int) instances.size(); }
+
+void SpriteBatch::Display(mat4 *view, int textureUnit) {
+	int n = (int) instances.size();
+	if (!n || !nLayers)
+		return;
+	GLuint program = SpriteSpace::GetBatchShader();
+	glUseProgram(program);
+	if (nLayersLoaded != nLayers)
+		LoadLayers();
+	// back to front
+	vector<int> order(n);
+	for (int i = 0; i < n; i++)
+		order[i] = i;
+	stable_sort(order.begin(), order.end(), [this](int a, int b) { return instances[a].z > instances[b].z; });
+	sorted.resize(n);
+	for (int i = 0; i < n; i++)
+		sorted[i] = instances[order[i]];
+	// instance buffer, orphaned each frame
+	if (!vao) {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		const char *names[] = { "pt0", "pt1", "pt2", "pt3", "uv0", "uv1", "zLayer", "flip" };
+		int sizes[] = { 4, 4, 4, 4, 4, 4, 2, 3 };
+		for (int k = 0, offset = 0; k < 8; offset += sizes[k++]*sizeof(float)) {
+			VertexAttribPointer(program, names[k], sizes[k], sizeof(Instance), (void *) (size_t) offset);
+			GLint id = glGetAttribLocation(program, names[k]);
+			if (id >= 0)
+				glVertexAttribDivisor(id, 1);
+		}
+	}
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, n*sizeof(Instance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, n*sizeof(Instance), sorted.data());
+	glActiveTexture(GL_TEXTURE0+textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	SetUniform(program, "textureArray", textureUnit);
+	SetUniform(program, "view", view? *view : mat4());
+	SetUniform(program, "time", SpriteTime());
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n);
+	glBindVertexArray(0);
+}
+
+void SpriteBatch::Release() {
+	if (textureArray)
+		glDeleteTextures(1, &textureArray);
+	if (vbo)
+		glDeleteBuffers(1, &vbo);
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	textureArray = vao = vbo = 0;
+	nLayersLoaded = 0;
 }
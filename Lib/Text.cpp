@@ -8,7 +8,11 @@
 #include "Letters.h"
 #include "Text.h"
 #include <map>
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
 // if FreeType not linked, undefine next line:
 // #define FREETYPE_OK
@@ -18,7 +22,7 @@
 	if (format) {                                      \
 		va_list ap;                                    \
 		va_start(ap, format);                          \
-		_vsnprintf(buffer, maxBufferSize, format, ap); \
+		vsnprintf(buffer, maxBufferSize, format, ap);  \
 		va_end(ap);                                    \
 	}                                                  \
 }
@@ -41,7 +45,7 @@ void Text(float x, float y, vec3 color, float scale, const char *format, ...) {
 	FormatString(text, 500, format);
 	Letters((int) x, (int) y, text, color, scaleAdj*scale);
 }
-void RenderText(const char *text, float x, float y, vec3 color, float scale, mat4 view) {
+void RenderText(const char *text, float x, float y, vec3 color, float scale, mat4 view, bool vertical) {
 	vec2 s = ScreenPoint(vec3(x, y, 0), view);
 	Letters((int) s.x, (int) s.y, text, color, scaleAdj*scale);
 }
@@ -64,8 +68,6 @@ CharacterSet *SetFont(const char *fontName, int charRes, int pixelRes, bool forc
 
 using std::string;
 
-static GLuint textShaderProgram = 0, textVertexBuffer = 0;
-
 CharacterSet *currentFont = NULL;
 
 // font repository
@@ -73,8 +75,82 @@ struct Compare { bool operator() (const string &a, const string &b) const { retu
 typedef std::map<string, CharacterSet, Compare> CharacterSets;
 CharacterSets fonts;
 
+// Signed Distance Field
+
+namespace {
+
+const float far = 1e20f;
+
+void DistanceTransform1D(float *f, int n, int stride, std::vector<float> &d, std::vector<int> &v, std::vector<float> &z) {
+	// squared distance transform of sampled function f (Felzenszwalb & Huttenlocher), in place
+	d.resize(n); v.resize(n); z.resize(n+1);
+	int k = 0;
+	v[0] = 0;
+	z[0] = -far;
+	z[1] = far;
+	for (int q = 1; q < n; q++) {
+		float s;
+		for (;;) {
+			int r = v[k];
+			s = ((f[q*stride]+q*q)-(f[r*stride]+r*r))/(2*q-2*r);
+			if (s > z[k] || k == 0) break;
+			k--;
+		}
+		if (s <= z[k]) s = z[k];
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = far;
+	}
+	k = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[k+1] < q)
+			k++;
+		d[q] = (q-v[k])*(q-v[k])+f[v[k]*stride];
+	}
+	for (int q = 0; q < n; q++)
+		f[q*stride] = d[q];
+}
+
+void DistanceTransform(std::vector<float> &grid, int w, int h) {
+	// squared distance to nearest zero-valued cell
+	std::vector<float> d, z;
+	std::vector<int> v;
+	for (int i = 0; i < w; i++)
+		DistanceTransform1D(&grid[i], h, w, d, v, z);
+	for (int j = 0; j < h; j++)
+		DistanceTransform1D(&grid[j*w], w, 1, d, v, z);
+}
+
+void DistanceField(unsigned char *coverage, int w, int h, int border, std::vector<unsigned char> &field) {
+	// field is (w+2*border) by (h+2*border); .5 (128) at glyph edge, increasing inwards, reaching 0 border pixels outside
+	int fw = w+2*border, fh = h+2*border;
+	std::vector<float> toInside(fw*fh, far), toOutside(fw*fh, 0.f);
+	for (int j = 0; j < h; j++)
+		for (int i = 0; i < w; i++)
+			if (coverage[j*w+i] > 127) {
+				int k = (j+border)*fw+i+border;
+				toInside[k] = 0;
+				toOutside[k] = far;
+			}
+	DistanceTransform(toInside, fw, fh);
+	DistanceTransform(toOutside, fw, fh);
+	field.resize(fw*fh);
+	for (int k = 0; k < fw*fh; k++) {
+		// edge lies halfway between inside and outside pixel centers
+		float d = toInside[k] > 0? sqrt(toInside[k])-.5f : .5f-sqrt(toOutside[k]);
+		float t = .5f-d/(2*border);
+		field[k] = (unsigned char) (255*(t < 0? 0 : t > 1? 1 : t));
+	}
+}
+
+} // end namespace
+
+// Atlas
+
 void SetCharacterSet(CharacterSet &cs, const char *fontName, int charRes, int pixelRes) {
 	cs.charRes = charRes;
+	cs.border = pixelRes/12 > 2? pixelRes/12 : 2;
 	// init FreeType, load font face
 	FT_Library ft;
 	FT_Face face;
@@ -85,111 +161,109 @@ void SetCharacterSet(CharacterSet &cs, const char *fontName, int charRes, int pi
 			printf("problem with FreeType, font load, or font face\n");
 			return;
 	}
-	// load glyphs
+	// load glyphs, convert to distance fields
+	std::vector<unsigned char> fields[128];
+	int2 fieldSizes[128], origins[128];
+	int area = 0, maxWidth = 0;
 	FT_GlyphSlot g = face->glyph;
 	for (GLubyte c = 0; c < 128; c++) {
+		fieldSizes[c] = int2(0, 0);
 		FT_Error r = FT_Load_Char(face, c, FT_LOAD_RENDER);
-		if (r)
+		if (r) {
 			printf("FreeType: failed to load Glyph\n");
-		else {
-			// generate texture
-			GLuint texture;
-			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_2D, texture);
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, g->bitmap.width, g->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE, g->bitmap.buffer);
-			// texture options
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			// store character
-			cs.characters[c] = Character(texture, int2(g->bitmap.width, g->bitmap.rows), int2(g->bitmap_left, g->bitmap_top), (GLuint) g->advance.x);
+			continue;
 		}
+		int w = g->bitmap.width, h = g->bitmap.rows;
+		cs.characters[c] = Character(0, vec4(0, 0, 0, 0), int2(w, h), int2(g->bitmap_left, g->bitmap_top), (GLuint) g->advance.x);
+		if (!w || !h)
+			continue;
+		DistanceField(g->bitmap.buffer, w, h, cs.border, fields[c]);
+		fieldSizes[c] = int2(w+2*cs.border, h+2*cs.border);
+		area += (fieldSizes[c].i1+1)*(fieldSizes[c].i2+1);
+		maxWidth = fieldSizes[c].i1+1 > maxWidth? fieldSizes[c].i1+1 : maxWidth;
 	}
 	FT_Done_Face(face);
 	FT_Done_FreeType(ft);
+	// pack rows (shelves) of fields, one pixel apart
+	int width = 64, height = 0, x = 0, y = 0, rowHeight = 0;
+	while (width*width < area || width < maxWidth)
+		width *= 2;
+	for (int c = 0; c < 128; c++) {
+		int2 s = fieldSizes[c];
+		if (!s.i1)
+			continue;
+		if (x+s.i1 > width) {
+			x = 0;
+			y += rowHeight+1;
+			rowHeight = 0;
+		}
+		origins[c] = int2(x, y);
+		x += s.i1+1;
+		rowHeight = s.i2 > rowHeight? s.i2 : rowHeight;
+	}
+	height = y+rowHeight;
+	std::vector<unsigned char> pixels(width*height, 0);
+	for (int c = 0; c < 128; c++) {
+		int2 s = fieldSizes[c], o = origins[c];
+		if (!s.i1)
+			continue;
+		for (int j = 0; j < s.i2; j++)
+			memcpy(&pixels[(o.i2+j)*width+o.i1], &fields[c][j*s.i1], s.i1);
+		cs.characters[c].uv = vec4((float) o.i1/width, (float) o.i2/height, (float) (o.i1+s.i1)/width, (float) (o.i2+s.i2)/height);
+	}
+	// one texture per font
+	if (cs.atlas)
+		glDeleteTextures(1, &cs.atlas);
+	glGenTextures(1, &cs.atlas);
+	glBindTexture(GL_TEXTURE_2D, cs.atlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	for (int c = 0; c < 128; c++)
+		cs.characters[c].textureID = cs.atlas;
 }
 
 CharacterSet *SetFont(const char *fontName, int charRes, int pixelRes, bool forceInit) {
 	CharacterSets::iterator it = fonts.find(fontName);
 	if (it == fonts.end() || forceInit) {
-		CharacterSet cs;
-		SetCharacterSet(cs, fontName, charRes, pixelRes);
-		fonts[string(fontName)] = cs;
+		SetCharacterSet(fonts[string(fontName)], fontName, charRes, pixelRes);
 		it = fonts.find(fontName);
 	}
 	currentFont = &it->second;
 	return currentFont;
 }
 
-static const char *textVertexShader = "\
-	#version 130                                    \n\
-	in vec4 point;							        \n\
-	out vec2 vUv;                                   \n\
-	uniform mat4 view;                              \n\
-	void main() {                                   \n\
-		gl_Position = view*vec4(point.xy, 0, 1);    \n\
-		vUv = point.zw;                             \n\
-	}                                               \n";
-
-static const char *textPixelShader = "\
-	#version 130                                    \n\
-	in vec2 vUv;                                    \n\
-	out vec4 pColor;                                \n\
-	uniform sampler2D textureImage;                 \n\
-	uniform vec3 color;                             \n\
-	void main() {                                   \n\
-		float a = texture(textureImage, vUv).r;     \n\
-		pColor = vec4(color, a);                    \n\
-	}                                               \n";
+// Rendering
 
 void RenderText(const char *text, float x, float y, vec3 color, float scale, mat4 view, bool vertical) {
 	if (!currentFont) {
 		SetFont("C:/Fonts/OpenSans/OpenSans-Regular.ttf", 64, 100);  // unsure exact effect of charRes, pixelRes
 		return;
 	}
-	if (!textShaderProgram)
-		textShaderProgram = LinkProgramViaCode(&textVertexShader, &textPixelShader);
-	glUseProgram(textShaderProgram);
 	scale /= (float) currentFont->charRes;
-	// create quad vertex buffer and build characters
-	if (textVertexBuffer == 0)
-		glGenBuffers(1, &textVertexBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, textVertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float)*6*4, NULL, GL_DYNAMIC_DRAW);
-	VertexAttribPointer(textShaderProgram, "point", 4, 4*sizeof(float), 0);
-	SetUniform(textShaderProgram, "view", view);
-	SetUniform(textShaderProgram, "color", color);
-	// SetUniform(textShaderProgram, "textureImage", (int) textureID); // not needed? (defaults to 0?)
-	glActiveTexture(GL_TEXTURE0);
-	glBindBuffer(GL_ARRAY_BUFFER, textVertexBuffer);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	// one quad per visible glyph, drawn together from the font atlas
+	std::vector<vec4> quads;
+	float b = (float) currentFont->border;
 	for (const char *c = text; *c; c++) {
-		Character ch = currentFont->characters[(int)*c];
-		float xpos = x+ch.bearing.i1*scale, ypos = y-(ch.gSize.i2-ch.bearing.i2)*scale;
-		float w = ch.gSize.i1*scale, h = ch.gSize.i2*scale;
-		glBindTexture(GL_TEXTURE_2D, ch.textureID);
-		// update vertex memory
-#ifdef GL_QUADS
-		float vertices[][4] = {{xpos, ypos+h, 0, 0}, {xpos+w, ypos+h, 1, 0}, {xpos+w, ypos, 1, 1}, {xpos, ypos, 0, 1}};
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glDrawArrays(GL_QUADS, 0, 4);     // render glyph texture with quad
-#else
-		float vertices[][4] = {{xpos, ypos+h, 0, 0}, {xpos+w, ypos+h, 1, 0}, {xpos+w, ypos, 1, 1},
-							   {xpos, ypos+h, 0, 0}, {xpos+w, ypos, 1, 1},   {xpos, ypos, 0, 1}};
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glDrawArrays(GL_TRIANGLES, 0, 6); // render glyph texture with triangles
-#endif
+		Character &ch = currentFont->characters[*c & 127];
+		if (ch.gSize.i1 && ch.gSize.i2) {
+			float xpos = x+(ch.bearing.i1-b)*scale, ypos = y-(ch.gSize.i2-ch.bearing.i2+b)*scale;
+			float w = (ch.gSize.i1+2*b)*scale, h = (ch.gSize.i2+2*b)*scale;
+			vec4 q[] = { vec4(xpos, ypos+h, ch.uv[0], ch.uv[1]), vec4(xpos+w, ypos+h, ch.uv[2], ch.uv[1]),
+						 vec4(xpos+w, ypos, ch.uv[2], ch.uv[3]), vec4(xpos, ypos, ch.uv[0], ch.uv[3]) };
+			quads.insert(quads.end(), q, q+4);
+		}
 		if (vertical)
 			y -= 24*scale;
 		else
 			x += (ch.advance >> 6)*scale;     // advance character position in terms of 1/64 pixel
 	}
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	if (quads.size())
+		AtlasQuads(currentFont->atlas, 2, (int) quads.size()/4, quads.data(), color, view);
 }
 
 float TextWidth(float scale, const char *format, ...) {
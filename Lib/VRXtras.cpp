@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <openvr.h>
+#include "MockVR.h"
 #include "VRXtras.h"
 
 // see https://github.com/ValveSoftware/openvr/wiki/API-Documentation
@@ -34,21 +35,35 @@ string GetTrackedDeviceString(IVRSystem *pHmd, TrackedDeviceIndex_t unDevice, Tr
 }
 
 bool VROOM::HmdPresent() {
-	return VR_IsHmdPresent();
+	return mock || VR_IsHmdPresent();
 }
 
 int VROOM::RecommendedWidth() {
+	if (mock)
+		return mock->recommendedWidth;
 	uint32_t recWidth = 0, recHeight = 0;
 	ivr->GetRecommendedRenderTargetSize(&recWidth, &recHeight);
 	return recWidth;
 }
 
 int VROOM::RecommendedHeight() {
+	if (mock)
+		return mock->recommendedHeight;
 	uint32_t recWidth = 0, recHeight = 0;
 	ivr->GetRecommendedRenderTargetSize(&recWidth, &recHeight);
 	return recHeight;
 }
 
+bool VROOM::InitMockVR(MockVR *m) {
+	mock = m;
+	openVR = true;
+	frameDuration = 1/m->refreshRate;
+	vsyncToPhotons = m->vsyncToPhotons;
+	UpdateDeviceIndices();
+	printf("mock VR runtime at %g Hz\n", m->refreshRate);
+	return true;
+}
+
 bool VROOM::InitOpenVR() {
 	// see HelloOpenVR_GLFW.cpp
 	openVR = VR_IsRuntimeInstalled();
@@ -91,9 +106,57 @@ bool VROOM::InitOpenVR() {
 		}
 	}
 	printf("%i base station\n", nBaseStations);
+	// display timing, for prediction
+	float frequency = ivr->GetFloatTrackedDeviceProperty(k_unTrackedDeviceIndex_Hmd, Prop_DisplayFrequency_Float);
+	if (frequency > 0)
+		frameDuration = 1/frequency;
+	vsyncToPhotons = ivr->GetFloatTrackedDeviceProperty(k_unTrackedDeviceIndex_Hmd, Prop_SecondsFromVsyncToPhotons_Float);
+	UpdateDeviceIndices();
 	return true;
 }
 
+// Tracked Devices
+
+void VROOM::UpdateDeviceIndices() {
+	if (mock) {
+		hmdIndex = MockVR::hmdIndex;
+		leftHandIndex = MockVR::leftHandIndex;
+		rightHandIndex = MockVR::rightHandIndex;
+		return;
+	}
+	if (!ivr)
+		return;
+	hmdIndex = ivr->IsTrackedDeviceConnected(k_unTrackedDeviceIndex_Hmd)? k_unTrackedDeviceIndex_Hmd : -1;
+	TrackedDeviceIndex_t left = ivr->GetTrackedDeviceIndexForControllerRole(TrackedControllerRole_LeftHand);
+	TrackedDeviceIndex_t right = ivr->GetTrackedDeviceIndexForControllerRole(TrackedControllerRole_RightHand);
+	if (left == k_unTrackedDeviceIndexInvalid || right == k_unTrackedDeviceIndexInvalid) {
+		// roles not assigned: assume first controller left, second right
+		TrackedDeviceIndex_t controllers[k_unMaxTrackedDeviceCount];
+		int nControllers = ivr->GetSortedTrackedDeviceIndicesOfClass(TrackedDeviceClass_Controller, controllers, k_unMaxTrackedDeviceCount);
+		if (left == k_unTrackedDeviceIndexInvalid && nControllers > 0)
+			left = controllers[0] != right? controllers[0] : nControllers > 1? controllers[1] : k_unTrackedDeviceIndexInvalid;
+		if (right == k_unTrackedDeviceIndexInvalid && nControllers > 1)
+			right = controllers[1] != left? controllers[1] : controllers[0];
+	}
+	leftHandIndex = left == k_unTrackedDeviceIndexInvalid? -1 : left;
+	rightHandIndex = right == k_unTrackedDeviceIndexInvalid? -1 : right;
+	printf("tracked devices: HMD %i, left hand %i, right hand %i\n", hmdIndex, leftHandIndex, rightHandIndex);
+}
+
+void VROOM::PollEvents() {
+	if (!ivr)
+		return;
+	VREvent_t e;
+	bool changed = false;
+	while (ivr->PollNextEvent(&e, sizeof(e))) {
+		uint32_t t = e.eventType;
+		if (t == VREvent_TrackedDeviceActivated || t == VREvent_TrackedDeviceDeactivated || t == VREvent_TrackedDeviceRoleChanged)
+			changed = true;
+	}
+	if (changed)
+		UpdateDeviceIndices();
+}
+
 const char *GetCompositorError(int err) {
 	return
 		err == VRCompositorError_None?							"None" :
@@ -173,70 +236,88 @@ void PrintPoses() {
 }
 
 
+void SetTransform(TrackedDevicePose_t *poses, int index, mat4 &m) {
+	if (index < 0)
+		return;
+	TrackedDevicePose_t &pose = poses[index];
+	if (pose.bPoseIsValid && pose.bDeviceIsConnected)
+		m = mat4from3x4(pose.mDeviceToAbsoluteTracking);
+		// From3By4(m) would seem proper transfer 3x4 to 4x4, but x-rotation reversed
+}
+
 bool VROOM::GetTransforms(mat4 &head, mat4 &leftHand, mat4 &rightHand) {
-	EVRCompositorError err = VRCompositor()->WaitGetPoses(pRenderPoseArray, k_unMaxTrackedDeviceCount, pGamePoseArray, k_unMaxTrackedDeviceCount);
+	EVRCompositorError err = mock?
+		mock->WaitGetPoses(pRenderPoseArray, k_unMaxTrackedDeviceCount, pGamePoseArray, k_unMaxTrackedDeviceCount) :
+		VRCompositor()->WaitGetPoses(pRenderPoseArray, k_unMaxTrackedDeviceCount, pGamePoseArray, k_unMaxTrackedDeviceCount);
 	if (err) {
 		printf("VRCompositor:WaitGetPoses: %s\n", GetCompositorError(err));
 		return false;
 	}
 	if (!onceVR) PrintPoses();
-	// it seems device[0] = HMD, device[2] = left hand, device[5] = right hand
-	TrackedDeviceIndex_t devices[100];
-	// headsets
-	int nHMDs = ivr->GetSortedTrackedDeviceIndicesOfClass(TrackedDeviceClass_HMD, devices, 100);
-	if (!onceVR) printf("%i head displays\n", nHMDs);
-	TrackedDevicePose_t pose = pGamePoseArray[devices[0]];
-	if (pose.bPoseIsValid && pose.bDeviceIsConnected) {
-		HmdMatrix34_t m = pose.mDeviceToAbsoluteTracking;
-		// head = From3By4(m);
-		//	   this would seem proper transfer 3x4 to 4x4, but x-rotation reversed
-		head = mat4from3x4(m);
-	} 
-	// hands
-	int nControllers = ivr->GetSortedTrackedDeviceIndicesOfClass(TrackedDeviceClass_Controller, devices, 100);
-	if (!onceVR) printf("%i controllers\n", nControllers);
-	// assuming devices[0] left, devices[1] right 
-	if (nControllers > 0) {
-		pose = pGamePoseArray[devices[0]];
-		if (pose.bPoseIsValid && pose.bDeviceIsConnected)
-			leftHand = mat4from3x4(pose.mDeviceToAbsoluteTracking);
-		//	leftHand = From3By4(pose.mDeviceToAbsoluteTracking);
-	}
-	if (nControllers > 1) {
-		pose = pGamePoseArray[devices[1]];
-		if (pose.bPoseIsValid && pose.bDeviceIsConnected)
-			rightHand = mat4from3x4(pose.mDeviceToAbsoluteTracking);
-		//	rightHand = From3By4(pose.mDeviceToAbsoluteTracking);
-	}
+	PollEvents();
+	SetTransform(pGamePoseArray, hmdIndex, head);
+	SetTransform(pGamePoseArray, leftHandIndex, leftHand);
+	SetTransform(pGamePoseArray, rightHandIndex, rightHand);
 	onceVR = true;
 	return true;
 }
 
+float VROOM::SecondsToPhotons() {
+	float sinceVsync = 0;
+	if (mock)
+		mock->GetTimeSinceLastVsync(&sinceVsync, NULL);
+	else if (ivr)
+		ivr->GetTimeSinceLastVsync(&sinceVsync, NULL);
+	return frameDuration-sinceVsync+vsyncToPhotons;
+}
+
+bool VROOM::GetPredictedTransforms(float secondsFromNow, mat4 &head, mat4 &leftHand, mat4 &rightHand) {
+	TrackedDevicePose_t poses[k_unMaxTrackedDeviceCount];
+	if (mock)
+		mock->GetDeviceToAbsoluteTrackingPose(secondsFromNow, poses, k_unMaxTrackedDeviceCount);
+	else if (ivr && VRCompositor())
+		ivr->GetDeviceToAbsoluteTrackingPose(VRCompositor()->GetTrackingSpace(), secondsFromNow, poses, k_unMaxTrackedDeviceCount);
+	else
+		return false;
+	SetTransform(poses, hmdIndex, head);
+	SetTransform(poses, leftHandIndex, leftHand);
+	SetTransform(poses, rightHandIndex, rightHand);
+	return true;
+}
+
 
 // transfer images to HMD
 
+bool Compositor(MockVR *mock) { return mock || VRCompositor(); }
+
+void Submit(MockVR *mock, EVREye eye, Texture_t *texture, VRTextureBounds_t *bounds = NULL) {
+	EVRCompositorError err = mock? mock->Submit(eye, texture, bounds) : VRCompositor()->Submit(eye, texture, bounds);
+	if (err) printf("VRCompositor:Submit(%s): %s\n", eye == Eye_Left? "left" : "right", GetCompositorError(err));
+}
+
+void PresentHandoff(MockVR *mock) {
+	glFlush();
+	if (!mock)
+		VRCompositor()->PostPresentHandoff();
+}
+
 void VROOM::SubmitOpenGLFrames(GLuint leftTextureUnit, GLuint rightTextureUnit) {
-	Texture_t leftEyeTexture = {(void *) leftTextureUnit, TextureType_OpenGL, ColorSpace_Auto}; // Linear};
-	Texture_t rightEyeTexture = {(void *) rightTextureUnit, TextureType_OpenGL, ColorSpace_Auto}; // Linear};
-	EVRCompositorError err = VRCompositorError_None;
-	if (!VRCompositor())
+	Texture_t leftEyeTexture = {(void *) (uintptr_t) leftTextureUnit, TextureType_OpenGL, ColorSpace_Auto}; // Linear};
+	Texture_t rightEyeTexture = {(void *) (uintptr_t) rightTextureUnit, TextureType_OpenGL, ColorSpace_Auto}; // Linear};
+	if (!Compositor(mock))
 		return;
 	glBindTexture(GL_TEXTURE_2D, leftTextureUnit); // ?
-	err = VRCompositor()->Submit(Eye_Left, &leftEyeTexture);
-	if (err) printf("VRCompositor:Submit(left): %s\n", GetCompositorError(err));
+	Submit(mock, Eye_Left, &leftEyeTexture);
 	glBindTexture(GL_TEXTURE_2D, rightTextureUnit); // ?
-	err = VRCompositor()->Submit(Eye_Right, &rightEyeTexture);
-	if (err) printf("VRCompositor:Submit(right): %s\n", GetCompositorError(err));
-	glFlush();
-	VRCompositor()->PostPresentHandoff();
+	Submit(mock, Eye_Right, &rightEyeTexture);
+	PresentHandoff(mock);
 }
 
-bool multisample = false; // *** fails ***
+bool multisample = false; // *** fails: can't glReadPixels a multisampled buffer; see SetEyeSamples
 
 bool VROOM::InitFrameBuffer(int w, int h) {
 	width = w;
 	height = h;
-	pixels = (float *) new float[4*width*height]; // deleted in destructor
 	// make new frame buffer of texture and depth buffer
 	glGenFramebuffers(1, &framebuffer);
 	glGenTextures(1, &framebufferTextureName);
@@ -279,8 +360,10 @@ bool VROOM::InitFrameBuffer(int w, int h) {
 }
 
 void VROOM::CopyFramebufferToEyeTexture(GLuint textureName, GLuint textureUnit) {
+	if (!pixels)
+		pixels = new unsigned char[4*width*height]; // deleted in destructor
 	// read from framebuffer
-	glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	// store pixels as GL texture
 	glActiveTexture(GL_TEXTURE0+textureUnit);
 	glBindTexture(GL_TEXTURE_2D, textureName); // bind active texture to textureName
@@ -290,10 +373,161 @@ void VROOM::CopyFramebufferToEyeTexture(GLuint textureName, GLuint textureUnit)
 //	***** so, as test, perhaps following two lines were causing the error
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, pixels);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 //	***** could Occulus want GL_RGB, rather than GL_RGBA??
 }
 
+// eye render targets
+
+bool VROOM::InitEyeFramebuffers(int w, int h) {
+	width = w;
+	height = h;
+	glGenFramebuffers(2, eyeFramebuffers);
+	glGenTextures(2, eyeTextures);
+	glGenRenderbuffers(2, eyeDepthBuffers);
+	bool ok = true;
+	for (int e = 0; e < 2; e++) {
+		// color: immutable, single level, 8 bits per channel (compositor shares without conversion)
+		glBindTexture(GL_TEXTURE_2D, eyeTextures[e]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, eyeFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// depth
+		glBindRenderbuffer(GL_RENDERBUFFER, eyeDepthBuffers[e]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		// frame buffer
+		glBindFramebuffer(GL_FRAMEBUFFER, eyeFramebuffers[e]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, eyeDepthBuffers[e]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, eyeTextures[e], 0);
+		GLenum drawBuffers[1] = {GL_COLOR_ATTACHMENT0};
+		glDrawBuffers(1, drawBuffers);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			printf("bad eye frame buffer status\n");
+			ok = false;
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return ok;
+}
+
+bool VROOM::SetEyeSamples(int nSamples) {
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	if (nSamples != 1 && nSamples != 2 && nSamples != 4 && nSamples != 8) {
+		printf("SetEyeSamples: %i samples not supported (use 1, 2, 4, 8)\n", nSamples);
+		return false;
+	}
+	if (nSamples > maxSamples) {
+		printf("SetEyeSamples: %i samples requested, %i available\n", nSamples, maxSamples);
+		nSamples = maxSamples;
+	}
+	if (msFramebuffer) {
+		glDeleteFramebuffers(1, &msFramebuffer);
+		glDeleteRenderbuffers(1, &msColorBuffer);
+		glDeleteRenderbuffers(1, &msDepthBuffer);
+		msFramebuffer = msColorBuffer = msDepthBuffer = 0;
+	}
+	eyeSamples = nSamples;
+	if (eyeSamples < 2)
+		return true;
+	// color and depth renderbuffers, same format as eye textures, wide enough for stereo target
+	int msWidth = stereoFramebuffer? 2*width : width;
+	glGenRenderbuffers(1, &msColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, msColorBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, eyeSamples, eyeFormat, msWidth, height);
+	glGenRenderbuffers(1, &msDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, msDepthBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, eyeSamples, GL_DEPTH_COMPONENT24, msWidth, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &msFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, msFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, msDepthBuffer);
+	bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!ok) {
+		printf("bad multisample frame buffer status\n");
+		SetEyeSamples(1);
+	}
+	return ok;
+}
+
+void VROOM::BindEyeFramebuffer(int eye) {
+	glBindFramebuffer(GL_FRAMEBUFFER, eyeSamples > 1? msFramebuffer : eyeFramebuffers[eye]);
+	glViewport(0, 0, width, height);
+}
+
+void VROOM::ResolveEyeFramebuffer(int eye) {
+	if (eyeSamples < 2)
+		return;
+	// average samples into single-sample eye texture (depth not needed by compositor)
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, msFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, eyeFramebuffers[eye]);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VROOM::SubmitEyeTextures() {
+	SubmitOpenGLFrames(eyeTextures[0], eyeTextures[1]);
+}
+
+// single-pass stereo target
+
+bool VROOM::InitStereoFramebuffer() {
+	glGenFramebuffers(1, &stereoFramebuffer);
+	glGenTextures(1, &stereoTexture);
+	glGenRenderbuffers(1, &stereoDepthBuffer);
+	glBindTexture(GL_TEXTURE_2D, stereoTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, eyeFormat, 2*width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindRenderbuffer(GL_RENDERBUFFER, stereoDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 2*width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, stereoFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, stereoDepthBuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, stereoTexture, 0);
+	bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!ok)
+		printf("bad stereo frame buffer status\n");
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// widen multisample target
+	if (eyeSamples > 1)
+		SetEyeSamples(eyeSamples);
+	return ok;
+}
+
+void VROOM::BindStereoFramebuffer() {
+	glBindFramebuffer(GL_FRAMEBUFFER, eyeSamples > 1? msFramebuffer : stereoFramebuffer);
+	glViewport(0, 0, 2*width, height);
+}
+
+void VROOM::ResolveStereoFramebuffer() {
+	if (eyeSamples < 2)
+		return;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, msFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, stereoFramebuffer);
+	glBlitFramebuffer(0, 0, 2*width, height, 0, 0, 2*width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VROOM::SubmitStereoTexture() {
+	if (!Compositor(mock))
+		return;
+	Texture_t texture = {(void *) (uintptr_t) stereoTexture, TextureType_OpenGL, ColorSpace_Auto};
+	VRTextureBounds_t leftBounds = {0, 0, .5f, 1}, rightBounds = {.5f, 0, 1, 1};
+	Submit(mock, Eye_Left, &texture, &leftBounds);
+	Submit(mock, Eye_Right, &texture, &rightBounds);
+	PresentHandoff(mock);
+}
+
 /*version 1
 #ifdef VROOM_V1
 bool GetHMD(mat4 &hmd, bool print = false) {
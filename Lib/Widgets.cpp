@@ -4,6 +4,7 @@
 #include "Draw.h"
 #include "GLXtras.h"
 #include "Misc.h"
+#include "PixelFormat.h"
 #include "Text.h"
 #include "Widgets.h"
 
@@ -637,8 +638,13 @@ void Magnifier::Display(int2 displayLoc, bool showSrcWindow) {
 	} h;
 	int nxBlocks = displaySize[0]/blockSize, nyBlocks = displaySize[1]/blockSize;
 	int dy = displaySize[1]-nyBlocks*blockSize;
-	float *pixels = new float[nxBlocks*nyBlocks*3];
-	glReadPixels(srcLoc[0], srcLoc[1], nxBlocks, nyBlocks, GL_RGB, GL_FLOAT, pixels);
+	int n = 3*nxBlocks*nyBlocks;
+	unsigned char *bytes = new unsigned char[n];
+	float *pixels = new float[n];
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(srcLoc[0], srcLoc[1], nxBlocks, nyBlocks, GL_RGB, GL_UNSIGNED_BYTE, bytes);
+	ByteToFloat(bytes, pixels, n);
+	delete [] bytes;
 	for (int i = 0; i < nxBlocks; i++)
 		for (int j = 0; j < nyBlocks; j++) {
 			float *pixel = pixels+3*(j*nxBlocks+i);